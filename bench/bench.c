@@ -0,0 +1,445 @@
+/************************************************
+ *
+ *  End-to-end benchmark of shafa: Generates deterministic synthetic corpora and runs
+ *  modules F, T, C and D (and whole round trips) for every block size and thread count
+ *
+ ***********************************************/
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "corpus.h"
+
+#define _1MiB 1048576
+#define MAX_ARGS 16
+
+/**
+\brief Result of a single execution of shafa
+*/
+typedef struct {
+    double seconds;
+    long peak_rss; // KiB
+    bool success;
+} Run;
+
+/**
+\brief Writes a corpus to disk (it's only generated once for every run)
+ @param path Path of the corpus
+ @param corpus Corpus to generate
+ @param size Size of the corpus
+ @returns Success
+*/
+static bool write_corpus(const char * const path, const Corpus * const corpus, const unsigned long size)
+{
+    uint8_t * buffer;
+    FILE * fd;
+    bool success = false;
+
+    buffer = malloc(size);
+
+    if (buffer) {
+        generate_corpus(corpus, buffer, size);
+
+        fd = fopen(path, "wb");
+
+        if (fd) {
+            success = fwrite(buffer, sizeof(uint8_t), size, fd) == size;
+            success = !fclose(fd) && success;
+        }
+
+        free(buffer);
+    }
+
+    return success;
+}
+
+/**
+\brief Copies a file
+ @param from Path of the file
+ @param to Path of the copy
+ @returns Success
+*/
+static bool copy_file(const char * const from, const char * const to)
+{
+    char buffer[65536];
+    size_t size;
+    FILE * fd_from, * fd_to;
+    bool success = false;
+
+    fd_from = fopen(from, "rb");
+
+    if (fd_from) {
+        fd_to = fopen(to, "wb");
+
+        if (fd_to) {
+            success = true;
+
+            while (success && (size = fread(buffer, 1, sizeof(buffer), fd_from)))
+                success = fwrite(buffer, 1, size, fd_to) == size;
+
+            success = !fclose(fd_to) && success && !ferror(fd_from);
+        }
+
+        fclose(fd_from);
+    }
+
+    return success;
+}
+
+/**
+\brief Compares the content of two files
+ @param a Path of the first file
+ @param b Path of the second file
+ @returns Whether they're the same
+*/
+static bool same_files(const char * const a, const char * const b)
+{
+    char buffer_a[65536], buffer_b[65536];
+    size_t size_a, size_b;
+    FILE * fd_a, * fd_b;
+    bool same = false;
+
+    fd_a = fopen(a, "rb");
+    fd_b = fopen(b, "rb");
+
+    if (fd_a && fd_b) {
+        do {
+            size_a = fread(buffer_a, 1, sizeof(buffer_a), fd_a);
+            size_b = fread(buffer_b, 1, sizeof(buffer_b), fd_b);
+            same = size_a == size_b && !memcmp(buffer_a, buffer_b, size_a);
+        } while (same && size_a);
+    }
+
+    if (fd_a)
+        fclose(fd_a);
+    if (fd_b)
+        fclose(fd_b);
+
+    return same;
+}
+
+/**
+\brief Size of a file
+ @param path Path of the file
+ @returns Size of the file (0 if it doesn't exist)
+*/
+static unsigned long long file_size(const char * const path)
+{
+    struct stat info;
+
+    return stat(path, &info) ? 0 : (unsigned long long) info.st_size;
+}
+
+/**
+\brief Executes shafa (its summary is discarded) in the working directory, timing it and measuring its peak RSS
+ @param shafa Path of the executable
+ @param args Arguments (NULL terminated, without the executable)
+ @param directory Working directory
+ @returns Result of the execution
+*/
+static Run run_shafa(const char * const shafa, const char * const * const args, const char * const directory)
+{
+    const char * argv[MAX_ARGS + 2] = { shafa };
+    struct timespec start, end;
+    struct rusage usage;
+    Run run = { .seconds = 0, .peak_rss = 0, .success = false };
+    int status, null_fd;
+    pid_t pid;
+
+    for (int i = 0; args[i] && i < MAX_ARGS; ++i)
+        argv[i + 1] = args[i];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid = fork();
+
+    if (pid == 0) {
+        null_fd = open("/dev/null", O_WRONLY);
+
+        if (null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0 || dup2(null_fd, STDERR_FILENO) < 0 || chdir(directory))
+            _exit(127);
+
+        execv(shafa, (char * const *) argv);
+        _exit(127);
+    }
+
+    // The peak RSS is the child's own, so it's taken from wait4 instead of RUSAGE_CHILDREN (which keeps the maximum of every child)
+    if (pid > 0 && wait4(pid, &status, 0, &usage) == pid) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        run.seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        run.peak_rss = usage.ru_maxrss;
+        run.success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    return run;
+}
+
+/**
+\brief Prints a row of the results' table (tab separated)
+*/
+static void print_row(const char * const corpus, const char * const stage, const char block, const unsigned int threads, const unsigned long long original_size,
+                      const unsigned long long input_size, const unsigned long long output_size, const Run * const run)
+{
+    printf("%s\t%s\t%c\t%u\t%llu\t%llu\t%.6f\t%.2f\t%.4f\t%ld\t%s\n",
+        corpus, stage, block, threads, input_size, output_size, run->seconds,
+        run->seconds > 0 ? original_size / run->seconds / 1e6 : 0, input_size ? (double) output_size / input_size : 0,
+        run->peak_rss, run->success ? "ok" : "failed"
+    );
+    fflush(stdout);
+}
+
+/**
+\brief Keeps the fastest of the repetitions (and the highest peak RSS)
+ @param best Best result so far
+ @param run Result of the last repetition
+*/
+static void keep_best(Run * const best, const Run * const run)
+{
+    if (!best->seconds || run->seconds < best->seconds)
+        best->seconds = run->seconds;
+
+    if (run->peak_rss > best->peak_rss)
+        best->peak_rss = run->peak_rss;
+
+    best->success = best->success && run->success;
+}
+
+/**
+\brief Path of a file generated in the working directory
+ @param path Buffer for the path
+ @param directory Working directory
+ @param name Name of the corpus
+ @param ext Extensions appended to the name
+ @returns The path
+*/
+static const char * output_path(char path[4096], const char * const directory, const char * const name, const char * const ext)
+{
+    // A path too long for the buffer is left empty, so it can't be opened (and the stage fails) instead of naming another file
+    if (snprintf(path, 4096, "%s/%s%s", directory, name, ext) >= 4096)
+        *path = '\0';
+
+    return path;
+}
+
+/**
+\brief Removes every file generated from a corpus in the working directory
+ @param directory Working directory
+ @param name Name of the corpus
+*/
+static void remove_outputs(const char * const directory, const char * const name)
+{
+    static const char * const extensions[] = { "", ".rle", ".freq", ".rle.freq", ".cod", ".rle.cod", ".shaf", ".rle.shaf" };
+    char path[4096];
+
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(*extensions); ++i)
+        remove(output_path(path, directory, name, extensions[i]));
+}
+
+/**
+\brief Benchmarks every stage of a corpus for a block size and a thread count
+ @param shafa Path of the executable
+ @param directory Directory of the corpora
+ @param name Name of the corpus
+ @param block Block size (K/m/M)
+ @param threads Number of threads
+ @param repetitions Number of repetitions of each stage (the fastest one is kept)
+ @returns Whether every stage succeeded (and the original file was given back)
+*/
+static bool bench_corpus(const char * const shafa, const char * const directory, const char * const name, const char block, const unsigned int threads, const int repetitions)
+{
+    char reference[4096], run_dir[4096], path[4096], base[4096], freq[4096], shaf[4096];
+    char block_arg[2] = { block, 0 }, threads_arg[16];
+    unsigned long long original_size, sizes[5][2] = {{0}};
+    Run runs[5], compress, decompress;
+    const char * const stages[5] = { "f", "t", "c", "d", "roundtrip" };
+    bool rle;
+
+    snprintf(reference, sizeof(reference), "%s/%s", directory, name);
+    snprintf(run_dir, sizeof(run_dir), "%s/run", directory);
+    snprintf(threads_arg, sizeof(threads_arg), "%u", threads);
+    original_size = file_size(reference);
+
+    for (int i = 0; i < 5; ++i)
+        runs[i] = (Run) { .seconds = 0, .peak_rss = 0, .success = true };
+
+    for (int repetition = 0; repetition < repetitions; ++repetition) {
+
+        // Modules one by one: F, T, C and D (which gives back the original file)
+        remove_outputs(run_dir, name);
+
+        if (!copy_file(reference, output_path(path, run_dir, name, "")))
+            return false;
+
+        compress = run_shafa(shafa, (const char * []) { name, "-m", "f", "-b", block_arg, "-t", threads_arg, NULL }, run_dir);
+        keep_best(&runs[0], &compress);
+
+        rle = file_size(output_path(path, run_dir, name, ".rle.freq")) > 0;
+        snprintf(base, sizeof(base), "%s%s", name, rle ? ".rle" : "");
+        snprintf(freq, sizeof(freq), "%s%s.freq", name, rle ? ".rle" : "");
+        snprintf(shaf, sizeof(shaf), "%s%s.shaf", name, rle ? ".rle" : "");
+
+        sizes[0][0] = original_size;
+        sizes[0][1] = file_size(output_path(path, run_dir, freq, "")) + (rle ? file_size(output_path(path, run_dir, base, "")) : 0);
+
+        compress = run_shafa(shafa, (const char * []) { freq, "-m", "t", "-t", threads_arg, NULL }, run_dir);
+        keep_best(&runs[1], &compress);
+
+        sizes[1][0] = file_size(output_path(path, run_dir, freq, ""));
+        sizes[1][1] = file_size(output_path(path, run_dir, base, ".cod"));
+
+        compress = run_shafa(shafa, (const char * []) { base, "-m", "c", "-t", threads_arg, NULL }, run_dir);
+        keep_best(&runs[2], &compress);
+
+        sizes[2][0] = file_size(output_path(path, run_dir, base, ""));
+        sizes[2][1] = file_size(output_path(path, run_dir, shaf, ""));
+
+        remove(output_path(path, run_dir, name, ""));
+        remove(output_path(path, run_dir, name, ".rle"));
+
+        decompress = run_shafa(shafa, (const char * []) { shaf, "-m", "d", "-t", threads_arg, NULL }, run_dir);
+        decompress.success = decompress.success && same_files(reference, output_path(path, run_dir, name, ""));
+        keep_best(&runs[3], &decompress);
+
+        sizes[3][0] = sizes[2][1];
+        sizes[3][1] = file_size(output_path(path, run_dir, name, ""));
+
+        // Round trip: Compression in a single pass followed by the decompression
+        remove_outputs(run_dir, name);
+
+        if (!copy_file(reference, output_path(path, run_dir, name, "")))
+            return false;
+
+        compress = run_shafa(shafa, (const char * []) { name, "-b", block_arg, "-t", threads_arg, NULL }, run_dir);
+
+        rle = file_size(output_path(path, run_dir, name, ".rle.shaf")) > 0;
+        snprintf(base, sizeof(base), "%s%s", name, rle ? ".rle" : "");
+        snprintf(shaf, sizeof(shaf), "%s%s.shaf", name, rle ? ".rle" : "");
+
+        sizes[4][0] = original_size;
+        sizes[4][1] = file_size(output_path(path, run_dir, shaf, "")) + file_size(output_path(path, run_dir, base, ".cod"));
+
+        remove(output_path(path, run_dir, name, ""));
+
+        decompress = run_shafa(shafa, (const char * []) { shaf, "-m", "d", "-t", threads_arg, NULL }, run_dir);
+        decompress.success = decompress.success && same_files(reference, output_path(path, run_dir, name, ""));
+
+        compress.seconds += decompress.seconds;
+        compress.peak_rss = compress.peak_rss > decompress.peak_rss ? compress.peak_rss : decompress.peak_rss;
+        compress.success = compress.success && decompress.success;
+        keep_best(&runs[4], &compress);
+    }
+
+    remove_outputs(run_dir, name);
+
+    for (int i = 0; i < 5; ++i)
+        print_row(name, stages[i], block, threads, original_size, sizes[i][0], sizes[i][1], &runs[i]);
+
+    return runs[0].success && runs[1].success && runs[2].success && runs[3].success && runs[4].success;
+}
+
+/**
+\brief Prints how to use the benchmark
+ @param program Name of the executable
+*/
+static void print_usage(const char * const program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <path to shafa>\n"
+        "    -s <MiB>      :  Size of each corpus (default: 16)\n"
+        "    -t <N>        :  Maximum number of threads, runs 1, 2, 4, ... up to N (default: number of processors)\n"
+        "    -r <N>        :  Repetitions of each run, the fastest one is kept (default: 3)\n"
+        "    -d <dir>      :  Directory for the corpora (default: bench_corpus)\n"
+        "    -c <corpus>   :  Only runs one corpus (text, zeros, random, log or runs)\n"
+        "    --generate    :  Only generates the corpora\n",
+        program
+    );
+}
+
+
+int main(const int argc, char * const argv[])
+{
+    const char * directory = "bench_corpus", * only_corpus = NULL;
+    char shafa[4096], path[4096];
+    unsigned long size = 16;
+    long max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int repetitions = 3;
+    bool generate_only = false, success = true;
+    char * program = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--generate") == 0)
+            generate_only = true;
+        else if (argv[i][0] == '-' && strlen(argv[i]) == 2 && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 's': size = strtoul(argv[++i], NULL, 10); break;
+                case 't': max_threads = strtol(argv[++i], NULL, 10); break;
+                case 'r': repetitions = atoi(argv[++i]); break;
+                case 'd': directory = argv[++i]; break;
+                case 'c': only_corpus = argv[++i]; break;
+                default: print_usage(argv[0]); return 1;
+            }
+        }
+        else if (argv[i][0] != '-' && !program)
+            program = argv[i];
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((!program && !generate_only) || !size || max_threads < 1 || repetitions < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // shafa is executed from the working directory, so its path can't be relative
+    if (program && !realpath(program, shafa)) {
+        fprintf(stderr, "Can't find %s\n", program);
+        return 1;
+    }
+
+    mkdir(directory, 0755);
+    snprintf(path, sizeof(path), "%s/run", directory);
+    mkdir(path, 0755);
+
+    // Corpora are only generated if they don't exist with the right size, so every run uses the same files
+    for (size_t c = 0; c < NUM_CORPORA; ++c) {
+        snprintf(path, sizeof(path), "%s/%s", directory, CORPORA[c].name);
+
+        if (file_size(path) != size * _1MiB && !write_corpus(path, &CORPORA[c], size * _1MiB)) {
+            fprintf(stderr, "Can't generate %s\n", path);
+            return 1;
+        }
+    }
+
+    if (generate_only)
+        return 0;
+
+    printf("corpus\tstage\tblock\tthreads\tinput_bytes\toutput_bytes\tseconds\tmb_per_s\tratio\tpeak_rss_kib\tstatus\n");
+
+    for (size_t c = 0; c < NUM_CORPORA; ++c) {
+        if (only_corpus && strcmp(only_corpus, CORPORA[c].name))
+            continue;
+
+        for (const char * block = "KmM"; *block; ++block) {
+            for (long threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2)
+                success = bench_corpus(shafa, directory, CORPORA[c].name, *block, threads, repetitions) && success;
+        }
+    }
+
+    return success ? 0 : 1;
+}
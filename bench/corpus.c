@@ -0,0 +1,143 @@
+/************************************************
+ *
+ *  Deterministic synthetic corpora shared by the benchmarks
+ *
+ ***********************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "corpus.h"
+
+/**
+\brief Next pseudo-random number (xorshift64*), so every corpus is the same on every machine
+ @param state State of the generator
+ @returns Pseudo-random number
+*/
+static inline uint64_t next_random(uint64_t * const state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+\brief English-like text: Words picked with a skewed distribution, separated by spaces, punctuation and new lines
+*/
+static void generate_text(uint8_t * const buffer, const unsigned long size, uint64_t * const state)
+{
+    static const char * const words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be", "by", "on", "not", "he",
+        "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had", "they", "you", "were", "their", "one",
+        "all", "we", "can", "her", "has", "there", "been", "if", "more", "when", "will", "would", "who", "so", "no", "compression",
+        "block", "symbol", "frequency", "algorithm", "shannon", "fano", "decoder", "entropy", "buffer", "thread"
+    };
+    const unsigned long num_words = sizeof(words) / sizeof(*words);
+    unsigned long idx = 0, word;
+    uint64_t random;
+
+    while (idx < size) {
+        random = next_random(state);
+
+        // Multiplying two uniform picks skews them towards the most common words
+        word = ((random & 0xffff) * ((random >> 16) & 0xffff) >> 26) % num_words;
+
+        for (const char * c = words[word]; *c && idx < size; ++c)
+            buffer[idx++] = *c;
+
+        if (idx < size)
+            buffer[idx++] = (random >> 40) % 17 == 0 ? '\n' : (random >> 40) % 11 == 0 ? ',' : ' ';
+    }
+}
+
+/**
+\brief Zero-heavy data (e.g. sparse tables or padded records): One in 16 bytes isn't NULL
+*/
+static void generate_zeros(uint8_t * const buffer, const unsigned long size, uint64_t * const state)
+{
+    uint64_t random;
+
+    for (unsigned long idx = 0; idx < size; ++idx) {
+        random = next_random(state);
+        buffer[idx] = (random & 15) ? 0 : (uint8_t) (random >> 8);
+    }
+}
+
+/**
+\brief Uniformly random bytes (incompressible)
+*/
+static void generate_random(uint8_t * const buffer, const unsigned long size, uint64_t * const state)
+{
+    uint64_t random = 0;
+
+    for (unsigned long idx = 0; idx < size; ++idx) {
+        if (!(idx & 7))
+            random = next_random(state);
+
+        buffer[idx] = (uint8_t) (random >> (idx & 7) * 8);
+    }
+}
+
+/**
+\brief Log-like lines: Increasing timestamps, a few levels and services and varying numbers
+*/
+static void generate_log(uint8_t * const buffer, const unsigned long size, uint64_t * const state)
+{
+    static const char * const levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+    static const char * const services[] = { "reader", "worker", "writer", "scheduler" };
+    static const char * const messages[] = { "request served", "block written", "cache miss", "queue full, waiting", "connection reset" };
+    char line[160];
+    unsigned long idx = 0, milliseconds = 0;
+    uint64_t random;
+    int length;
+
+    while (idx < size) {
+        random = next_random(state);
+        milliseconds += random % 97;
+
+        length = snprintf(line, sizeof(line), "2021-01-%02lu %02lu:%02lu:%02lu.%03lu [%s] %s-%lu: %s id=%lu in %lu ms\n",
+            1 + milliseconds / 86400000 % 28, milliseconds / 3600000 % 24, milliseconds / 60000 % 60, milliseconds / 1000 % 60, milliseconds % 1000,
+            levels[(random >> 8) % 6], services[(random >> 16) % 4], (unsigned long) (random >> 20) % 8, messages[(random >> 24) % 5],
+            (unsigned long) (random >> 32) % 100000, (unsigned long) (random >> 52) % 500);
+
+        for (int i = 0; i < length && idx < size; ++i)
+            buffer[idx++] = line[i];
+    }
+}
+
+/**
+\brief Long runs of the same symbol (the best case of RLE)
+*/
+static void generate_runs(uint8_t * const buffer, const unsigned long size, uint64_t * const state)
+{
+    unsigned long idx = 0, run;
+    uint64_t random;
+
+    while (idx < size) {
+        random = next_random(state);
+
+        for (run = 1 + (random >> 8) % 200; run && idx < size; --run)
+            buffer[idx++] = (uint8_t) (random & 31);
+    }
+}
+
+const Corpus CORPORA[] = {
+    { "text", generate_text },
+    { "zeros", generate_zeros },
+    { "random", generate_random },
+    { "log", generate_log },
+    { "runs", generate_runs },
+};
+
+const size_t NUM_CORPORA = sizeof(CORPORA) / sizeof(*CORPORA);
+
+
+void generate_corpus(const Corpus * const corpus, uint8_t * const buffer, const unsigned long size)
+{
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+    corpus->generate(buffer, size, &state);
+}
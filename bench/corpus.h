@@ -0,0 +1,34 @@
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    Generator of the content of a corpus (writes `size` bytes into `buffer`)
+*/
+typedef void (* Generator)(uint8_t * buffer, unsigned long size, uint64_t * state);
+
+/**
+\brief Corpus generated for the benchmark
+*/
+typedef struct {
+    const char * name;
+    Generator generate;
+} Corpus;
+
+/*
+    Every corpus (text, zeros, random, log and runs)
+*/
+extern const Corpus CORPORA[];
+extern const size_t NUM_CORPORA;
+
+/**
+\brief Generates a corpus. The generator is always seeded the same way, so a corpus is the same on every machine
+ @param corpus Corpus to generate
+ @param buffer Buffer to be filled
+ @param size Size of the corpus
+*/
+void generate_corpus(const Corpus * corpus, uint8_t * buffer, unsigned long size);
+
+#endif //BENCH_CORPUS_H
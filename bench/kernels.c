@@ -0,0 +1,411 @@
+/************************************************
+ *
+ *  Microbenchmark of the hot kernels of shafa: Runs each of them on a block kept in memory (no file IO but
+ *  the stdio of the frequencies' reader) with warm-up and repetitions, and reports their time and its variance
+ *
+ ***********************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_COUNTER
+#endif
+
+#include "corpus.h"
+#include "../src/modules/f.h"
+#include "../src/modules/t.h"
+#include "../src/modules/c.h"
+#include "../src/modules/d.h"
+#include "../src/modules/utils/rle.h"
+#include "../src/modules/utils/codes.h"
+#include "../src/modules/utils/freqs.h"
+#include "../src/modules/utils/buffer_pool.h"
+
+#define _1KiB 1024
+
+/*
+    Each repetition calls the kernel as many times as needed to last at least this long (nanoseconds), so short kernels aren't lost in the clock's resolution
+*/
+#define MIN_REPETITION_TIME 2000000.0
+#define MAX_CALLS 1000000
+
+/**
+\brief A block of a corpus along with everything derived from it that the kernels need as their input
+*/
+typedef struct {
+    const uint8_t * input;
+    unsigned long size;
+    uint8_t * rle; // RLE block
+    unsigned long rle_size;
+    unsigned long frequencies[NUM_SYMBOLS];
+    BlockCodes block_codes; // Canonical codes of the block
+    Code codes[NUM_SYMBOLS];
+    uint8_t * shafa; // Codified block
+    unsigned long shafa_size;
+    uint8_t * output; // Scratch buffer for the output of the kernels
+    FILE * freq_binary; // Frequencies of the block in both formats of the .freq file
+    FILE * freq_text;
+} Fixture;
+
+/*
+    Runs a kernel once over the fixture
+*/
+typedef bool (* Kernel)(Fixture * fixture);
+
+/**
+\brief Kernel to be measured
+*/
+typedef struct {
+    const char * name;
+    Kernel run;
+} KernelBench;
+
+/**
+\brief Time (and cycles) of a call of a kernel, over every repetition
+*/
+typedef struct {
+    double min;    // Nanoseconds
+    double mean;
+    double stddev;
+    double cycles; // Cycles of the fastest repetition (0 without a cycle counter)
+    unsigned long calls; // Calls per repetition
+} Measure;
+
+
+static bool run_block_compression(Fixture * const fixture)
+{
+    return block_compression(fixture->input, fixture->output, fixture->size, fixture->size) == fixture->rle_size;
+}
+
+static bool run_make_freq(Fixture * const fixture)
+{
+    unsigned long frequencies[NUM_SYMBOLS] = {0};
+
+    make_freq(fixture->input, frequencies, fixture->size);
+
+    return frequencies[fixture->input[0]] == fixture->frequencies[fixture->input[0]];
+}
+
+static bool run_read_block(Fixture * const fixture, FILE * const fd, const bool binary)
+{
+    unsigned long frequencies[NUM_SYMBOLS], block_size, original_size;
+
+    rewind(fd);
+
+    return !read_block_freq(fd, binary, &block_size, &original_size, frequencies) && block_size == fixture->size;
+}
+
+static bool run_read_block_binary(Fixture * const fixture)
+{
+    return run_read_block(fixture, fixture->freq_binary, true);
+}
+
+static bool run_read_block_text(Fixture * const fixture)
+{
+    return run_read_block(fixture, fixture->freq_text, false);
+}
+
+static bool run_sf_codes(Fixture * const fixture)
+{
+    uint8_t lengths[NUM_SYMBOLS];
+
+    return !make_block_lengths(fixture->frequencies, lengths);
+}
+
+static bool run_binary_coding(Fixture * const fixture)
+{
+    binary_coding(fixture->codes, fixture->input, fixture->size, 0, NULL, fixture->output);
+
+    return true;
+}
+
+static bool run_shafa_block_decompressor(Fixture * const fixture)
+{
+    uint8_t * block;
+
+    // The decoding table of the block is built by every call (it's negligible next to a block of 64 KiB or more)
+    if (decompress_block(&fixture->block_codes, fixture->shafa, fixture->shafa_size, fixture->size, 0, false, &block))
+        return false;
+
+    buffer_pool_release(block);
+
+    return true;
+}
+
+static bool run_rle_block_decompressor(Fixture * const fixture)
+{
+    unsigned long decoded_size;
+
+    return rle_decode(fixture->rle, fixture->rle_size, fixture->output, fixture->size, &decoded_size) && decoded_size == fixture->size;
+}
+
+static const KernelBench KERNELS[] = {
+    { "block_compression", run_block_compression },
+    { "make_freq", run_make_freq },
+    { "read_block", run_read_block_binary },
+    { "read_block_text", run_read_block_text },
+    { "sf_codes", run_sf_codes },
+    { "binary_coding", run_binary_coding },
+    { "shafa_block_decompressor", run_shafa_block_decompressor },
+    { "rle_block_decompressor", run_rle_block_decompressor },
+};
+
+/**
+\brief Monotonic clock
+ @returns Nanoseconds since an arbitrary point
+*/
+static inline double now()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+/**
+\brief Cycle counter (time stamp counter on x86)
+ @returns Cycles since an arbitrary point (0 without a cycle counter)
+*/
+static inline uint64_t cycles()
+{
+#ifdef CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+\brief Compresses a block the same way as the single pass compression does (RLE, frequencies, canonical codes and codification)
+ @param fixture Fixture with the block, which is filled with everything derived from it
+ @returns Success
+*/
+static bool prepare_fixture(Fixture * const fixture)
+{
+    FILE * fd;
+
+    // The output of RLE may be twice the size of the block
+    fixture->rle = malloc(fixture->size * 2.1);
+
+    if (!fixture->rle)
+        return false;
+
+    fixture->rle_size = block_compression(fixture->input, fixture->rle, fixture->size, fixture->size);
+    make_freq(fixture->input, fixture->frequencies, fixture->size);
+
+    fixture->block_codes.text = NULL;
+
+    if (make_block_lengths(fixture->frequencies, fixture->block_codes.lengths) || build_codes(&fixture->block_codes, fixture->codes))
+        return false;
+
+    if (compress_block(fixture->codes, fixture->input, fixture->size, &fixture->shafa, &fixture->shafa_size))
+        return false;
+
+    // The output buffer is shared by every kernel (RLE's decoder needs some slack past it)
+    fixture->output = malloc((fixture->size * 2.1 > fixture->shafa_size ? fixture->size * 2.1 : fixture->shafa_size) + RLE_DECODE_SLACK);
+
+    if (!fixture->output)
+        return false;
+
+    for (int binary = 0; binary < 2; ++binary) {
+        fd = tmpfile();
+
+        if (!fd || write_block_freq(fd, fixture->size, fixture->size, fixture->frequencies, binary) || write_freq_trailer(fd, binary) || fflush(fd)) {
+            if (fd)
+                fclose(fd);
+            return false;
+        }
+
+        if (binary)
+            fixture->freq_binary = fd;
+        else
+            fixture->freq_text = fd;
+    }
+
+    return true;
+}
+
+/**
+\brief Releases everything derived from the block of a fixture
+ @param fixture Fixture
+*/
+static void release_fixture(Fixture * const fixture)
+{
+    free(fixture->rle);
+    free(fixture->output);
+    buffer_pool_release(fixture->shafa);
+
+    if (fixture->freq_binary)
+        fclose(fixture->freq_binary);
+    if (fixture->freq_text)
+        fclose(fixture->freq_text);
+}
+
+/**
+\brief Measures a kernel: A few warm-up calls (which also find out how many calls each repetition needs) followed by the repetitions
+ @param kernel Kernel
+ @param fixture Input of the kernel
+ @param warm_up Number of warm-up calls
+ @param repetitions Number of repetitions
+ @param measure Measure to be filled
+ @returns Success (false if the kernel failed)
+*/
+static bool measure_kernel(const KernelBench * const kernel, Fixture * const fixture, const int warm_up, const int repetitions, Measure * const measure)
+{
+    double start, elapsed, call_time, sum = 0, sum_squares = 0;
+    uint64_t start_cycles, elapsed_cycles;
+    unsigned long calls;
+
+    start = now();
+
+    for (int i = 0; i < warm_up; ++i)
+        if (!kernel->run(fixture))
+            return false;
+
+    call_time = (now() - start) / warm_up;
+    calls = call_time > 0 ? MIN_REPETITION_TIME / call_time + 1 : MAX_CALLS;
+    calls = calls < MAX_CALLS ? calls : MAX_CALLS;
+
+    *measure = (Measure) { .min = INFINITY, .calls = calls };
+
+    for (int i = 0; i < repetitions; ++i) {
+        start = now();
+        start_cycles = cycles();
+
+        for (unsigned long call = 0; call < calls; ++call)
+            if (!kernel->run(fixture))
+                return false;
+
+        elapsed_cycles = cycles() - start_cycles;
+        elapsed = (now() - start) / calls;
+
+        if (elapsed < measure->min) {
+            measure->min = elapsed;
+            measure->cycles = (double) elapsed_cycles / calls;
+        }
+
+        sum += elapsed;
+        sum_squares += elapsed * elapsed;
+    }
+
+    measure->mean = sum / repetitions;
+    measure->stddev = repetitions > 1 ? sqrt(fmax(0, (sum_squares - sum * sum / repetitions) / (repetitions - 1))) : 0;
+
+    return true;
+}
+
+/**
+\brief Prints how to use the microbenchmark
+ @param program Name of the executable
+*/
+static void print_usage(const char * const program)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "    -b <K/m/M>    :  Blocks size (default: K)\n"
+        "    -r <N>        :  Repetitions of each kernel (default: 20)\n"
+        "    -w <N>        :  Warm-up calls of each kernel (default: 3)\n"
+        "    -c <corpus>   :  Only runs one corpus (text, zeros, random, log or runs)\n"
+        "    -k <kernel>   :  Only runs one kernel\n",
+        program
+    );
+}
+
+
+int main(const int argc, char * const argv[])
+{
+    const char * only_corpus = NULL, * only_kernel = NULL;
+    unsigned long block_size = 640 * _1KiB;
+    int repetitions = 20, warm_up = 3;
+    bool success = true;
+    uint8_t * input;
+    Fixture fixture;
+    Measure measure;
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] == '-' && strlen(argv[i]) == 2 && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'b':
+                    ++i;
+                    block_size = !strcmp(argv[i], "K") ? 640 * _1KiB : !strcmp(argv[i], "m") ? 8 * _1KiB * _1KiB : !strcmp(argv[i], "M") ? 64 * _1KiB * _1KiB : 0;
+                    break;
+                case 'r': repetitions = atoi(argv[++i]); break;
+                case 'w': warm_up = atoi(argv[++i]); break;
+                case 'c': only_corpus = argv[++i]; break;
+                case 'k': only_kernel = argv[++i]; break;
+                default: print_usage(argv[0]); return 1;
+            }
+        }
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!block_size || repetitions < 1 || warm_up < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    input = malloc(block_size);
+
+    if (!input) {
+        fputs("Not enough memory for the block\n", stderr);
+        return 1;
+    }
+
+    printf("kernel\tcorpus\tblock_bytes\tcalls\tmin_us\tmean_us\tstddev_pct\tmb_per_s\tcycles_per_byte\n");
+
+    for (size_t c = 0; c < NUM_CORPORA; ++c) {
+        if (only_corpus && strcmp(only_corpus, CORPORA[c].name))
+            continue;
+
+        generate_corpus(&CORPORA[c], input, block_size);
+
+        fixture = (Fixture) { .input = input, .size = block_size };
+
+        if (!prepare_fixture(&fixture)) {
+            fprintf(stderr, "Can't prepare the block of %s\n", CORPORA[c].name);
+            release_fixture(&fixture);
+            success = false;
+            continue;
+        }
+
+        for (size_t k = 0; k < sizeof(KERNELS) / sizeof(*KERNELS); ++k) {
+            if (only_kernel && strcmp(only_kernel, KERNELS[k].name))
+                continue;
+
+            if (!measure_kernel(&KERNELS[k], &fixture, warm_up, repetitions, &measure)) {
+                fprintf(stderr, "%s failed on %s\n", KERNELS[k].name, CORPORA[c].name);
+                success = false;
+                continue;
+            }
+
+            // Rates are relative to the block the kernel works for (not to the bytes it reads), so kernels are comparable along the pipeline
+            printf("%s\t%s\t%lu\t%lu\t%.3f\t%.3f\t%.2f\t%.2f\t",
+                KERNELS[k].name, CORPORA[c].name, block_size, measure.calls, measure.min / 1e3, measure.mean / 1e3,
+                measure.mean > 0 ? 100 * measure.stddev / measure.mean : 0, block_size / measure.min * 1e9 / (1024 * 1024));
+
+            if (measure.cycles > 0)
+                printf("%.3f\n", measure.cycles / block_size);
+            else
+                printf("-\n");
+        }
+
+        release_fixture(&fixture);
+    }
+
+    free(input);
+
+    return success ? 0 : 1;
+}
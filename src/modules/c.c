@@ -10,262 +10,622 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
-
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "c.h"
+#include "utils/file.h"
+#include "utils/binary.h"
+#include "utils/codes.h"
+#include "utils/stats.h"
 #include "utils/errors.h"
 #include "utils/extensions.h"
+#include "utils/input.h"
+#include "utils/output.h"
+#include "utils/histogram.h"
+#include "utils/rle.h"
+#include "utils/block_index.h"
+#include "utils/table_cache.h"
 #include "utils/multithread.h"
+#include "utils/buffer_pool.h"
+
+/**
+\brief Struct with the parameters that are going to multithread
+*/
+typedef struct {
+    unsigned long block_size;
+    FILE * fd_shafa;
+    unsigned long long shafa_start; // Position of the first block in the SHAFA file
+    CachedTable * codes;
+    const uint8_t * block_input;
+    uint8_t * block_input_allocated; // NULL if the block is mapped from the file
+    uint8_t * block_output;
+    unsigned long * new_block_size;
+    unsigned long * original_size; // Size before RLE for the block index (NULL if there's no index, 0 if the .cod file doesn't keep it)
+    unsigned long sync_interval; // Symbols between the sync points (0 for none)
+    BlockSync * sync;
+    unsigned int num_streams; // Bitstreams the symbols are interleaved into (1 for the usual layout)
+} Arguments;
 
-#define MAX_CODE_INT 32
-#define NUM_SYMBOLS 256
-#define NUM_OFFSETS 8
+// Symbols codified by each task when a block is split in chunks (only blocks larger than a chunk are split)
+#define CHUNK_SIZE (_1KiB * _1KiB)
 
 /**
-\brief Struct with the symbol code, next and index
+\brief Codification of a chunk of a block
 */
 typedef struct {
-    int index;
-    int next; 
-    uint8_t code[MAX_CODE_INT + 1];
-} CodesIndex;
+    uint8_t * output; // Its first byte is shared with the previous chunk unless it starts at a whole byte
+    unsigned long long bit; // Position of the chunk in the codification of the block
+    unsigned long long num_bits;
+} ChunkCode;
 
 /**
-\brief Struct with the parameters that are going to multithread
+\brief Block codified in chunks by separate tasks. Its codification is the chunks' one after the other, which are stitched together by its last chunk's write
 */
 typedef struct {
-    unsigned long block_size;
     FILE * fd_shafa;
-    char * block_codes;
-    uint8_t * block_input;
-    uint8_t * block_output;
+    unsigned long long shafa_start; // Position of the first block in the SHAFA file
+    unsigned long long offset; // Position of the block from the first one (claimed by its last chunk)
+    const uint8_t * block_input;
+    uint8_t * block_input_allocated; // NULL if the block is mapped from the file
+    unsigned long block_size;
+    unsigned long chunk_size;
+    unsigned long num_chunks;
+    ChunkCode * chunks;
     unsigned long * new_block_size;
-} Arguments;
+    unsigned long * original_size; // Size before RLE for the block index (NULL if there's no index, 0 if the .cod file doesn't keep it)
+    unsigned long sync_interval; // Symbols between the sync points (0 for none)
+    BlockSync * sync;
+    atomic_ulong chunks_left; // Chunks not written yet (the last one writes the block)
+    bool incomplete; // Not every chunk was queued
+} SplitBlock;
+
+/**
+\brief Struct with the parameters of a chunk of a block that are going to multithread
+*/
+typedef struct {
+    SplitBlock * block;
+    CachedTable * codes;
+    unsigned long chunk;
+} ArgumentsChunk;
+
+/**
+\brief Stores the 64 bits of the accumulator with the first code's bit in the most significant bit of the first byte
+ @param output Buffer with at least 8 bytes
+ @param accumulator Bits to be stored
+*/
+static inline void flush_accumulator(uint8_t * const output, const uint64_t accumulator)
+{
+#if (defined(__GNUC__) || defined(__clang__)) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint64_t value = __builtin_bswap64(accumulator);
+
+    memcpy(output, &value, sizeof(uint64_t));
+#else
+    for (int i = 0; i < 8; ++i)
+        output[i] = accumulator >> (56 - i * 8);
+#endif
+}
 
 /**
-\brief Aplies algorithm to make the symbols' codification
- @param table Table of codes
+\brief Codifies the symbols of a block as binary_coding does, but starting at any bit of the first byte (its previous bits are left as 0s)
+ @param codes Code of each symbol
  @param block_input Block with original file's bytes
- @param block_size Block size 
- @param new_block_size Block size after codification
- @returns Allocated string of compressed binary
- */
-static uint8_t * binary_coding(CodesIndex * const table, const uint8_t * restrict block_input, const unsigned long block_size, unsigned long * const new_block_size)
+ @param block_size Block size
+ @param first_bit Bit of the first byte where the first code starts (0 to 7)
+ @param sync_interval Symbols between the sync points (0 for none)
+ @param sync_points Array to load the sync points, whose bits are counted from the first byte (NULL without them)
+ @param block_output Buffer with exactly the size of the codified block
+*/
+static inline void code_symbols(const Code codes[NUM_SYMBOLS], const uint8_t * restrict block_input, const unsigned long block_size, const int first_bit, const unsigned long sync_interval, SyncPoint * restrict sync_points, uint8_t * restrict block_output)
 {
-    CodesIndex * symbol;
-    int next = 0, num_bytes_code;
-    uint8_t * code, * output;
+    const uint8_t * const start_input = block_input, * const start_output = block_output, * const end = block_input + block_size;
+    const uint8_t * chunk_end;
+    uint64_t accumulator = 0, bits;
+    int free_bits = 64 - first_bit, length, left_over;
 
-    uint8_t * const block_output = calloc(block_size * 1.05, sizeof(uint8_t)); // Uncompressed Block Size + 5% which is a big margin for the new compressed block size
+    while (block_input < end) {
 
-    if (!block_output)
-        return NULL;
+        // The block is coded in chunks of sync_interval symbols, and the end of each one (but the last) is a sync point
+        chunk_end = sync_interval && (unsigned long) (end - block_input) > sync_interval ? block_input + sync_interval : end;
 
-    output = block_output;
-    
-    for (unsigned long idx = 0; idx < block_size; ++idx) {
-        symbol = &table[next + *block_input++];
+        while (block_input < chunk_end) {
+            bits = codes[*block_input].bits;
+            length = codes[*block_input++].length;
+
+            if (length < free_bits) {
+                free_bits -= length;
+                accumulator |= bits << free_bits;
+            }
+            else {
+                // The code doesn't fit, so the accumulator is completed with its first bits and the rest start the next one
+                left_over = length - free_bits;
+                accumulator |= bits >> left_over;
 
-        num_bytes_code = symbol->index;
-        code = symbol->code;
+                flush_accumulator(block_output, accumulator);
+                block_output += 8;
 
-        for (int i = 0; i < num_bytes_code; ++i)
-            *output++ |= *code++;
-        
-        // Even if the compiler won't store it in a registry it will be cached
-        *output |= *code;
+                free_bits = 64 - left_over;
+                accumulator = left_over ? bits << free_bits : 0;
+            }
+        }
 
-        next = symbol->next;
+        if (chunk_end < end)
+            *sync_points++ = (SyncPoint) { .symbol = chunk_end - start_input, .bit = (unsigned long long) (block_output - start_output) * 8 + 64 - free_bits };
     }
 
-    *new_block_size = output - block_output + (next ? 1 : 0);
+    // Last bits (the last byte is padded with 0s)
+    for (int idx = 0; idx < (64 - free_bits + 7) / 8; ++idx, accumulator <<= 8)
+        *block_output++ = accumulator >> 56;
+}
 
-    return block_output;
+void binary_coding(const Code codes[NUM_SYMBOLS], const uint8_t * restrict block_input, const unsigned long block_size, const unsigned long sync_interval, SyncPoint * restrict sync_points, uint8_t * restrict block_output)
+{
+    code_symbols(codes, block_input, block_size, 0, sync_interval, sync_points, block_output);
 }
 
 /**
-\brief Generates table of codes
- @param _args Structure with all arguments needed to this function
+\brief Calculates the size of the codification of a block from its frequencies
+ @param codes Code of each symbol
+ @param block_input Block with original/RLE file's bytes
+ @param block_size Block size
+ @param num_bits Pointer to load the size of the codification (in bits)
  @returns Error status
 */
-static _modules_error compress_to_buffer(void * const _args)
+static _modules_error codification_bits(const Code codes[NUM_SYMBOLS], const uint8_t * const block_input, const unsigned long block_size, unsigned long long * const num_bits)
 {
-    Arguments * args = (Arguments *) _args;
-    const char * block_codes = args->block_codes;
-    const uint8_t * block_input = args->block_input;
-    const unsigned long block_size = args->block_size;
-    unsigned long * const new_block_size = args->new_block_size;
-
-    CodesIndex header_symbol_row, *symbol_row;
-    char cur_char, next_char;
-    int bit_idx, code_idx;
-    uint8_t byte, next_byte_prefix = 0, mask;
-
-    CodesIndex (* table)[NUM_SYMBOLS] = calloc(1, sizeof(CodesIndex[NUM_OFFSETS][NUM_SYMBOLS]));
- 
-    if (!table)
-        return _LACK_OF_MEMORY;
+    unsigned long frequencies[NUM_SYMBOLS];
 
-    /*
-    /
-    /    Table's header initialization
-    /
-    */
+    histogram(block_input, block_size, frequencies);
 
-    cur_char = *block_codes++;
-    next_char = *block_codes++;
-    for (int syb_idx = 0; syb_idx < NUM_SYMBOLS; ++syb_idx) {
+    *num_bits = 0;
 
-        code_idx = 0;
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol) {
 
-        for ( ; cur_char != ';' && cur_char != '\0' && code_idx < MAX_CODE_INT; ++code_idx) {
-            byte = 0;
-            for (bit_idx = 0; bit_idx < 8; ++bit_idx) {
+        // Every symbol of the block needs a code
+        if (frequencies[symbol] && !codes[symbol].length)
+            return _FILE_UNRECOGNIZABLE;
 
-                if (cur_char == '1')
-                    ++byte;
-                else if (cur_char != '0') {
-                    free(args->block_codes);
-                    free(table);
-                    return _FILE_UNRECOGNIZABLE;
-                }
+        *num_bits += (unsigned long long) frequencies[symbol] * codes[symbol].length;
+    }
 
-                if (bit_idx < 7) {
-                    if (next_char == ';') {
-                        byte <<= 7 - bit_idx;
-                        cur_char = next_char;
-                        next_char = *block_codes++;
-                        break;
-                    }
-                    else if (next_char == '\0') {
-                        byte <<= 7 - bit_idx;
-                        cur_char = next_char;
-                        break;
-                    }
-                    else
-                        byte <<= 1;
-                }
-                
-                cur_char = next_char;
-                next_char = *block_codes++;
+    return _SUCCESS;
+}
 
-            }
-            table[0][syb_idx].code[code_idx] = byte;
-        }
+_modules_error compress_block_sync(const Code codes[NUM_SYMBOLS], const uint8_t * const block_input, const unsigned long block_size, const unsigned long sync_interval, BlockSync * const sync, uint8_t ** const block_output, unsigned long * const new_block_size)
+{
+    unsigned long long num_bits;
+    _modules_error error;
 
-        if (code_idx > 0) {
-            table[0][syb_idx].next = (bit_idx != 8) ? (bit_idx + 1) * NUM_SYMBOLS : 0;
-            table[0][syb_idx].index = code_idx - (bit_idx < 8 ? 1 : 0);
-        }
+    // The size of the codified block is known beforehand from its frequencies
+    error = codification_bits(codes, block_input, block_size, &num_bits);
 
-        if (cur_char != '\0') {
-            cur_char = next_char;
-            next_char = *block_codes++;
-        }
-        else if (syb_idx < NUM_SYMBOLS - 1) { // if end of codes' block but still hasn't iterated over 256 symbols
-            free(args->block_codes);
-            free(table);
+    if (error)
+        return error;
+
+    // A sync point every sync_interval symbols, but the start of the block
+    if (sync_interval && block_size > sync_interval) {
+        sync->num_points = (block_size - 1) / sync_interval;
+        sync->points = malloc(sync->num_points * sizeof(SyncPoint));
+
+        if (!sync->points)
+            return _LACK_OF_MEMORY;
+    }
+
+    *new_block_size = (num_bits + 7) / 8;
+    *block_output = buffer_pool_acquire(*new_block_size);
+
+    if (!*block_output)
+        return _LACK_OF_MEMORY;
+
+    binary_coding(codes, block_input, block_size, sync_interval, sync_interval ? sync->points : NULL, *block_output);
+
+    return _SUCCESS;
+}
+
+_modules_error compress_block(const Code codes[NUM_SYMBOLS], const uint8_t * const block_input, const unsigned long block_size, uint8_t ** const block_output, unsigned long * const new_block_size)
+{
+    return compress_block_sync(codes, block_input, block_size, 0, NULL, block_output, new_block_size);
+}
+
+_modules_error compress_block_streams(const Code codes[NUM_SYMBOLS], const uint8_t * const block_input, const unsigned long block_size, const unsigned int num_streams, uint8_t ** const block_output, unsigned long * const new_block_size)
+{
+    unsigned long long num_bits[MAX_STREAMS] = { 0 };
+    unsigned long stream_sizes[MAX_STREAMS];
+    unsigned long idx, size;
+    unsigned int stream = 0;
+    uint8_t * symbols, * output;
+
+    // Symbol i goes to stream i % num_streams
+    for (idx = 0; idx < block_size; ++idx) {
+
+        // Every symbol of the block needs a code
+        if (!codes[block_input[idx]].length)
             return _FILE_UNRECOGNIZABLE;
-        }
 
+        num_bits[stream] += codes[block_input[idx]].length;
+        stream = stream + 1 == num_streams ? 0 : stream + 1;
+    }
+
+    // The sizes of every stream but the last go before the streams
+    *new_block_size = (num_streams - 1) * 8;
+
+    for (stream = 0; stream < num_streams; ++stream) {
+        stream_sizes[stream] = (num_bits[stream] + 7) / 8;
+        *new_block_size += stream_sizes[stream];
     }
-    free(args->block_codes);
 
-    if (cur_char != '\0') { // Check whether file is actually correct (Not required but it is an assert)
-        free(table);
-        return _FILE_UNRECOGNIZABLE;
+    *block_output = buffer_pool_acquire(*new_block_size);
+    symbols = buffer_pool_acquire(block_size / num_streams + 1);
+
+    if (!*block_output || !symbols) {
+        buffer_pool_release(*block_output);
+        buffer_pool_release(symbols);
+        return _LACK_OF_MEMORY;
     }
 
+    output = *block_output + (num_streams - 1) * 8;
 
-    /*
-    /
-    /    Table's body initialization
-    /
-    */
+    for (stream = 0; stream < num_streams; ++stream) {
 
-    for (int idx = 0, new_index; idx < NUM_SYMBOLS; ++idx) {
+        if (stream + 1 < num_streams)
+            store_le64(*block_output + stream * 8, stream_sizes[stream]);
 
-        header_symbol_row = table[0][idx];
+        // The symbols of the stream are gathered to be codified as a block of their own
+        for (idx = stream, size = 0; idx < block_size; idx += num_streams)
+            symbols[size++] = block_input[idx];
 
-        if (header_symbol_row.next || header_symbol_row.index) {
+        binary_coding(codes, symbols, size, 0, NULL, output);
+        output += stream_sizes[stream];
+    }
 
-            for (int offset = 1, bit_offset; offset < NUM_OFFSETS; ++offset) {
+    buffer_pool_release(symbols);
 
-                symbol_row = &table[offset][idx];
+    return _SUCCESS;
+}
 
-                bit_offset = (header_symbol_row.next / NUM_SYMBOLS) + offset;
-                new_index = header_symbol_row.index + (bit_offset < 8 ? 0: 1);
-                symbol_row->index = new_index;
-                symbol_row->next = ((bit_offset < 8) ? bit_offset : bit_offset - 8) * NUM_SYMBOLS;
+_modules_error write_block_shafa(FILE * const fd_shafa, const unsigned long long shafa_start, const uint8_t * const block_output, const unsigned long new_block_size)
+{
+    char header[24];
+    const int header_size = sprintf(header, "@%lu@", new_block_size);
+    const unsigned long long offset = shafa_start + multithread_offset(header_size + new_block_size);
+    _modules_error error;
 
-                next_byte_prefix = 0;
-                for (code_idx = 0; code_idx < new_index; ++code_idx) {
+    error = output_write(fd_shafa, offset, header, header_size);
 
-                    byte = header_symbol_row.code[code_idx];
-                    symbol_row->code[code_idx] = (byte >> offset) | (next_byte_prefix << (8 - offset));
+    if (!error)
+        error = output_write(fd_shafa, offset + header_size, block_output, new_block_size);
 
-                    mask = (1 << offset) - 1;
-                    next_byte_prefix = byte & mask;
+    return error;
+}
 
-                }
+/**
+\brief Builds the encoding table of a block, i.e. the code of each symbol
+ @param block_codes Codes of a block as stored in the .cod file
+ @param table Address to load the allocated table
+ @returns Error status
+*/
+static _modules_error build_encoding_table(const BlockCodes * const block_codes, void ** const table)
+{
+    _modules_error error;
+    Code * const codes = malloc(NUM_SYMBOLS * sizeof(Code));
+
+    if (!codes)
+        return _LACK_OF_MEMORY;
+
+    error = build_codes(block_codes, codes);
+
+    if (error)
+        free(codes);
+    else
+        *table = codes;
+
+    return error;
+}
+
+// Blocks with the same codes share their encoding table
+static TableCache ENCODING_TABLES = { .build = build_encoding_table, .destroy = free };
+
+/**
+\brief Gets the table of codes (shared with blocks with the same codes) and compresses the block
+ @param _args Structure with all arguments needed to this function
+ @returns Error status
+*/
+static _modules_error compress_to_buffer(void * const _args)
+{
+    Arguments * args = (Arguments *) _args;
+    const void * codes = NULL;
+    _modules_error error;
+
+    error = table_cache_acquire(&ENCODING_TABLES, args->codes, &codes);
+
+    if (!error && args->num_streams > 1)
+        error = compress_block_streams(codes, args->block_input, args->block_size, args->num_streams, &args->block_output, args->new_block_size);
+    else if (!error)
+        error = compress_block_sync(codes, args->block_input, args->block_size, args->sync_interval, args->sync, &args->block_output, args->new_block_size);
+
+    table_cache_release(&ENCODING_TABLES, args->codes, codes);
+
+    // Textual .cod files don't keep the size before RLE, so it's calculated from the RLE block
+    if (!error && args->original_size && !*args->original_size && !rle_decoded_size(args->block_input, args->block_size, args->original_size))
+        error = _FILE_UNRECOGNIZABLE;
+
+    buffer_pool_release(args->block_input_allocated);
+
+    // Each block is written at its own position as soon as it's ready
+    if (!error)
+        error = write_block_shafa(args->fd_shafa, args->shafa_start, args->block_output, *args->new_block_size);
+
+    buffer_pool_release(args->block_output);
+
+    return error;
+}
 
-                // This will only execute if next != 0 (which is the same as bit_offset != 8) Because this iteration is unnecessary
-                if (bit_offset != 8) {
-                    byte = header_symbol_row.code[new_index];
-                    symbol_row->code[new_index] = (byte >> offset) | (next_byte_prefix << (8 - offset));
+/**
+\brief Releases the arguments of a block (it was already written by compress_to_buffer)
+ @param _args Structure with all arguments needed to this function 
+ @param prev_error Error before calling this function
+ @param error Error after calling this function
+ @returns Error status
+*/
+static _modules_error release_shafa(void * const _args, _modules_error prev_error, _modules_error error)
+{
+    (void) prev_error;
+    free(_args);
+    return error;
+}
+
+/**
+\brief Codifies a chunk of a block right after the previous chunks, whose size is known once it's its turn to claim an offset
+ @param _args Structure with all arguments needed to this function
+ @returns Error status
+*/
+static _modules_error compress_chunk(void * const _args)
+{
+    ArgumentsChunk * args = (ArgumentsChunk *) _args;
+    SplitBlock * block = args->block;
+    ChunkCode * const chunk = &block->chunks[args->chunk];
+    const unsigned long start = args->chunk * block->chunk_size;
+    const unsigned long size = (args->chunk + 1 < block->num_chunks ? start + block->chunk_size : block->block_size) - start;
+    const bool last = args->chunk + 1 == block->num_chunks;
+    SyncPoint * points = NULL;
+    const void * codes = NULL;
+    unsigned long num_points;
+    char header[24];
+    _modules_error error;
+
+    error = table_cache_acquire(&ENCODING_TABLES, args->codes, &codes);
+
+    if (!error)
+        error = codification_bits(codes, block->block_input + start, size, &chunk->num_bits);
+
+    if (!error) {
+
+        // Chunks take their turn in order after their size is known, so the size of the previous ones is known by then
+        if (last)
+            multithread_turn();
+        else
+            multithread_offset(0);
+
+        chunk->bit = 0;
+        for (unsigned long i = 0; i < args->chunk; ++i)
+            chunk->bit += block->chunks[i].num_bits;
+
+        // The last chunk knows the size of the whole block, so it claims its room
+        if (last) {
+            *block->new_block_size = (chunk->bit + chunk->num_bits + 7) / 8;
+            block->offset = multithread_offset(sprintf(header, "@%lu@", *block->new_block_size) + *block->new_block_size);
+        }
+
+        chunk->output = buffer_pool_acquire((chunk->bit % 8 + chunk->num_bits + 7) / 8 + 1);
+
+        if (chunk->output) {
+
+            // Chunks start at a sync point (their size is a multiple of sync_interval) and the ones inside them are loaded in their position
+            if (block->sync_interval)
+                points = block->sync->points + start / block->sync_interval;
+
+            code_symbols(codes, block->block_input + start, size, chunk->bit % 8, block->sync_interval, points, chunk->output);
+
+            if (block->sync_interval) {
+                num_points = (size - 1) / block->sync_interval;
+
+                for (unsigned long i = 0; i < num_points; ++i) {
+                    points[i].symbol += start;
+                    points[i].bit += chunk->bit - chunk->bit % 8;
                 }
+
+                if (args->chunk)
+                    points[-1] = (SyncPoint) { .symbol = start, .bit = chunk->bit };
             }
         }
+        else
+            error = _LACK_OF_MEMORY;
     }
 
-    
-    /*
-    /
-    /    Write compressed code
-    /
-    */
+    table_cache_release(&ENCODING_TABLES, args->codes, codes);
 
-    
-    args->block_output = binary_coding((CodesIndex *) table, block_input, block_size, new_block_size);
+    // Textual .cod files don't keep the size before RLE, so it's calculated from the RLE block
+    if (!error && !args->chunk && block->original_size && !*block->original_size && !rle_decoded_size(block->block_input, block->block_size, block->original_size))
+        error = _FILE_UNRECOGNIZABLE;
 
-    free(table);    
+    return error;
+}
 
-    if (!args->block_output)
-        return _LACK_OF_MEMORY;
+/**
+\brief Writes a block codified in chunks to the SHAFA file. Each chunk takes the last byte of the previous one when they share it
+ @param block Block codified in chunks
+ @returns Error status
+*/
+static _modules_error write_split_block(SplitBlock * const block)
+{
+    char header[24];
+    const int header_size = sprintf(header, "@%lu@", *block->new_block_size);
+    const unsigned long long offset = block->shafa_start + block->offset + header_size;
+    ChunkCode * chunk;
+    unsigned long size;
+    _modules_error error;
 
-    return _SUCCESS;
+    error = output_write(block->fd_shafa, offset - header_size, header, header_size);
+
+    for (unsigned long i = 0; i < block->num_chunks && !error; ++i) {
+        chunk = &block->chunks[i];
+        size = (chunk->bit + chunk->num_bits + 7) / 8 - chunk->bit / 8;
+
+        if (i + 1 < block->num_chunks && (chunk->bit + chunk->num_bits) % 8)
+            block->chunks[i + 1].output[0] |= chunk->output[--size];
+
+        error = output_write(block->fd_shafa, offset + chunk->bit / 8, chunk->output, size);
+    }
+
+    return error;
 }
 
 /**
-\brief Writes codification to file
+\brief Releases the share of a block of its chunks, the last one releasing the block itself
+ @param block Block codified in chunks
+ @param chunks Number of chunks
+*/
+static void release_split_block(SplitBlock * const block, const unsigned long chunks)
+{
+    if (atomic_fetch_sub(&block->chunks_left, chunks) != chunks)
+        return;
+
+    for (unsigned long i = 0; i < block->num_chunks; ++i)
+        buffer_pool_release(block->chunks[i].output);
+
+    buffer_pool_release(block->block_input_allocated);
+    free(block);
+}
+
+/**
+\brief Releases the arguments of a chunk of a block. The last chunk writes the block (every chunk was codified by then)
  @param _args Structure with all arguments needed to this function 
- @param prev_error Error before calling this functione
+ @param prev_error Error before calling this function
  @param error Error after calling this function
  @returns Error status
 */
-static _modules_error write_shafa(void * const _args, _modules_error prev_error, _modules_error error)
+static _modules_error release_chunk(void * const _args, _modules_error prev_error, _modules_error error)
 {
-    Arguments * args = (Arguments *) _args;
-    FILE * const fd_shafa = args->fd_shafa;
-    uint8_t * const block_output = args->block_output;
-    const unsigned long new_block_size = *args->new_block_size;
+    SplitBlock * block = ((ArgumentsChunk *) _args)->block;
 
-    if (!error) {
-        if (!prev_error) {
-            if (fprintf(fd_shafa, "@%lu@", new_block_size) >= 2) {
+    free(_args);
 
-                if (fwrite(block_output, sizeof(uint8_t), new_block_size, fd_shafa) != new_block_size)
-                    error = _FILE_STREAM_FAILED;
-            }
-            else
-                error = _FILE_STREAM_FAILED;
+    if (atomic_load(&block->chunks_left) == 1 && !block->incomplete && !error && !prev_error)
+        error = write_split_block(block);
+
+    release_split_block(block, 1);
+
+    return error;
+}
 
+/**
+\brief Queues a block as a task for each of its chunks, so they're codified in parallel
+ Warning: This function isn't thread-safe itself
+ @param fd_shafa SHAFA file's handle (flushed)
+ @param shafa_start Position of the first block in the SHAFA file
+ @param block_input Block with original/RLE file's bytes
+ @param block_input_allocated Block if it was allocated, NULL if it's mapped from the file (it belongs to the chunks from now on, even on error)
+ @param block_size Block size
+ @param new_block_size Pointer to load the block size after codification
+ @param original_size Pointer to the size before RLE for the block index (NULL if there's no index, 0 if the .cod file doesn't keep it)
+ @param sync_interval Symbols between the sync points (0 for none)
+ @param sync Zeroed sync points of the block (NULL without them)
+ @param codes Entry of the encoding table of the block (its reference belongs to the chunks from now on, even on error)
+ @returns Error status
+*/
+static _modules_error queue_split_block(FILE * const fd_shafa, const unsigned long long shafa_start, const uint8_t * const block_input, uint8_t * const block_input_allocated, const unsigned long block_size,
+    unsigned long * const new_block_size, unsigned long * const original_size, const unsigned long sync_interval, BlockSync * const sync, CachedTable * const codes)
+{
+    // Chunks start at a sync point, so their size is a multiple of sync_interval
+    const unsigned long chunk_size = sync_interval ? (CHUNK_SIZE + sync_interval - 1) / sync_interval * sync_interval : CHUNK_SIZE;
+    const unsigned long num_chunks = (block_size + chunk_size - 1) / chunk_size;
+    _modules_error error = _SUCCESS;
+    SplitBlock * block;
+    unsigned long chunk;
+    ArgumentsChunk * args;
+
+    // The codification of each chunk goes along with the block
+    block = malloc(sizeof(SplitBlock) + num_chunks * sizeof(ChunkCode));
+
+    // A block up to a single interval has no sync points (the start of the block isn't one)
+    if (block && sync_interval && block_size > sync_interval) {
+        sync->num_points = (block_size - 1) / sync_interval;
+        sync->points = malloc(sync->num_points * sizeof(SyncPoint));
+
+        if (!sync->points) {
+            free(block);
+            block = NULL;
         }
+    }
 
-        free(block_output); 
+    if (!block) {
+        buffer_pool_release(block_input_allocated);
+        table_cache_release(&ENCODING_TABLES, codes, NULL);
+        return _LACK_OF_MEMORY;
+    }
+
+    *block = (SplitBlock) {
+        .fd_shafa = fd_shafa,
+        .shafa_start = shafa_start,
+        .offset = 0,
+        .block_input = block_input,
+        .block_input_allocated = block_input_allocated,
+        .block_size = block_size,
+        .chunk_size = chunk_size,
+        .num_chunks = num_chunks,
+        .chunks = (ChunkCode *) (block + 1),
+        .new_block_size = new_block_size,
+        .original_size = original_size,
+        .sync_interval = sync_interval,
+        .sync = sync,
+        .incomplete = false
+    };
+
+    // The output of every chunk is released along with the block, even if it wasn't codified
+    memset(block->chunks, 0, num_chunks * sizeof(ChunkCode));
+
+    atomic_init(&block->chunks_left, block->num_chunks);
+
+    // Each chunk holds a reference to the encoding table
+    for (chunk = 1; chunk < block->num_chunks; ++chunk)
+        table_cache_reference(codes);
+
+    // The memory of the whole block (input and codification) was already reserved, and it goes along with the first chunk
+    for (chunk = 0; chunk < block->num_chunks; ++chunk) {
+
+        args = malloc(sizeof(ArgumentsChunk));
+        if (!args) {
+            error = _LACK_OF_MEMORY;
+            break;
+        }
+
+        *args = (ArgumentsChunk) {
+            .block = block,
+            .codes = codes,
+            .chunk = chunk
+        };
+
+        error = multithread_create(compress_chunk, release_chunk, args);
+        if (error) {
+            free(args);
+            break;
+        }
+    }
+
+    // The chunks that weren't queued give up their share of the block and the encoding table
+    if (error) {
+        block->incomplete = true;
+
+        for (unsigned long i = chunk; i < block->num_chunks; ++i)
+            table_cache_release(&ENCODING_TABLES, codes, NULL);
+
+        release_split_block(block, block->num_chunks - chunk);
     }
 
-    free(_args);
     return error;
 }
+
 /**
 \brief Prints the results of the program execution
  @param num_blocks Number of blocks analysed
@@ -284,7 +644,8 @@ static inline void print_summary(const unsigned long long num_blocks, const unsi
         "Module: C (Symbol codes' codification)\n"
         "Number of blocks: %lu\n", num_blocks
     );
-    for (unsigned long long i = 0; i < num_blocks; ++i) {
+    // The quiet summary leaves out the line of each block
+    for (unsigned long long i = 0; i < num_blocks && STATS != STATS_QUIET; ++i) {
         block_input_size = blocks_input_size[i];
         block_output_size = blocks_output_size[i];
         printf("Size before/after & compression rate (Block %lu): %lu/%lu -> %d%%\n", i, block_input_size, block_output_size, (int) (((float) block_output_size / block_input_size) * 100));
@@ -298,7 +659,7 @@ static inline void print_summary(const unsigned long long num_blocks, const unsi
 }
 
 
-_modules_error shafa_compress(char ** const path)
+_modules_error shafa_compress(char ** const path, const bool index, const unsigned long sync_interval, const unsigned int num_streams)
 {
     FILE * fd_file, * fd_codes, * fd_shafa;
     Arguments * args;
@@ -306,12 +667,20 @@ _modules_error shafa_compress(char ** const path)
     char * path_file = *path;
     char * path_codes;
     char * path_shafa;
-    char * block_codes;
+    char mode;
+    BlockCodes block_codes;
+    CachedTable * codes;
     unsigned long long num_blocks;
-    unsigned long block_size;
+    int header_size;
+    unsigned long block_size, original_size;
+    bool canonical;
     int error = _SUCCESS;
-    uint8_t * block_input;
-    unsigned long * blocks_size = NULL, * blocks_input_size, * blocks_output_size;
+    _modules_error thread_error;
+    InputFile input;
+    const uint8_t * block_input;
+    uint8_t * block_input_allocated;
+    unsigned long * blocks_size = NULL, * blocks_input_size, * blocks_output_size, * blocks_original_size;
+    BlockSync * blocks_sync = NULL;
 
     clock_main_thread(START_CLOCK);
     
@@ -325,7 +694,7 @@ _modules_error shafa_compress(char ** const path)
 
         if (fd_codes) {
 
-            if (fscanf(fd_codes, "@%*c@%lu", &num_blocks) == 1) {
+            if (!read_codes_header(fd_codes, &mode, &num_blocks, &canonical)) {
 
                 // Open File's handle
                 fd_file = fopen(path_file, "rb");
@@ -343,77 +712,119 @@ _modules_error shafa_compress(char ** const path)
 
                         if (fd_shafa) {
 
-                            if (fprintf(fd_shafa, "@%lu", num_blocks) >= 2) {
+                            // Blocks are written by the threads at their own positions, so nothing can be left buffered (interleaved blocks are marked by their number of streams)
+                            if (num_streams > 1)
+                                header_size = fprintf(fd_shafa, "@%lu#%u", num_blocks, num_streams);
+                            else
+                                header_size = fprintf(fd_shafa, "@%lu", num_blocks);
+
+                            if (header_size >= 2 && !fflush(fd_shafa)) {
 
-                                blocks_size = malloc(2 * num_blocks * sizeof(unsigned long));
+                                blocks_size = malloc(3 * num_blocks * sizeof(unsigned long));
 
-                                if (blocks_size) {
+                                // Sync points of each block for the block index
+                                if (sync_interval)
+                                    blocks_sync = calloc(num_blocks + 1, sizeof(BlockSync));
+
+                                if (blocks_size && (blocks_sync || !sync_interval)) {
                                     
                                     blocks_input_size = blocks_size;
                                     blocks_output_size = blocks_input_size + num_blocks; // Acts as a "virtual" array
+                                    blocks_original_size = blocks_output_size + num_blocks;
+
+                                    // The file is mapped whenever possible so blocks don't need to be copied
+                                    input_open(&input, fd_file);
 
                                     for (unsigned long long thread_idx = 0; thread_idx < num_blocks; ++thread_idx) {
 
-                                        block_codes = malloc((33151 + 1 + 1) * sizeof(char)); //sum 1 to 256 (worst case shannon fano) + 255 semicolons + 1 byte NULL + 1 algorithm efficiency (exchange 2 * 256 + 2 compares for +1 byte in heap and +1 memory access)
+                                        error = read_block_codes(fd_codes, canonical, &block_size, &original_size, &block_codes);
+
+                                        if (error)
+                                            break;
 
-                                        if (!block_codes) {
+                                        codes = table_cache_get(&ENCODING_TABLES, &block_codes);
+
+                                        if (!codes) {
                                             error = _LACK_OF_MEMORY;
                                             break;
                                         }
 
-                                        if (fscanf(fd_codes,"@%lu@%33151[^@]", &block_size, block_codes) != 2) {
-                                            free(block_codes);
-                                            error = _FILE_STREAM_FAILED;
+                                        // Input and output blocks (Shannon Fano's codes average less than 9 bits per symbol) along with the codes
+                                        error = multithread_reserve(block_size * 2.125 + BLOCK_CODES_SIZE);
+
+                                        if (error) {
+                                            table_cache_release(&ENCODING_TABLES, codes, NULL);
                                             break;
                                         }
 
-                                        args = malloc(sizeof(Arguments));
+                                        error = input_block(&input, block_size, &block_input, &block_input_allocated);
 
-                                        if (!args) {
-                                            free(block_codes);
-                                            error = _LACK_OF_MEMORY;
+                                        if (error) {
+                                            table_cache_release(&ENCODING_TABLES, codes, NULL);
                                             break;
                                         }
-                                            
-                                        block_input = malloc(block_size * sizeof(uint8_t));
 
-                                        if (!block_input) {
-                                            free(block_codes);
-                                            free(args);
-                                            error = _LACK_OF_MEMORY;
-                                            break;
+                                        blocks_input_size[thread_idx] = block_size;
+                                        blocks_original_size[thread_idx] = mode == 'R' ? original_size : block_size;
+
+                                        // Blocks larger than a chunk are codified in parallel by a task for each chunk (interleaved streams are codified as a whole)
+                                        if (block_size > CHUNK_SIZE && num_streams == 1) {
+                                            error = queue_split_block(fd_shafa, header_size, block_input, block_input_allocated, block_size, &blocks_output_size[thread_idx],
+                                                index ? &blocks_original_size[thread_idx] : NULL, sync_interval, blocks_sync ? &blocks_sync[thread_idx] : NULL, codes);
+                                            if (error)
+                                                break;
+                                            continue;
                                         }
 
-                                        if (fread(block_input, sizeof(uint8_t), block_size, fd_file) != block_size) {
-                                            free(block_codes);
-                                            free(block_input);
-                                            free(args);
-                                            error = _FILE_STREAM_FAILED;
+                                        args = malloc(sizeof(Arguments));
+
+                                        if (!args) {
+                                            table_cache_release(&ENCODING_TABLES, codes, NULL);
+                                            buffer_pool_release(block_input_allocated);
+                                            error = _LACK_OF_MEMORY;
                                             break;
                                         }
 
                                         *args = (Arguments) {
                                             .block_size = block_size,
                                             .fd_shafa = fd_shafa,
-                                            .block_codes = block_codes,
+                                            .shafa_start = header_size,
+                                            .codes = codes,
                                             .block_input = block_input,
+                                            .block_input_allocated = block_input_allocated,
                                             .block_output = NULL,
-                                            .new_block_size = &blocks_output_size[thread_idx]
+                                            .new_block_size = &blocks_output_size[thread_idx],
+                                            .original_size = index ? &blocks_original_size[thread_idx] : NULL,
+                                            .sync_interval = sync_interval,
+                                            .sync = blocks_sync ? &blocks_sync[thread_idx] : NULL,
+                                            .num_streams = num_streams
                                         };
-
-                                        blocks_input_size[thread_idx] = block_size;
                                                     
-                                        error = multithread_create(compress_to_buffer, write_shafa, args);
+                                        error = multithread_create(compress_to_buffer, release_shafa, args);
 
                                         if (error) {
-                                            free(block_codes);
-                                            free(block_input);
+                                            table_cache_release(&ENCODING_TABLES, codes, NULL);
+                                            buffer_pool_release(block_input_allocated);
                                             free(args);
                                             break;
                                         }
                                         
                                     }
-                                    multithread_wait();
+                                    thread_error = multithread_wait();
+
+                                    if (!error)
+                                        error = thread_error;
+
+                                    // The index goes after the last block, whose position is only known now
+                                    if (!error && index)
+                                        error = write_block_index(fd_shafa, header_size, num_blocks, blocks_output_size, blocks_original_size, blocks_sync);
+
+                                    for (unsigned long long i = 0; blocks_sync && i < num_blocks; ++i)
+                                        free(blocks_sync[i].points);
+
+                                    table_cache_clear(&ENCODING_TABLES);
+                                    buffer_pool_clear();
+                                    input_close(&input);
                                 }
                                 else
                                     error = _LACK_OF_MEMORY;
@@ -457,11 +868,15 @@ _modules_error shafa_compress(char ** const path)
 
         total_time = clock_main_thread(STOP_CLOCK);
 
-        print_summary(num_blocks, blocks_input_size, blocks_output_size, total_time, path_shafa);     
+        if (STATS == STATS_JSON)
+            stats_print(stdout, "C", total_time);
+        else
+            print_summary(num_blocks, blocks_input_size, blocks_output_size, total_time, path_shafa);     
     }
 
     if (blocks_size)
         free(blocks_size);
+    free(blocks_sync);
 
     return error;
 }
@@ -1,13 +1,82 @@
 #ifndef MODULE_C_H
 #define MODULE_C_H
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utils/codes.h"
 #include "utils/errors.h"
+#include "utils/block_index.h"
 
 /**
 \brief Compresses file with Shannon Fano's algorithm and saves it to disk
  @param path Pointer to the original/RLE file's path
+ @param index Append the block index to the SHAFA file (so module D can decompress a range of it)
+ @param sync_interval Symbols between the sync points of each block, which are kept in the block index (0 for none)
+ @param num_streams Bitstreams the symbols of each block are interleaved into (1 for the usual layout, which is the only one with sync points)
+ @returns Error status
+*/
+_modules_error shafa_compress(char ** path, bool index, unsigned long sync_interval, unsigned int num_streams);
+
+/**
+\brief Aplies algorithm to make the symbols' codification
+ The codes are appended to a 64 bits accumulator, which is written to the output whenever it gets full
+ @param codes Code of each symbol
+ @param block_input Block with original file's bytes
+ @param block_size Block size 
+ @param sync_interval Symbols between the sync points (0 for none)
+ @param sync_points Array to load the (block_size - 1) / sync_interval sync points (NULL without them)
+ @param block_output Buffer with exactly the size of the codified block
+ */
+void binary_coding(const Code codes[NUM_SYMBOLS], const uint8_t * restrict block_input, unsigned long block_size, unsigned long sync_interval, SyncPoint * restrict sync_points, uint8_t * restrict block_output);
+
+/**
+\brief Compresses a single block with Shannon Fano's algorithm
+ @param codes Code of each symbol
+ @param block_input Block with original/RLE file's bytes
+ @param block_size Block size
+ @param block_output Address to load a buffer of the pool with the compressed block (released with buffer_pool_release)
+ @param new_block_size Block size after codification
+ @returns Error status
+*/
+_modules_error compress_block(const Code codes[NUM_SYMBOLS], const uint8_t * block_input, unsigned long block_size, uint8_t ** block_output, unsigned long * new_block_size);
+
+/**
+\brief Compresses a single block with Shannon Fano's algorithm and records its sync points, where module D can start decoding it
+ @param codes Code of each symbol
+ @param block_input Block with original/RLE file's bytes
+ @param block_size Block size
+ @param sync_interval Symbols between the sync points (0 for none)
+ @param sync Zeroed sync points of the block, where an allocated array with them is loaded (unless the block is no longer than sync_interval)
+ @param block_output Address to load a buffer of the pool with the compressed block (released with buffer_pool_release)
+ @param new_block_size Block size after codification
+ @returns Error status
+*/
+_modules_error compress_block_sync(const Code codes[NUM_SYMBOLS], const uint8_t * block_input, unsigned long block_size, unsigned long sync_interval, BlockSync * sync, uint8_t ** block_output, unsigned long * new_block_size);
+
+/**
+\brief Compresses a single block with Shannon Fano's algorithm into interleaved bitstreams: symbol i goes to stream i % num_streams, so module D decodes the streams at once
+ The compressed block is the size of each stream but the last (8 bytes each) followed by the streams
+ @param codes Code of each symbol
+ @param block_input Block with original/RLE file's bytes
+ @param block_size Block size
+ @param num_streams Number of streams (2 to MAX_STREAMS)
+ @param block_output Address to load a buffer of the pool with the compressed block (released with buffer_pool_release)
+ @param new_block_size Block size after codification
+ @returns Error status
+*/
+_modules_error compress_block_streams(const Code codes[NUM_SYMBOLS], const uint8_t * block_input, unsigned long block_size, unsigned int num_streams, uint8_t ** block_output, unsigned long * new_block_size);
+
+/**
+\brief Writes a compressed block ("@size@" followed by the block) to the SHAFA file at the position claimed with multithread_offset
+ Warning: Must be called from the `process` function of a task
+ @param fd_shafa SHAFA file's handle (flushed)
+ @param shafa_start Position of the first block in the SHAFA file
+ @param block_output Compressed block
+ @param new_block_size Size of the compressed block
  @returns Error status
 */
-_modules_error shafa_compress(char ** path);
+_modules_error write_block_shafa(FILE * fd_shafa, unsigned long long shafa_start, const uint8_t * block_output, unsigned long new_block_size);
 
 #endif //MODULE_C_H
\ No newline at end of file
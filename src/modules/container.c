@@ -0,0 +1,528 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdbool.h>
+
+#include "stream.h"
+#include "container.h"
+#include "utils/file.h"
+#include "utils/input.h"
+#include "utils/output.h"
+#include "utils/binary.h"
+#include "utils/stats.h"
+#include "utils/errors.h"
+#include "utils/extensions.h"
+#include "utils/multithread.h"
+#include "utils/buffer_pool.h"
+#include "utils/block_index.h"
+
+/**
+\brief Struct with the parameters that are going to multithread while compressing
+*/
+typedef struct {
+    bool force_rle;
+    FILE * fd_container;
+    unsigned long block_size;
+    const uint8_t * block_input;
+    uint8_t * block_input_allocated; // NULL if the block is mapped from the file
+    unsigned long long * block_offset; // Position of the block's header in the container
+    unsigned long * new_block_size;
+} ArgumentsCompress;
+
+/**
+\brief Struct with the parameters that are going to multithread while decompressing
+*/
+typedef struct {
+    FILE * f_wrt;
+    StreamBlock block;
+    const uint8_t * block_shafa; // Points to the container, which is kept until every block is decompressed
+    unsigned long slice_start; // Part of the decompressed block to be written
+    unsigned long slice_size;
+} ArgumentsDecompress;
+
+/**
+\brief Prints the results of the program execution
+ @param decompression Whether the container was decompressed
+ @param num_blocks Number of blocks
+ @param input_size Size of the input file
+ @param output_size Size of the generated file
+ @param total_time Time that the program took to execute
+ @param path The path to the generated file
+*/
+static inline void print_summary(const bool decompression, const unsigned long long num_blocks, const unsigned long long input_size, const unsigned long long output_size, const double total_time, const char * const path)
+{
+    printf(
+        "Module: %s\n"
+        "Number of blocks: %llu\n"
+        "Size before/after: %llu/%llu\n"
+        "Module runtime (milliseconds): %f\n"
+        "Generated file %s\n",
+        decompression ? "D (container decoding)" : "F+T+C (container encoding)",
+        num_blocks, input_size, output_size, total_time, path
+    );
+}
+
+/**
+\brief Compresses a block on its own and writes it (header and codification) at its own position of the container
+ @param _args Structure with all arguments needed to this function
+ @returns Error status
+*/
+static _modules_error compress_container_block(void * const _args)
+{
+    ArgumentsCompress * args = (ArgumentsCompress *) _args;
+    StreamBlock block;
+    uint8_t header[STREAM_BLOCK_HEADER_SIZE], * block_output = NULL;
+    _modules_error error;
+
+    error = stream_encode_block(args->block_input, args->block_size, args->force_rle, &block, &block_output);
+
+    buffer_pool_release(args->block_input_allocated);
+
+    if (!error) {
+        *args->new_block_size = STREAM_BLOCK_HEADER_SIZE + block.new_block_size;
+        *args->block_offset = CONTAINER_HEADER_SIZE + multithread_offset(*args->new_block_size);
+
+        stream_store_header(&block, header);
+
+        error = output_write(args->fd_container, *args->block_offset, header, STREAM_BLOCK_HEADER_SIZE);
+
+        if (!error)
+            error = output_write(args->fd_container, *args->block_offset + STREAM_BLOCK_HEADER_SIZE, block_output, block.new_block_size);
+    }
+
+    buffer_pool_release(block_output);
+
+    return error;
+}
+
+/**
+\brief Releases the arguments of a block (it was already written by its `process` function)
+ @param _args Structure with all arguments needed to this function
+ @param prev_error Error before calling this function
+ @param error Error after calling this function
+ @returns Error status
+*/
+static _modules_error release_container_block(void * const _args, _modules_error prev_error, _modules_error error)
+{
+    (void) prev_error;
+    free(_args);
+    return error;
+}
+
+/**
+\brief Writes the index of the container after its last block
+ @param fd_container Container's handle (flushed)
+ @param num_blocks Number of blocks
+ @param blocks_offset Position of each block's header
+ @param blocks_output_size Size of each block in the container
+ @param blocks_input_size Size of each block once decompressed
+ @param container_size Pointer to load the size of the whole container
+ @returns Error status
+*/
+static _modules_error write_container_index(FILE * const fd_container, const unsigned long long num_blocks, const unsigned long long * const blocks_offset, const unsigned long * const blocks_output_size, const unsigned long * const blocks_input_size, unsigned long long * const container_size)
+{
+    const unsigned long size = num_blocks * CONTAINER_ENTRY_SIZE + CONTAINER_TRAILER_SIZE;
+    unsigned long long index_start = CONTAINER_HEADER_SIZE;
+    uint8_t * index;
+    _modules_error error;
+
+    index = malloc(size);
+
+    if (!index)
+        return _LACK_OF_MEMORY;
+
+    for (unsigned long long i = 0; i < num_blocks; ++i) {
+        store_le64(index + i * CONTAINER_ENTRY_SIZE, blocks_offset[i]);
+        store_le64(index + i * CONTAINER_ENTRY_SIZE + 8, blocks_input_size[i]);
+        index_start += blocks_output_size[i];
+    }
+
+    // The trailer points back to the index so it's found from the end of the container
+    store_le64(index + num_blocks * CONTAINER_ENTRY_SIZE, index_start);
+    memcpy(index + num_blocks * CONTAINER_ENTRY_SIZE + 8, CONTAINER_MAGIC, 4);
+
+    error = output_write(fd_container, index_start, index, size);
+    free(index);
+
+    *container_size = index_start + size;
+
+    return error;
+}
+
+
+_modules_error container_compress(char ** const path, const bool force_rle, const unsigned long block_size)
+{
+    FILE * fd_file, * fd_container;
+    ArgumentsCompress * args;
+    float total_time;
+    char * path_file = *path, * path_container = NULL;
+    long long num_blocks;
+    long size_of_last_block;
+    unsigned long the_block_size = block_size, cur_block_size;
+    unsigned long * blocks_size = NULL, * blocks_input_size, * blocks_output_size;
+    unsigned long long * blocks_offset = NULL, size_f, container_size;
+    uint8_t header[CONTAINER_HEADER_SIZE];
+    InputFile input;
+    const uint8_t * block_input;
+    uint8_t * block_input_allocated;
+    _modules_error error = _SUCCESS, thread_error;
+
+    clock_main_thread(START_CLOCK);
+
+    fd_file = fopen(path_file, "rb");
+
+    if (fd_file) {
+
+        num_blocks = fsize(fd_file, NULL, &the_block_size, &size_of_last_block);
+
+        if (num_blocks > 0) {
+
+            size_f = (num_blocks - 1) * the_block_size + size_of_last_block;
+
+            blocks_size = malloc(2 * num_blocks * sizeof(unsigned long));
+            blocks_offset = malloc(num_blocks * sizeof(unsigned long long));
+            path_container = add_ext(path_file, CONTAINER_EXT);
+
+            if (blocks_size && blocks_offset && path_container) {
+
+                blocks_input_size = blocks_size;
+                blocks_output_size = blocks_input_size + num_blocks; // Acts as a "virtual" array
+
+                fd_container = fopen(path_container, "wb");
+
+                if (fd_container) {
+
+                    memcpy(header, CONTAINER_MAGIC, 4);
+                    header[4] = CONTAINER_VERSION;
+                    store_le64(header + 5, num_blocks);
+                    store_le64(header + 13, size_f);
+
+                    // Blocks are written by the threads at their own positions, so nothing can be left buffered
+                    if (fwrite(header, sizeof(uint8_t), CONTAINER_HEADER_SIZE, fd_container) == CONTAINER_HEADER_SIZE && !fflush(fd_container)) {
+
+                        // The file is mapped whenever possible so blocks don't need to be copied
+                        input_open(&input, fd_file);
+
+                        for (long long block_idx = 0; block_idx < num_blocks; ++block_idx) {
+
+                            cur_block_size = (block_idx == num_blocks - 1) ? (unsigned long) size_of_last_block : the_block_size;
+
+                            // Input, RLE (up to 2.1 times the input) and output blocks (less than 9 bits per codified symbol)
+                            error = multithread_reserve(cur_block_size * (1 + 2.1 + 2.1 * 1.125));
+
+                            if (error)
+                                break;
+
+                            error = input_block(&input, cur_block_size, &block_input, &block_input_allocated);
+
+                            if (error)
+                                break;
+
+                            args = malloc(sizeof(ArgumentsCompress));
+
+                            if (!args) {
+                                buffer_pool_release(block_input_allocated);
+                                error = _LACK_OF_MEMORY;
+                                break;
+                            }
+
+                            *args = (ArgumentsCompress) {
+                                .force_rle = force_rle,
+                                .fd_container = fd_container,
+                                .block_size = cur_block_size,
+                                .block_input = block_input,
+                                .block_input_allocated = block_input_allocated,
+                                .block_offset = &blocks_offset[block_idx],
+                                .new_block_size = &blocks_output_size[block_idx]
+                            };
+
+                            blocks_input_size[block_idx] = cur_block_size;
+
+                            error = multithread_create(compress_container_block, release_container_block, args);
+
+                            if (error) {
+                                buffer_pool_release(block_input_allocated);
+                                free(args);
+                                break;
+                            }
+                        }
+                        thread_error = multithread_wait();
+
+                        if (!error)
+                            error = thread_error;
+
+                        // The index goes after the last block, whose position is only known now
+                        if (!error)
+                            error = write_container_index(fd_container, num_blocks, blocks_offset, blocks_output_size, blocks_input_size, &container_size);
+
+                        buffer_pool_clear();
+                        input_close(&input);
+                    }
+                    else
+                        error = _FILE_STREAM_FAILED;
+
+                    fclose(fd_container);
+                }
+                else
+                    error = _FILE_INACCESSIBLE;
+            }
+            else
+                error = _LACK_OF_MEMORY;
+        }
+        else
+            error = _FILE_STREAM_FAILED;
+
+        fclose(fd_file);
+    }
+    else
+        error = _FILE_INACCESSIBLE;
+
+    if (!error) {
+        *path = path_container;
+        free(path_file);
+
+        total_time = clock_main_thread(STOP_CLOCK);
+
+        if (STATS == STATS_JSON)
+            stats_print(stdout, "F+T+C (container)", total_time);
+        else
+            print_summary(false, num_blocks, size_f, container_size, total_time, path_container);
+    }
+    else
+        free(path_container);
+
+    free(blocks_size);
+    free(blocks_offset);
+
+    return error;
+}
+
+/**
+\brief Decompresses a block of the container and writes it (or the part of it inside the range) at its own position of the file
+ @param _args Structure with all arguments needed to this function
+ @returns Error status
+*/
+static _modules_error decompress_container_block(void * const _args)
+{
+    ArgumentsDecompress * args = (ArgumentsDecompress *) _args;
+    uint8_t * block_output;
+    unsigned long size;
+    _modules_error error;
+
+    error = stream_decode_block(&args->block, args->block_shafa, &block_output);
+
+    if (!error) {
+        size = args->block.block_size - args->slice_start;
+
+        error = output_write(args->f_wrt, multithread_offset(size < args->slice_size ? size : args->slice_size), block_output + args->slice_start, size < args->slice_size ? size : args->slice_size);
+        buffer_pool_release(block_output);
+    }
+
+    return error;
+}
+
+/**
+\brief Loads the index of the container
+ @param container Whole container
+ @param container_size Size of the container
+ @param num_blocks Number of blocks (from the container's header)
+ @param entries Address to load an allocated array with the entry of each block (its compressed size isn't kept by the index)
+ @returns Error status
+*/
+static _modules_error load_container_index(const uint8_t * const container, const unsigned long long container_size, const unsigned long long num_blocks, IndexEntry ** const entries)
+{
+    const uint8_t * trailer = container + container_size - CONTAINER_TRAILER_SIZE, * entry;
+    const unsigned long long index_start = load_le64(trailer);
+    IndexEntry * new_entries;
+
+    // The entries must fill the space between the last block and the trailer (a container is never written without blocks)
+    if (!num_blocks || memcmp(trailer + 8, CONTAINER_MAGIC, 4) || index_start < CONTAINER_HEADER_SIZE || index_start > container_size - CONTAINER_TRAILER_SIZE
+        || (container_size - CONTAINER_TRAILER_SIZE - index_start) / CONTAINER_ENTRY_SIZE != num_blocks || (container_size - CONTAINER_TRAILER_SIZE - index_start) % CONTAINER_ENTRY_SIZE)
+        return _FILE_UNRECOGNIZABLE;
+
+    new_entries = malloc(num_blocks * sizeof(IndexEntry));
+
+    if (!new_entries)
+        return _LACK_OF_MEMORY;
+
+    entry = container + index_start;
+    for (unsigned long long i = 0; i < num_blocks; ++i, entry += CONTAINER_ENTRY_SIZE) {
+        new_entries[i] = (IndexEntry) { .offset = load_le64(entry), .compressed_size = 0, .original_size = load_le64(entry + 8) };
+
+        // Every block's header must lie before the index
+        if (new_entries[i].offset < CONTAINER_HEADER_SIZE || new_entries[i].offset > index_start || index_start - new_entries[i].offset < STREAM_BLOCK_HEADER_SIZE) {
+            free(new_entries);
+            return _FILE_UNRECOGNIZABLE;
+        }
+    }
+
+    *entries = new_entries;
+
+    return _SUCCESS;
+}
+
+
+_modules_error container_decompress(char ** const path, const ByteRange * const range)
+{
+    FILE * f_container, * f_wrt;
+    ArgumentsDecompress * args;
+    float total_time;
+    char * path_container = *path, * path_wrt = NULL;
+    long file_size;
+    unsigned long long num_blocks, original_size, first_block = 0, num_tasks = 0, range_left = 0, output_size = 0;
+    unsigned long slice_start = 0, slice_size;
+    IndexEntry * index = NULL, * entry;
+    StreamBlock block;
+    InputFile input;
+    const uint8_t * container;
+    uint8_t * container_allocated = NULL;
+    _modules_error error = _SUCCESS, thread_error;
+
+    clock_main_thread(START_CLOCK);
+
+    f_container = fopen(path_container, "rb");
+
+    if (f_container) {
+
+        if (!fseek(f_container, 0, SEEK_END) && (file_size = ftell(f_container)) >= 0 && !fseek(f_container, 0, SEEK_SET)) {
+
+            // The whole container is mapped (or loaded with a single read) and parsed from memory
+            input_open(&input, f_container);
+
+            if (file_size >= CONTAINER_HEADER_SIZE + CONTAINER_TRAILER_SIZE)
+                error = input_block(&input, file_size, &container, &container_allocated);
+            else
+                error = _FILE_UNRECOGNIZABLE;
+
+            if (!error) {
+
+                num_blocks = load_le64(container + 5);
+                original_size = load_le64(container + 13);
+
+                if (!memcmp(container, CONTAINER_MAGIC, 4) && container[4] == CONTAINER_VERSION)
+                    error = load_container_index(container, file_size, num_blocks, &index);
+                else
+                    error = _FILE_UNRECOGNIZABLE;
+            }
+
+            if (!error) {
+
+                num_tasks = num_blocks;
+
+                // Only the blocks overlapping the range are decompressed (a range past the end of the original file is refused before the file is created)
+                if (range) {
+                    error = find_range_blocks(index, num_blocks, range, &first_block, &num_tasks, &slice_start);
+                    range_left = range->size;
+                }
+            }
+
+            if (!error) {
+
+                path_wrt = rm_ext(path_container);
+
+                if (path_wrt) {
+
+                    f_wrt = fopen(path_wrt, "wb");
+
+                    if (f_wrt) {
+
+                        for (unsigned long long task_idx = 0; task_idx < num_tasks; ++task_idx) {
+
+                            entry = &index[first_block + task_idx];
+
+                            // The header of the block must agree with the index and its codification must lie before the index
+                            error = stream_load_header(container + entry->offset, &block);
+
+                            if (!error && (block.block_size != entry->original_size || file_size - entry->offset - STREAM_BLOCK_HEADER_SIZE < block.new_block_size))
+                                error = _FILE_UNRECOGNIZABLE;
+
+                            // RLE and decompressed blocks (the codification is already in memory)
+                            if (!error)
+                                error = multithread_reserve(block.rle_block_size + (block.mode == 'R' ? block.block_size : 0));
+
+                            if (error)
+                                break;
+
+                            args = malloc(sizeof(ArgumentsDecompress));
+
+                            if (!args) {
+                                error = _LACK_OF_MEMORY;
+                                break;
+                            }
+
+                            // Only the part of the block inside the range is written
+                            slice_size = ULONG_MAX;
+
+                            if (range) {
+                                slice_start = task_idx ? 0 : slice_start;
+                                slice_size = block.block_size - slice_start < range_left ? block.block_size - slice_start : range_left;
+                                range_left -= slice_size;
+                            }
+
+                            *args = (ArgumentsDecompress) {
+                                .f_wrt = f_wrt,
+                                .block = block,
+                                .block_shafa = container + entry->offset + STREAM_BLOCK_HEADER_SIZE,
+                                .slice_start = slice_start,
+                                .slice_size = slice_size
+                            };
+
+                            output_size += slice_size < block.block_size ? slice_size : block.block_size;
+
+                            error = multithread_create(decompress_container_block, release_container_block, args);
+
+                            if (error) {
+                                free(args);
+                                break;
+                            }
+                        }
+                        thread_error = multithread_wait();
+
+                        if (!error)
+                            error = thread_error;
+
+                        // Every block must add up to the size of the original file
+                        if (!error && !range && output_size != original_size)
+                            error = _FILE_UNRECOGNIZABLE;
+
+                        fclose(f_wrt);
+                    }
+                    else
+                        error = _FILE_INACCESSIBLE;
+                }
+                else
+                    error = _LACK_OF_MEMORY;
+            }
+
+            buffer_pool_release(container_allocated);
+            buffer_pool_clear();
+            input_close(&input);
+        }
+        else
+            error = _FILE_STREAM_FAILED;
+
+        fclose(f_container);
+    }
+    else
+        error = _FILE_INACCESSIBLE;
+
+    if (!error) {
+        *path = path_wrt;
+        free(path_container);
+
+        total_time = clock_main_thread(STOP_CLOCK);
+
+        if (STATS == STATS_JSON)
+            stats_print(stdout, "D (container)", total_time);
+        else
+            print_summary(true, num_tasks, file_size, output_size, total_time, path_wrt);
+    }
+    else
+        free(path_wrt);
+
+    free(index);
+
+    return error;
+}
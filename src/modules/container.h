@@ -0,0 +1,38 @@
+#ifndef MODULE_CONTAINER_H
+#define MODULE_CONTAINER_H
+
+#include <stdbool.h>
+
+#include "utils/errors.h"
+#include "utils/block_index.h"
+
+/*
+    Container (binary), a single file with everything needed to decompress it:
+        "SHFC" | version (1 byte) | number of blocks (8 bytes) | size of the original file (8 bytes)
+        Each block: the same header as a block of a stream (sizes, mode and lengths of the canonical codes) | codification
+        Index: for each block, the position of its header (8 bytes) and its size once decompressed (8 bytes) | position of the index (8 bytes) | "SHFC"
+*/
+#define CONTAINER_MAGIC "SHFC"
+#define CONTAINER_VERSION 1
+#define CONTAINER_HEADER_SIZE 21
+#define CONTAINER_ENTRY_SIZE 16
+#define CONTAINER_TRAILER_SIZE 12
+
+/**
+\brief Compresses a file into a single container (.shafc) with the codes of each block inlined and a trailing index of the blocks
+ @param path Pointer to the original file's path
+ @param force_rle Force execution of RLE's algorithm even if % of compression <= 5%
+ @param block_size Size of each block
+ @returns Error status
+*/
+_modules_error container_compress(char ** path, bool force_rle, unsigned long block_size);
+
+/**
+\brief Decompresses a container, which is mapped (or loaded with a single read) and parsed from memory
+ @param path Pointer to the container's path
+ @param range Only decompresses the blocks overlapping this range and saves the range itself (NULL for the whole file)
+ @returns Error status
+*/
+_modules_error container_decompress(char ** path, const ByteRange * range);
+
+#endif //MODULE_CONTAINER_H
@@ -10,13 +10,25 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
-
+#include "d.h"
 #include "utils/file.h"
+#include "utils/binary.h"
+#include "utils/input.h"
+#include "utils/output.h"
+#include "utils/codes.h"
+#include "utils/freqs.h"
+#include "utils/rle.h"
+#include "utils/stats.h"
 #include "utils/errors.h"
 #include "utils/extensions.h"
 #include "utils/multithread.h"
+#include "utils/buffer_pool.h"
+#include "utils/table_cache.h"
+#include "utils/block_index.h"
 
 #define NUM_SYMBOLS 256
 
@@ -55,7 +67,8 @@ static inline void print_summary (double time, unsigned long * decomp_sizes, uns
     else 
         printf("Module: D (SHAFA & RLE decoding)\n");
 
-    for (unsigned long long i = 0; i < length; ++i) 
+    // The quiet summary leaves out the line of each block
+    for (unsigned long long i = 0; i < length && STATS != STATS_QUIET; ++i) 
         printf("Size before/after generating file (block %lu): %lu/%lu\n", i + 1, decomp_sizes[i], new_sizes[i]);
     printf(
         "Module runtime (in milliseconds): %f\n"
@@ -65,35 +78,6 @@ static inline void print_summary (double time, unsigned long * decomp_sizes, uns
 }
 
 
-/**
-\brief Loads the rle file to a buffer and saves it
- @param f_rle Pointer to the RLE file
- @param block_size Size of the block to be loaded
- @param buffer Address to a string to load a block of RLE content
- @returns Error status
-*/
-static _modules_error load_rle (FILE* f_rle, unsigned long block_size, uint8_t ** buffer) 
-{
-    _modules_error error = _SUCCESS;
-
-    // Memory allocation for the buffer that will contain the contents of one block of symbols
-    *buffer = malloc(block_size);
-    if (*buffer) {
-        // The function fread loads the said contents into the buffer
-        // For the correct execution, the amount read by fread has to match the amount that was supposed to be read: block_size
-        if (fread(*buffer, sizeof(uint8_t), block_size, f_rle) != block_size) {
-            error = _FILE_STREAM_FAILED;
-            *buffer = NULL; 
-        }
-
-    } 
-    else 
-        error = _LACK_OF_MEMORY;
-
-
-    return error;
-}
-
 /**
  \brief Arguments to the RLE multithread
 */
@@ -102,12 +86,29 @@ typedef struct {
     FILE * f_rle;
     FILE * f_wrt;
     unsigned long rle_block_size;
+    unsigned long original_size; // 0 if unknown
     unsigned long * final_sizes;
-    uint8_t * buffer;
+    const uint8_t * buffer;
+    uint8_t * allocated; // NULL if the buffer is mapped from the RLE file
     uint8_t * sequence;
     
 } ArgumentsRLE;
 
+/**
+\brief Size of the buffer to hold a decompressed block when its size wasn't recorded and its RLE block isn't decoded yet (only used to account for its memory)
+ @param block_size Size of the RLE block
+ @param original_size Size of the decompressed block (0 if unknown)
+ @returns Size of the buffer to hold the decompressed block in the worst case
+*/
+static unsigned long rle_size_bound (unsigned long block_size, unsigned long original_size)
+{
+    if (original_size)
+        return original_size + RLE_DECODE_SLACK;
+
+    // Each byte of RLE is at most RLE_MAX_EXPANSION symbols and no block is larger than 64 MiB
+    return (block_size < _64MiB / RLE_MAX_EXPANSION ? block_size * RLE_MAX_EXPANSION : _64MiB) + RLE_DECODE_SLACK;
+}
+
 /**
 \brief Decompresses a RLE block
  @param args Arguments necessary to the function
@@ -119,110 +120,78 @@ static _modules_error rle_block_decompressor (void * _args)
     ArgumentsRLE * args = (ArgumentsRLE *) _args;  
     unsigned long block_size = args->rle_block_size;
     unsigned long * final_sizes = args->final_sizes;
-    uint8_t * buffer = args->buffer;
+    unsigned long orig_size = args->original_size;
+    const uint8_t * buffer = args->buffer;
     uint8_t * sequence;
-    unsigned long orig_size, l;
-    char simb;
-    uint8_t n_reps;
-
-    // Assumption of the smallest size possible for the decompressed file
-    if (block_size <= _64KiB) 
-        orig_size = _64KiB + _1KiB;
-    else if (block_size <= _640KiB) 
-        orig_size = _640KiB + _1KiB;
-    else if (block_size <= _8MiB)
-        orig_size = _8MiB + _1KiB;
-    else 
-        orig_size = _64MiB + _1KiB;
 
-    // Allocation of the corresponding memory 
-    sequence = malloc(orig_size);
-    if (sequence) {
+    // Files that don't record the size before RLE (textual formats) get it calculated beforehand, so there's still a single allocation
+    if (orig_size || rle_decoded_size(buffer, block_size, &orig_size)) {
 
-        // Loop to decompress block by block
-        l = 0; // Variable to be used to go through the sequence string 
-        for (unsigned long i = 0; i < block_size; ++i) {
-            
-            simb = buffer[i];
-            n_reps = 0;
-            // Case of RLE pattern {0}char{n_rep} 
-            if (!simb) {
-                simb = buffer[++i];
-                n_reps = buffer[++i];
-            } 
-            // Re-allocation of memory in the string
-            if (l + n_reps > orig_size) {
-                switch (orig_size) {
-                    case _64KiB + _1KiB:
-                        orig_size = _640KiB + _1KiB;
-                        break;
-                    case _640KiB + _1KiB:
-                        orig_size = _8MiB + _1KiB;
-                        break;
-                    case _8MiB + _1KiB:
-                        orig_size = _64MiB + _1KiB;
-                        break;
-                    default: // Invalid size
-                        error = _FILE_UNRECOGNIZABLE;
-                        free(sequence);
-                        return error;
-                }
-                sequence = realloc(sequence, orig_size);
-                // In case of realloc failure, we free the previous memory allocation
-                if (!sequence) {
-                    error = _LACK_OF_MEMORY;
-                    free(sequence); // Frees the previously allocated memory
-                    break;
-                }
+        // Allocation of the corresponding memory (along with the slack for the vector stores)
+        sequence = buffer_pool_acquire(orig_size + RLE_DECODE_SLACK);
+        if (sequence) {
 
+            // The decompressed block must have exactly the recorded size
+            if (rle_decode(buffer, block_size, sequence, orig_size, final_sizes) && *final_sizes == orig_size)
+                args->sequence = sequence;
+            else {
+                error = _FILE_UNRECOGNIZABLE;
+                buffer_pool_release(sequence);
             }
-            if (n_reps) {
-                memset(sequence + l, simb, n_reps);
-                l += n_reps;
-            }
-            else 
-                sequence[l++] = simb;
-            
         }
-        *final_sizes = l; 
-
-        args->sequence = sequence;
+        else 
+            error = _LACK_OF_MEMORY;
     }
-    else 
-        error = _LACK_OF_MEMORY;
+    else
+        error = _FILE_UNRECOGNIZABLE;
     
-    free(buffer);
+    buffer_pool_release(args->allocated);
 
     return error;
 }
 
 /**
- \brief Writes the contents resulting of the decompression of the RLE file
- @param _args Arguments to the function
- @param prev_error Error status in previous thread
- @param error Error status from process
+\brief Writes a decompressed block at its own position of the file (in the order the blocks were queued)
+ @param f_wrt File to write the decompressed contents
+ @param block Decompressed block
+ @param block_size Size of the decompressed block
  @returns Error status
 */
-static _modules_error write_decompressed_rle (void * const _args, _modules_error prev_error, _modules_error error)
+static _modules_error write_block (FILE * f_wrt, const uint8_t * block, unsigned long block_size)
 {
-    ArgumentsRLE * args = (ArgumentsRLE *) _args;
-    FILE * const f_wrt = args->f_wrt;
-    const unsigned long new_block_size = *args->final_sizes;
-    uint8_t * const sequence = args->sequence;
-
-    if (!error) {
-
-        if (!prev_error) {
+    return output_write(f_wrt, multithread_offset(block_size), block, block_size);
+}
 
-            // Writing the decompressed block in ORIGINAL file
-            if (fwrite(sequence, sizeof(uint8_t), new_block_size, f_wrt) != new_block_size) 
-                error = _FILE_STREAM_FAILED; 
+/**
+\brief Decompresses a RLE block and writes it in the ORIGINAL file without waiting for the previous blocks to be written
+ @param _args Arguments necessary to the function
+ @returns Error status 
+*/
+static _modules_error process_rle_decomp (void * _args) 
+{
+    ArgumentsRLE * args = (ArgumentsRLE *) _args;
+    _modules_error error;
 
-        }
+    error = rle_block_decompressor(args);
 
-        free(sequence); 
+    if (!error) {
+        error = write_block(args->f_wrt, args->sequence, *args->final_sizes);
+        buffer_pool_release(args->sequence);
     }
 
+    return error;
+}
+
+/**
+ \brief Releases the arguments of a RLE block (it was already written by process_rle_decomp)
+ @param _args Arguments to the function
+ @param prev_error Error status in previous thread
+ @param error Error status from process
+ @returns Error status
+*/
+static _modules_error release_decompressed_rle (void * const _args, _modules_error prev_error, _modules_error error)
+{
+    (void) prev_error;
     free(_args);
 
     return error;
@@ -233,13 +202,17 @@ _modules_error rle_decompress (char ** path)
 {
     _modules_error error = _SUCCESS;
     FILE *f_rle, *f_freq, *f_wrt;
+    InputFile input;
     char *path_freq, *path_wrt, *path_rle;
-    uint8_t * buffer;
+    const uint8_t * buffer;
+    uint8_t * allocated;
     char mode;
-    unsigned long *rle_sizes, *final_sizes;
+    bool binary_freq;
+    unsigned long *rle_sizes, *orig_sizes, *final_sizes, frequencies[NUM_SYMBOLS];
     unsigned long long length;
     float total_time;
     ArgumentsRLE * args;
+    _modules_error thread_error;
     
     clock_main_thread(START_CLOCK);
 
@@ -265,18 +238,19 @@ _modules_error rle_decompress (char ** path)
                     if (f_freq) {
 
                         // Reads the header of the FREQ file
-                        if (fscanf(f_freq, "@%c@%lu", &mode, &length) == 2) {   
+                        if (!read_freq_header(f_freq, &mode, &length, &binary_freq)) {
 
                             if (mode == 'R') {
 
-                                // Allocates memory for an array to contain the sizes of all the blocks of the RLE file
-                                rle_sizes = malloc(sizeof(unsigned long) * length);       
+                                // Allocates memory for an array to contain the sizes of all the blocks of the RLE file (and their sizes before RLE)
+                                rle_sizes = malloc(2 * sizeof(unsigned long) * length);       
                                 if (rle_sizes) {
 
+                                    orig_sizes = rle_sizes + length; // Acts as a "virtual" array
+
                                     // Loads the sizes to the array
                                     for (unsigned long long i = 0; i < length && !error; ++i) {
-                                        if (fscanf(f_freq, "@%lu@%*[^@]", rle_sizes + i) != 1)                                          
-                                            error = _FILE_STREAM_FAILED;       
+                                        error = read_block_freq(f_freq, binary_freq, rle_sizes + i, orig_sizes + i, frequencies);
                                                                                                                    
                                     }
 
@@ -315,23 +289,46 @@ _modules_error rle_decompress (char ** path)
                     final_sizes = malloc(sizeof(unsigned long) * length);
                     if (final_sizes) {
 
+                        // The RLE file is mapped whenever possible so blocks don't need to be copied
+                        input_open(&input, f_rle);
+
                         // Loop to execute block by block
                         for (unsigned long long thread_idx = 0; thread_idx < length; ++thread_idx) {
                                 
+                            // Memory for the RLE block
+                            error = multithread_reserve(rle_sizes[thread_idx]);
+                            if (error) break;
+
                             // Loading rle block
-                            error = load_rle(f_rle, rle_sizes[thread_idx], &buffer);
+                            error = input_block(&input, rle_sizes[thread_idx], &buffer, &allocated);
                             if (error) break;
 
+                            // Textual .freq files don't keep the size before RLE, so it's calculated from the block itself
+                            if (!orig_sizes[thread_idx] && !rle_decoded_size(buffer, rle_sizes[thread_idx], &orig_sizes[thread_idx]))
+                                error = _FILE_UNRECOGNIZABLE;
+
+                            // Memory for its decompression
+                            if (!error)
+                                error = multithread_reserve(orig_sizes[thread_idx] + RLE_DECODE_SLACK);
+
+                            if (error) {
+                                buffer_pool_release(allocated);
+                                break;
+                            }
+
                             args = malloc(sizeof(ArgumentsRLE)); 
 
                             if (!args) {
-                                free(buffer);
+                                buffer_pool_release(allocated);
+                                error = _LACK_OF_MEMORY;
                                 break;
                             }
 
                             *args = (ArgumentsRLE) {
                                 .rle_block_size = rle_sizes[thread_idx],
+                                .original_size = orig_sizes[thread_idx],
                                 .buffer = buffer,
+                                .allocated = allocated,
                                 .f_rle = f_rle, 
                                 .f_wrt = f_wrt,
                                 .final_sizes = &final_sizes[thread_idx]
@@ -339,18 +336,23 @@ _modules_error rle_decompress (char ** path)
                             };       
 
                             // Decompressing the RLE block and loading the final size of the blocks after decompression to the array
-                            error = multithread_create(rle_block_decompressor, write_decompressed_rle, args);
+                            error = multithread_create(process_rle_decomp, release_decompressed_rle, args);
                                 
                             if (error) {
                                 free(args);
-                                free(buffer);
+                                buffer_pool_release(allocated);
                                 break;
                             }
     
                         }
 
-                        multithread_wait();
+                        thread_error = multithread_wait();
 
+                        if (!error)
+                            error = thread_error;
+
+                        buffer_pool_clear();
+                        input_close(&input);
                                          
                         if (error) 
                             free(final_sizes);                  
@@ -378,7 +380,10 @@ _modules_error rle_decompress (char ** path)
         free(path_rle);
         *path = path_wrt;
         total_time = clock_main_thread(STOP_CLOCK);
-        print_summary(total_time, rle_sizes, final_sizes, length, *path, _RLE);
+        if (STATS == STATS_JSON)
+            stats_print(stdout, "D", total_time);
+        else
+            print_summary(total_time, rle_sizes, final_sizes, length, *path, _RLE);
         free(rle_sizes);
         free(final_sizes);
 
@@ -388,169 +393,423 @@ _modules_error rle_decompress (char ** path)
 }
 
 
+/*
+Struct for the SHAFA arguments in multithreading
+*/
+typedef struct {
+
+	FILE * f_wrt;
+    CachedTable * decoder;
+	unsigned long * rle_sizes;
+	unsigned long * final_sizes;
+	uint8_t * rle_decompressed;
+	uint8_t * shafa_decompressed;
+	const uint8_t * shafa_code;
+	uint8_t * shafa_allocated; // NULL if the code is mapped from the SHAFA file
+	unsigned long shafa_size;
+	unsigned long original_size;
+    unsigned long slice_start; // Part of the decompressed block to be written
+    unsigned long slice_size;
+    unsigned int num_streams; // Bitstreams the symbols are interleaved into (1 for the usual layout)
+    bool rle_decompression;
+		
+} ArgumentsSHAFA;
+
+/*
+Block of shafa code decompressed in parts (split at its sync points) by separate tasks
+*/
+typedef struct {
+
+    FILE * f_wrt;
+    const uint8_t * shafa_code;
+    uint8_t * shafa_allocated; // NULL if the code is mapped from the SHAFA file
+    uint8_t * shafa_decompressed; // Shared by the parts when the block is decompressed with RLE afterwards (NULL otherwise)
+    unsigned long shafa_size;
+    unsigned long rle_size;
+    unsigned long original_size;
+    unsigned long * final_sizes;
+    unsigned long long offset; // Position of the block in the ORIGINAL file when it's decompressed with RLE (claimed by its first part)
+    atomic_ulong parts_left; // Parts not written yet (the last one finishes the block)
+    bool incomplete; // Not every part was queued
+    bool rle_decompression;
+
+} SplitBlock;
+
+/*
+Struct for the arguments of a part of a block in multithreading
+*/
+typedef struct {
+
+    SplitBlock * block;
+    CachedTable * decoder;
+    unsigned long long bit; // Position of the part in the block of shafa code
+    unsigned long start; // Position of the part in the decompressed block
+    unsigned long size;
+
+} ArgumentsPart;
+
+#define PRIMARY_BITS 11
+#define SECONDARY_BITS 8
+
 /**
-\brief Binary tree that will contain all of the symbols codes needed to the descompressed file
+\brief Types of entries in the decoding table
 */
-typedef struct btree{
-    char symbol;
-    struct btree *left,*right;
-} *BTree;
+typedef enum
+{
+    _EMPTY_ENTRY,
+    _SYMBOL_ENTRY,
+    _TABLE_ENTRY,
+
+} EntryType;
+
+/**
+\brief Entry of the decoding table indexed by the next bits of the stream. Either resolves a symbol or points to a secondary table for longer codes
+*/
+typedef struct {
+    uint32_t value : 24; // Symbol or offset of the secondary table
+    uint32_t bits : 6; // Bits consumed from the stream when this entry is used
+    uint32_t type : 2;
+} DecodeEntry;
+
+/**
+\brief Flat decoding table: Primary table (PRIMARY_BITS) followed by every secondary table (SECONDARY_BITS) 
+*/
+typedef struct {
+    DecodeEntry * entries;
+    unsigned long size;
+    unsigned long capacity;
+} Decoder;
+
+/**
+\brief Bit buffer with the next bits of the stream aligned to the most significant bit
+*/
+typedef struct {
+    const uint8_t * next;
+    const uint8_t * end;
+    uint64_t buffer;
+    int count;
+} BitReader;
 
 /**
-\brief Frees all the memory used by a BTree
- @param tree Binary tree
+\brief Adds a given symbol to the decoding table, creating secondary tables if the code doesn't fit in the current one
+ @param decoder Decoding table
+ @param code Code of the symbol
+ @param symbol Symbol to be saved in the table
+ @returns Error status
 */
-static void free_tree(BTree tree) 
+static _modules_error add_code (Decoder * decoder, Code code, uint8_t symbol)
 {
-    if (tree) {
-        free_tree(tree->right);
-        free_tree(tree->left);
-        free(tree);
+    DecodeEntry * entry, * entries;
+    unsigned long table = 0, index, num_entries;
+    int table_bits = PRIMARY_BITS, length = code.length;
+
+    // Walks (or creates) the secondary tables until the remaining of the code fits in one
+    while (length > table_bits) {
+
+        entry = &decoder->entries[table + ((code.bits >> (length - table_bits)) & ((1UL << table_bits) - 1))];
+
+        if (entry->type == _EMPTY_ENTRY) {
+
+            if (decoder->size + (1 << SECONDARY_BITS) > decoder->capacity) {
+                index = entry - decoder->entries;
+                entries = realloc(decoder->entries, 2 * decoder->capacity * sizeof(DecodeEntry));
+                if (!entries) return _LACK_OF_MEMORY;
+
+                memset(entries + decoder->capacity, 0, decoder->capacity * sizeof(DecodeEntry));
+                entry = entries + index;
+                decoder->entries = entries;
+                decoder->capacity *= 2;
+            }
+
+            *entry = (DecodeEntry) { .value = decoder->size, .bits = table_bits, .type = _TABLE_ENTRY };
+            decoder->size += 1 << SECONDARY_BITS;
+        }
+        // Another code is a prefix of this one
+        else if (entry->type != _TABLE_ENTRY)
+            return _FILE_UNRECOGNIZABLE;
+
+        table = entry->value;
+        length -= table_bits;
+        table_bits = SECONDARY_BITS;
     }
 
+    // Every index starting with the (remaining) code resolves the symbol
+    index = table + ((code.bits & ((1UL << length) - 1)) << (table_bits - length));
+    num_entries = 1UL << (table_bits - length);
+
+    for (entry = &decoder->entries[index]; num_entries; --num_entries, ++entry) {
+        if (entry->type != _EMPTY_ENTRY) // The code is a prefix of another code
+            return _FILE_UNRECOGNIZABLE;
+
+        *entry = (DecodeEntry) { .value = symbol, .bits = length, .type = _SYMBOL_ENTRY };
+    }
+
+    return _SUCCESS;
 }
 
 /**
-\brief Adds a given symbol to the BTree
- @param decoder Tree with saved symbols to help in decoding
- @param code String with the codes from COD file
- @param start Beggining of the code to be added
- @param end Ending of the code to be added
- @param symbol Symbol to be saved in the tree 
+\brief Generates the decoding table of the symbols acording to the codes
+ @param block_codes Codes of a block of the COD file
+ @param decoder Decoding table to be initialized
  @returns Error status
 */
-static _modules_error add_tree(BTree* decoder, char *code, int start, int end, char symbol) 
+static _modules_error create_decoder (const BlockCodes * block_codes, Decoder * decoder)
 {
-    // Creation of the path to the symbol we are placing
-    for (int i = start; i < end; ++i) {
+    _modules_error error;
+    Code codes[NUM_SYMBOLS];
 
-        if (*decoder && code[i] == '0') decoder = &(*decoder)->left;
-        else if (*decoder && code[i] == '1') decoder = &(*decoder)->right;
-        else {
-            *decoder = malloc(sizeof(struct btree));
-            if (!(*decoder)) return _LACK_OF_MEMORY;
-            (*decoder)->left = (*decoder)->right = NULL;
-            if (code[i] == '0') decoder = &(*decoder)->left;
-            else decoder = &(*decoder)->right;
-        } 
+    error = build_codes(block_codes, codes);
+    if (error) return error;
+
+    decoder->size = 1 << PRIMARY_BITS;
+    decoder->capacity = 2 << PRIMARY_BITS;
+    decoder->entries = calloc(decoder->capacity, sizeof(DecodeEntry));
+
+    if (!decoder->entries)
+        return _LACK_OF_MEMORY;
+
+    // An empty code means the symbol doesn't show up in the block
+    for (int symb = 0; symb < NUM_SYMBOLS && !error; ++symb)
+        if (codes[symb].length)
+            error = add_code(decoder, codes[symb], symb);
+
+    if (error)
+        free(decoder->entries);
+
+    return error;
+}
+
+/**
+\brief Allocates the decoding table of a block (to be shared through the cache)
+ @param block_codes Codes of a block of the COD file
+ @param table Address to load the allocated decoding table
+ @returns Error status
+*/
+static _modules_error build_decoding_table (const BlockCodes * block_codes, void ** table)
+{
+    _modules_error error;
+    Decoder * decoder = malloc(sizeof(Decoder));
+
+    if (!decoder) return _LACK_OF_MEMORY;
+
+    error = create_decoder(block_codes, decoder);
+
+    if (error) 
+        free(decoder);
+    else 
+        *table = decoder;
+
+    return error;
+}
+
+/**
+\brief Releases a decoding table allocated by build_decoding_table
+ @param table Decoding table
+*/
+static void destroy_decoding_table (void * table)
+{
+    free(((Decoder *) table)->entries);
+    free(table);
+}
+
+// Blocks with the same codes share their decoding table
+static TableCache DECODING_TABLES = { .build = build_decoding_table, .destroy = destroy_decoding_table };
+
+/**
+\brief Loads bytes into the bit buffer until it holds at least 57 bits (zeros are loaded past the end of the stream)
+ @param reader Bit buffer
+*/
+static inline void refill (BitReader * reader)
+{
+    const uint8_t * next = reader->next;
+
+    if (reader->end - next >= 8) {
+        reader->buffer |= (
+            (uint64_t) next[0] << 56 | (uint64_t) next[1] << 48 | (uint64_t) next[2] << 40 | (uint64_t) next[3] << 32 |
+            (uint64_t) next[4] << 24 | (uint64_t) next[5] << 16 | (uint64_t) next[6] << 8  | (uint64_t) next[7]
+        ) >> reader->count;
+        reader->next += (63 - reader->count) >> 3;
+        reader->count |= 56;
+    }
+    else {
+        for ( ; reader->count <= 56; reader->count += 8)
+            if (reader->next < reader->end)
+                reader->buffer |= (uint64_t) *reader->next++ << (56 - reader->count);
     }
-    // Adding the symbol to the corresponding leaf of the tree
-    *decoder = malloc(sizeof(struct btree));
-    (*decoder)->symbol = symbol;
-    (*decoder)->left = (*decoder)->right = NULL;
-    return _SUCCESS;
 }
 
-/*
-Struct for the SHAFA arguments in multithreading
+/**
+\brief Decodes the next symbol of a stream
+ @param reader Bit buffer of the stream
+ @param entries Decoding table of the symbols
+ @param symbol Pointer to load the decoded symbol
+ @returns Whether the next bits are the code of a symbol
 */
-typedef struct {
+static inline bool decode_symbol (BitReader * reader, const DecodeEntry * entries, uint8_t * symbol)
+{
+    DecodeEntry entry;
 
-	FILE * f_wrt;
-    char * cod_code;
-	unsigned long * rle_sizes;
-	unsigned long * final_sizes;
-	uint8_t * rle_decompressed;
-	uint8_t * shafa_decompressed;
-	uint8_t * shafa_code;
-    bool rle_decompression;
-		
-} ArgumentsSHAFA;
+    if (reader->count < PRIMARY_BITS)
+        refill(reader);
+
+    entry = entries[reader->buffer >> (64 - PRIMARY_BITS)];
+
+    // Longer codes are resolved by the secondary tables
+    while (entry.type == _TABLE_ENTRY) {
+        reader->buffer <<= entry.bits;
+        reader->count -= entry.bits;
+
+        if (reader->count < SECONDARY_BITS)
+            refill(reader);
+
+        entry = entries[entry.value + (reader->buffer >> (64 - SECONDARY_BITS))];
+    }
+
+    if (entry.type == _EMPTY_ENTRY)
+        return false;
+
+    reader->buffer <<= entry.bits;
+    reader->count -= entry.bits;
+    *symbol = entry.value;
+
+    return true;
+}
 
 /**
-\brief Generates a binary tree that contains the symbols acording to the codes
- @param code String with a block of the COD file
- @param decoder Pointer to the binary tree
+\brief Decodes the symbols of a block of shafa code starting at any bit of it (a sync point)
+ @param shafa Content of the file to be descompressed
+ @param shafa_size Size of the content of the file to be descompressed
+ @param bit Bit of the block where the first symbol starts
+ @param num_symbols Number of symbols to be decoded
+ @param decoder Decoding table of the symbols
+ @param output Buffer to load the decoded symbols
  @returns Error status
 */
-static _modules_error create_tree (char * code, BTree * decoder)
+static _modules_error decode_symbols (const uint8_t * shafa, unsigned long shafa_size, unsigned long long bit, unsigned long num_symbols, const Decoder * decoder, uint8_t * output)
 {
-    _modules_error error;
-    int j, start, end;
+    const DecodeEntry * const entries = decoder->entries;
+    BitReader reader = { .next = shafa + bit / 8, .end = shafa + shafa_size, .buffer = 0, .count = 0 };
+
+    // The first bits of a byte in the middle of the block belong to the previous symbols
+    if (bit % 8) {
+        refill(&reader);
+        reader.buffer <<= bit % 8;
+        reader.count -= bit % 8;
+    }
 
-    error = _SUCCESS;
-    // Initialize root without meaning 
-    *decoder = malloc(sizeof(struct btree));
-    
-    if (*decoder) {
-        
-        (*decoder)->left = (*decoder)->right = NULL;
-          
-        for (int symb = 0, l = 0; code[l] && !error;) {
-
-            // When it finds a ';' it is no longer on the same symbol. This updates it.
-            while (code[l] == ';') {
-                symb++;
-                l++;
-            }
-                
-            start = l;
-            for ( ; code[l] && (code[l] != ';'); ++l);
-            end = l;    
-
-            if (start != end) 
-                // Adds the code to the tree
-                error = add_tree(decoder, code, start, end, symb);
-           
+    // Each iteration resolves one symbol (it's used the final size to control the cycle to avoid padding excess)
+    for (unsigned long l = 0; l < num_symbols; ++l)
+        if (!decode_symbol(&reader, entries, &output[l]))
+            return _FILE_UNRECOGNIZABLE;
+      
+    return _SUCCESS;
+}
+
+/**
+\brief Decodes the symbols of interleaved streams, one of each stream in turn. Each stream is a chain of its own, so the decoding of a symbol doesn't wait for the previous one
+ @param readers Bit buffer of each stream
+ @param num_streams Number of streams, 2 or MAX_STREAMS (a constant once inlined)
+ @param num_symbols Number of symbols to be decoded
+ @param entries Decoding table of the symbols
+ @param output Buffer to load the decoded symbols
+ @returns Error status
+*/
+static inline _modules_error decode_interleaved (const BitReader * readers, const unsigned int num_streams, unsigned long num_symbols, const DecodeEntry * entries, uint8_t * output)
+{
+    // Each stream has a variable of its own (instead of indexing the array) so they're kept in registers
+    BitReader first = readers[0], second = readers[1], third = readers[num_streams - 2], fourth = readers[num_streams - 1];
+    unsigned long l = 0;
+    bool valid = true;
+
+    for ( ; l + num_streams <= num_symbols && valid; l += num_streams) {
+        valid &= decode_symbol(&first, entries, &output[l]);
+        valid &= decode_symbol(&second, entries, &output[l + 1]);
+
+        if (num_streams == MAX_STREAMS) {
+            valid &= decode_symbol(&third, entries, &output[l + 2]);
+            valid &= decode_symbol(&fourth, entries, &output[l + 3]);
         }
+    }
+
+    // The last symbols don't go around every stream
+    if (l < num_symbols && valid)
+        valid = decode_symbol(&first, entries, &output[l]);
+
+    if (l + 1 < num_symbols && valid)
+        valid = decode_symbol(&second, entries, &output[l + 1]);
+
+    if (l + 2 < num_symbols && valid)
+        valid = decode_symbol(&third, entries, &output[l + 2]);
+
+    return valid ? _SUCCESS : _FILE_UNRECOGNIZABLE;
+}
+
+/**
+\brief Decodes the symbols of a block of shafa code interleaved into streams (symbol i is in stream i % num_streams)
+ @param shafa Content of the file to be descompressed: the size of each stream but the last (8 bytes each) followed by the streams
+ @param shafa_size Size of the content of the file to be descompressed
+ @param num_streams Number of streams (2 or MAX_STREAMS)
+ @param num_symbols Number of symbols to be decoded
+ @param decoder Decoding table of the symbols
+ @param output Buffer to load the decoded symbols
+ @returns Error status
+*/
+static _modules_error decode_streams (const uint8_t * shafa, unsigned long shafa_size, unsigned int num_streams, unsigned long num_symbols, const Decoder * decoder, uint8_t * output)
+{
+    BitReader readers[MAX_STREAMS];
+    unsigned long long start = (num_streams - 1) * 8, stream_size;
+
+    if (shafa_size < start)
+        return _FILE_UNRECOGNIZABLE;
+
+    for (unsigned int stream = 0; stream < num_streams; ++stream) {
+        stream_size = stream + 1 < num_streams ? load_le64(shafa + stream * 8) : shafa_size - start;
 
-        free(code);       
+        if (stream_size > shafa_size - start)
+            return _FILE_UNRECOGNIZABLE;
+
+        readers[stream] = (BitReader) { .next = shafa + start, .end = shafa + start + stream_size, .buffer = 0, .count = 0 };
+        start += stream_size;
     }
-    else 
-        error = _LACK_OF_MEMORY;
 
+    if (num_streams == 2)
+        return decode_interleaved(readers, 2, num_symbols, decoder->entries, output);
 
-    return error;
+    return decode_interleaved(readers, MAX_STREAMS, num_symbols, decoder->entries, output);
 }
 
 /**
 \brief Decompresses a block of shafa code
  @param shafa Content of the file to be descompressed
+ @param shafa_size Size of the content of the file to be descompressed
  @param block_size Block size
- @param decoder Binary tree with the symbols
+ @param num_streams Bitstreams the symbols are interleaved into (1 for the usual layout)
+ @param decoder Decoding table of the symbols
  @param decomp Address to load a string with the decompressed contents
  @returns Error status
 */
-static _modules_error shafa_block_decompressor (uint8_t * shafa, unsigned long block_size, BTree decoder, uint8_t ** decomp) 
+static _modules_error shafa_block_decompressor (const uint8_t * shafa, unsigned long shafa_size, unsigned long block_size, unsigned int num_streams, const Decoder * decoder, uint8_t ** decomp) 
 {
-    BTree root;
-    uint8_t mask;
-    unsigned long i, l;
-    int bit;
+    _modules_error error;
 
     // String for the decompressed contents 
-    *decomp = malloc(block_size);
-    if (!(*decomp)) return _LACK_OF_MEMORY;
+    *decomp = buffer_pool_acquire(block_size);
+    if (!*decomp) return _LACK_OF_MEMORY;
 
-    root = decoder; // Saving the root for multiple crossings in the tree
-    mask = 128; // 1000 0000 
-    i = l = 0; 
+    if (num_streams > 1)
+        error = decode_streams(shafa, shafa_size, num_streams, block_size, decoder, *decomp);
+    else
+        error = decode_symbols(shafa, shafa_size, 0, block_size, decoder, *decomp);
 
-    // Loop to check every byte, bit by bit (it's used the final size to control the cycle to avoid padding excess)
-    while (l < block_size) {
-        
-        bit = mask & shafa[i];
-        if (!bit) decoder = decoder->left; // bit = 0
-        else decoder = decoder->right;
-        // Finds a leaf of the tree
-        if (decoder && !(decoder->left) && !(decoder->right)) {
-                (*decomp)[l++] = decoder->symbol;
-                decoder = root;
-        }
-        mask >>= 1; // 1000 0000 >> 0100 0000 >> ... >> 0000 0001 >> 0000 0000
-        
-        // When mask = 0 it's time to move to the next byte
-        if (!mask) {
-            ++i;
-            mask = 128;
-        }
-        
+    if (error) {
+        buffer_pool_release(*decomp);
+        *decomp = NULL;
     }
-      
-    return _SUCCESS;
+
+    return error;
 }
 
-/** Does the process of the main function: includes the creation of a binary tree, the shafa block decompression and, if needed, the rle block decompression
+/** Does the process of the main function: includes the creation of the decoding table, the shafa block decompression and, if needed, the rle block decompression
  \brief 
  @param _args Arguments of the function
  @returns Error status
@@ -559,87 +818,326 @@ static _modules_error process_shafa_decomp (void * _args) {
 
     _modules_error error;
     ArgumentsSHAFA * args_shafa = (ArgumentsSHAFA *) _args; 
-    BTree decoder; 
+    const void * decoder = NULL; 
     ArgumentsRLE args_rle;
+    uint8_t * decompressed;
+    unsigned long decompressed_size;
 
-    error = create_tree(args_shafa->cod_code, &decoder);
+    error = table_cache_acquire(&DECODING_TABLES, args_shafa->decoder, &decoder);
 
-    if (!error) {
+    if (!error) 
+        error = shafa_block_decompressor(args_shafa->shafa_code, args_shafa->shafa_size, *args_shafa->rle_sizes, args_shafa->num_streams, decoder, &args_shafa->shafa_decompressed);
 
-        error = shafa_block_decompressor(args_shafa->shafa_code, *args_shafa->rle_sizes, decoder, &args_shafa->shafa_decompressed);
+    table_cache_release(&DECODING_TABLES, args_shafa->decoder, decoder);
 
-        free(args_shafa->shafa_code);
-        free_tree(decoder);
+    if (!error && args_shafa->rle_decompression) {
 
-        if (!error && args_shafa->rle_decompression) {
+        args_rle = (ArgumentsRLE) {
+            .buffer = args_shafa->shafa_decompressed,
+            .allocated = args_shafa->shafa_decompressed,
+            .rle_block_size = *args_shafa->rle_sizes,
+            .original_size = args_shafa->original_size,
+            .final_sizes = args_shafa->final_sizes
+        };
 
-            args_rle = (ArgumentsRLE) {
-                .buffer = args_shafa->shafa_decompressed,
-                .rle_block_size = *args_shafa->rle_sizes,
-                .final_sizes = args_shafa->final_sizes
-            };
+        error = rle_block_decompressor(&args_rle);
+        if (!error) {
+            args_shafa->rle_decompressed = args_rle.sequence;
+        }
+    }
 
-            error = rle_block_decompressor(&args_rle);
-            if (!error) {
-                args_shafa->rle_decompressed = args_rle.sequence;
-            }
+    buffer_pool_release(args_shafa->shafa_allocated);
+
+    // Writing the decompressed block (or the part of it inside the range) in ORIGINAL file without waiting for the previous blocks to be written
+    if (!error) {
+        if (args_shafa->rle_decompression) {
+            decompressed = args_shafa->rle_decompressed;
+            decompressed_size = *args_shafa->final_sizes;
+        }
+        else {
+            decompressed = args_shafa->shafa_decompressed;
+            decompressed_size = *args_shafa->rle_sizes;
+        }
+
+        if (args_shafa->slice_start <= decompressed_size) {
+            decompressed_size -= args_shafa->slice_start;
+            error = write_block(args_shafa->f_wrt, decompressed + args_shafa->slice_start, decompressed_size < args_shafa->slice_size ? decompressed_size : args_shafa->slice_size);
         }
+        else
+            error = _FILE_UNRECOGNIZABLE;
+
+        buffer_pool_release(decompressed);
     }
 
     return error;
 }
 
 /**
- \brief Writes the decompressed shafa in the destined file
+ \brief Releases the arguments of a shafa block (it was already written by process_shafa_decomp)
  @param _args Arguments of the function
  @param prev_error Previous thread error status
  @param error Process error status
  @returns Error status
 */
-static _modules_error write_decompressed_shafa (void * _args, _modules_error prev_error, _modules_error error) {
+static _modules_error release_decompressed_shafa (void * _args, _modules_error prev_error, _modules_error error) {
+
+    (void) prev_error;
+
+    free(_args);
+
+    return error;
+}
 
-    ArgumentsSHAFA * args_shafa = (ArgumentsSHAFA *) _args; 
-    unsigned long size_wrt;
-    uint8_t * decomp;
-    FILE * f_wrt = args_shafa->f_wrt;
-    bool rle_decompression = args_shafa->rle_decompression;
+
+/**
+\brief Decompresses a part of a block of shafa code and, unless the block is decompressed with RLE afterwards, writes it in the ORIGINAL file
+ @param _args Arguments of the function
+ @returns Error status
+*/
+static _modules_error process_shafa_part (void * _args) {
+
+    _modules_error error;
+    ArgumentsPart * args = (ArgumentsPart *) _args;
+    SplitBlock * block = args->block;
+    const void * decoder = NULL;
+    uint8_t * decompressed = block->shafa_decompressed;
+    unsigned long long offset;
+
+    // Sizes are known beforehand, so the room is claimed right away: each part's own or, with RLE, the whole block's by its first part (only used by the last one)
+    offset = multithread_offset(!block->rle_decompression ? args->size : args->start ? 0 : block->original_size);
+    if (!args->start)
+        block->offset = offset;
+
+    error = table_cache_acquire(&DECODING_TABLES, args->decoder, &decoder);
 
     if (!error) {
+        decompressed = decompressed ? decompressed + args->start : buffer_pool_acquire(args->size);
 
-        if (!prev_error) {
+        if (decompressed) 
+            error = decode_symbols(block->shafa_code, block->shafa_size, args->bit, args->size, decoder, decompressed);
+        else
+            error = _LACK_OF_MEMORY;
+    }
 
-            size_wrt = (rle_decompression) ? (*args_shafa->final_sizes) : (*args_shafa->rle_sizes);
-            decomp = (rle_decompression) ? (args_shafa->rle_decompressed) : (args_shafa->shafa_decompressed);
-            if (fwrite(decomp, sizeof(uint8_t), size_wrt, f_wrt) != size_wrt) 
-                error = _FILE_STREAM_FAILED;
+    table_cache_release(&DECODING_TABLES, args->decoder, decoder);
 
-        }
+    // Without RLE the part is already decompressed
+    if (!block->rle_decompression) {
+        if (!error)
+            error = output_write(block->f_wrt, offset, decompressed, args->size);
+
+        buffer_pool_release(decompressed);
+    }
+
+    return error;
+}
+
+/**
+\brief Releases the share of a block of its parts, the last one releasing the block itself
+ @param block Block decompressed in parts
+ @param parts Number of parts
+ @returns Whether the block was released
+*/
+static bool release_split_block (SplitBlock * block, unsigned long parts) {
+
+    if (atomic_fetch_sub(&block->parts_left, parts) != parts)
+        return false;
+
+    buffer_pool_release(block->shafa_decompressed);
+    buffer_pool_release(block->shafa_allocated);
+    free(block);
+
+    return true;
+}
+
+/**
+ \brief Releases the arguments of a part of a block. The last part of the block decompresses it with RLE (every part was decompressed by then) and writes it in the ORIGINAL file
+ @param _args Arguments of the function
+ @param prev_error Previous thread error status
+ @param error Process error status
+ @returns Error status
+*/
+static _modules_error release_shafa_part (void * _args, _modules_error prev_error, _modules_error error) {
 
-        if (rle_decompression) 
-            free(args_shafa->rle_decompressed);    
-    } 
+    SplitBlock * block = ((ArgumentsPart *) _args)->block;
+    ArgumentsRLE args_rle;
 
     free(_args);
 
+    if (atomic_load(&block->parts_left) == 1 && block->rle_decompression && !block->incomplete && !error && !prev_error) {
+
+        args_rle = (ArgumentsRLE) {
+            .buffer = block->shafa_decompressed,
+            .allocated = block->shafa_decompressed,
+            .rle_block_size = block->rle_size,
+            .original_size = block->original_size,
+            .final_sizes = block->final_sizes
+        };
+
+        error = rle_block_decompressor(&args_rle);
+        block->shafa_decompressed = NULL;
+
+        if (!error) {
+            error = output_write(block->f_wrt, block->offset, args_rle.sequence, *block->final_sizes);
+            buffer_pool_release(args_rle.sequence);
+        }
+    }
+
+    release_split_block(block, 1);
+
+    return error;
+}
+
+/**
+\brief Queues a block of shafa code as a task for each part between its sync points, so its parts are decompressed in parallel
+ Warning: This function isn't thread-safe itself
+ @param f_wrt File to write the decompressed contents
+ @param shafa_code Block of shafa code
+ @param shafa_allocated Block of shafa code if it was allocated, NULL if it's mapped from the SHAFA file (it belongs to the parts from now on, even on error)
+ @param shafa_size Size of the block of shafa code
+ @param rle_size Size of the decompressed block of shafa code
+ @param original_size Size of the block once decompressed with RLE
+ @param rle_decompression Decompresses the block with RLE too
+ @param final_sizes Pointer to load the size of the block once decompressed with RLE
+ @param sync Sync points of the block
+ @param decoder Entry of the decoding table of the block (its reference belongs to the parts from now on, even on error)
+ @returns Error status
+*/
+static _modules_error queue_split_block (FILE * f_wrt, const uint8_t * shafa_code, uint8_t * shafa_allocated, unsigned long shafa_size, unsigned long rle_size, 
+    unsigned long original_size, bool rle_decompression, unsigned long * final_sizes, const BlockSync * sync, CachedTable * decoder) {
+
+    _modules_error error = _SUCCESS;
+    const unsigned long num_parts = sync->num_points + 1;
+    unsigned long part, start, size;
+    SplitBlock * block;
+    ArgumentsPart * args;
+
+    block = malloc(sizeof(SplitBlock));
+    if (!block) {
+        buffer_pool_release(shafa_allocated);
+        table_cache_release(&DECODING_TABLES, decoder, NULL);
+        return _LACK_OF_MEMORY;
+    }
+
+    *block = (SplitBlock) {
+        .f_wrt = f_wrt,
+        .shafa_code = shafa_code,
+        .shafa_allocated = shafa_allocated,
+        .shafa_decompressed = NULL,
+        .shafa_size = shafa_size,
+        .rle_size = rle_size,
+        .original_size = original_size,
+        .final_sizes = final_sizes,
+        .offset = 0,
+        .incomplete = false,
+        .rle_decompression = rle_decompression
+    };
+
+    // With RLE the parts are decompressed into the same buffer, which is decompressed with RLE by the last one
+    if (rle_decompression) {
+        block->shafa_decompressed = buffer_pool_acquire(rle_size);
+        if (!block->shafa_decompressed) {
+            buffer_pool_release(shafa_allocated);
+            free(block);
+            table_cache_release(&DECODING_TABLES, decoder, NULL);
+            return _LACK_OF_MEMORY;
+        }
+    }
+
+    atomic_init(&block->parts_left, num_parts);
+
+    // Each part holds a reference to the decoding table
+    for (part = 1; part < num_parts; ++part)
+        table_cache_reference(decoder);
+
+    for (part = 0; part < num_parts; ++part) {
+
+        start = part ? sync->points[part - 1].symbol : 0;
+        size = (part < sync->num_points ? sync->points[part].symbol : block->rle_size) - start;
+
+        // The first part was given the memory of the whole block and the next ones take the memory of their decompressed symbols
+        if (part) {
+            error = multithread_reserve(size);
+            if (error) break;
+        }
+
+        args = malloc(sizeof(ArgumentsPart));
+        if (!args) {
+            error = _LACK_OF_MEMORY;
+            break;
+        }
+
+        *args = (ArgumentsPart) {
+            .block = block,
+            .decoder = decoder,
+            .bit = part ? sync->points[part - 1].bit : 0,
+            .start = start,
+            .size = size
+        };
+
+        error = multithread_create(process_shafa_part, release_shafa_part, args);
+        if (error) {
+            free(args);
+            break;
+        }
+    }
+
+    // The parts that weren't queued give up their share of the block and the decoding table
+    if (error) {
+        block->incomplete = true;
+
+        for (unsigned long i = part; i < num_parts; ++i)
+            table_cache_release(&DECODING_TABLES, decoder, NULL);
+
+        release_split_block(block, num_parts - part);
+    }
+
     return error;
 }
 
 
-_modules_error shafa_decompress (char ** const path, bool rle_decompression) 
+/**
+\brief Finds the next block of the SHAFA file
+ @param input SHAFA file
+ @param entry Entry of the block in the block index (NULL to read the block right after the previous one)
+ @param size Pointer to load the size of the block
+ @returns Success
+*/
+static bool next_block (InputFile * input, const IndexEntry * entry, unsigned long * size)
+{
+    if (entry) {
+        *size = entry->compressed_size;
+        return input_seek(input, entry->offset);
+    }
+
+    return input_size(input, size) && input_skip(input, '@');
+}
+
+
+_modules_error shafa_decompress (char ** const path, bool rle_decompression, const ByteRange * const range) 
 {
     _modules_error error;
     FILE *f_shafa, *f_cod, *f_wrt;
     char *path_cod, *path_wrt, *path_shafa, *path_tmp;
-    uint8_t * shafa_code; 
-    char * cod_code;
+    InputFile input;
+    const uint8_t * shafa_code; 
+    uint8_t * shafa_allocated;
+    BlockCodes block_codes;
+    CachedTable * decoder;
+    bool canonical;
     char mode;
     float total_time;
     unsigned long long length;
     unsigned long *sizes, *sf_sizes, *final_sizes;
-    unsigned long sf_bsize;
+    unsigned long sf_bsize, original_size, slice_start = 0, slice_size, num_streams = 1;
+    unsigned long long num_tasks, first_block = 0, index_length, range_left = 0;
+    IndexEntry * index = NULL, * entry;
     ArgumentsSHAFA * args;
+    _modules_error thread_error;
 
     sizes = sf_sizes = final_sizes = NULL;
+    path_wrt = NULL;
+    f_wrt = NULL;
     path_shafa = *path;
     error = _SUCCESS;
     clock_main_thread(START_CLOCK);
@@ -648,6 +1146,9 @@ _modules_error shafa_decompress (char ** const path, bool rle_decompression)
     f_shafa = fopen(path_shafa, "rb");
     if (f_shafa) {
 
+        // The shafa file is mapped whenever possible so blocks don't need to be copied
+        input_open(&input, f_shafa);
+
         // Creates path to the .cod file
         path_tmp = rm_ext(path_shafa);
         if (path_tmp) { // free this somehow
@@ -660,143 +1161,209 @@ _modules_error shafa_decompress (char ** const path, bool rle_decompression)
             else 
                 path_wrt = path_tmp;
 
-            f_wrt = fopen(path_wrt, "wb");
-            if (f_wrt) {
-                
-                path_cod = add_ext(path_tmp, CODES_EXT);
-                if (path_cod) {
-
-                    f_cod = fopen(path_cod, "rb");
-                    if (f_cod) {
-
-                        // Reading header of shafa file
-                        if (fscanf(f_shafa, "@%lu", &length) == 1) {
-
-                            // Reading header of cod file
-                            if (fscanf(f_cod, "@%c@%lu", &mode, &length) == 2) {
-                                // Checking the mode of the file
-                                if ((mode == 'N' && !rle_decompression) || (mode == 'R')) {   
-
-                                    // Allocates memory to an array with the purpose of saving the size of each SHAF block
-                                    sf_sizes = malloc(sizeof(unsigned long) * length);
-                                    if (sf_sizes) {
-
-                                        // Allocates memory to an array with the purpose of saving the sizes of each RLE/ORIGINAL block
-                                        sizes = malloc(sizeof(unsigned long) * length);
-                                        if (sizes) {
-
-                                            if (rle_decompression) {
-                                                final_sizes = malloc(sizeof(unsigned long) * length);
-                                                if (!final_sizes)
-                                                    error = _LACK_OF_MEMORY;
-                                            }  
-
-                                            for (unsigned long long thread_idx = 0; thread_idx < length && !error; ++thread_idx) {
-
-                                                // Reads the size of the shafa blockss
-                                                if (fscanf(f_shafa, "@%lu@", &sf_bsize) == 1) {
-
-                                                    sf_sizes[thread_idx] = sf_bsize;
-
-                                                    // Allocates memory to a buffer in which will be loaded one block of shafa code                                                         
-                                                    shafa_code = malloc(sf_bsize); 
-                                                    if (shafa_code) {
-
-                                                        // Reads a block of shafa code
-                                                        if (fread(shafa_code, sizeof(uint8_t), sf_bsize, f_shafa) == sf_bsize) { 
-
-                                                            // Reads the size of the decompressed shafa code and saves it
-                                                            if (fscanf(f_cod, "@%lu", &sizes[thread_idx]) == 1) {
-
-                                                                // Allocates memory for a block of COD code
-                                                                cod_code = malloc(33152); //sum 1 to 256 (worst case shannon fano) + 255 semicolons + 1 byte NULL
-                                                                if (cod_code) {
-
-                                                                    // Loads the block of COD code
-                                                                    if (fscanf(f_cod,"@%33151[^@]", cod_code) == 1) {
-
-                                                                        // Allocates memory for the arguments
-                                                                        args = malloc(sizeof(ArgumentsSHAFA)); 
-                                                                        if (!args) {
-                                                                            error = _LACK_OF_MEMORY;
-                                                                            free(shafa_code);
-                                                                            break;
-                                                                        }
-                                                                            
-                                                                        // Arguments for the SHAFA multithread
-                                                                        *args = (ArgumentsSHAFA) {
-                                                                            .f_wrt = f_wrt,
-                                                                            .shafa_code = shafa_code,
-                                                                            .rle_decompression = rle_decompression,
-                                                                            .rle_sizes = &sizes[thread_idx],
-                                                                            .final_sizes = &final_sizes[thread_idx],
-                                                                            .cod_code = cod_code
-                                                                        };
-                                                                        error = multithread_create(process_shafa_decomp, write_decompressed_shafa, args); 
-                                                                            
-                                                                        if (error) {
-                                                                            free(cod_code);
-                                                                            break;
-                                                                        }
-                                                                    }
-                                                                    else 
-                                                                        error = _FILE_STREAM_FAILED;
-                                                                            
-                                                                }
-                                                                else 
-                                                                    error = _LACK_OF_MEMORY;
-                                                            }
-                                                            else 
-                                                                error = _FILE_STREAM_FAILED;
-                                                                   
+            // Creates path to the .cod file (once the path to the ORIGINAL file was created as well)
+            path_cod = path_wrt ? add_ext(path_tmp, CODES_EXT) : NULL;
+            if (path_cod) {
+
+                f_cod = fopen(path_cod, "rb");
+                if (f_cod) {
+
+                    // Reading header of shafa file (interleaved blocks are marked by their number of streams)
+                    if (input_size(&input, &sf_bsize) && (!input_number(&input, '#', &num_streams) || num_streams == 2 || num_streams == MAX_STREAMS)) {
+
+                        // Reading header of cod file
+                        if (!read_codes_header(f_cod, &mode, &length, &canonical)) {
+                            // Checking the mode of the file
+                            if ((mode == 'N' && !rle_decompression) || (mode == 'R')) {   
+
+                                num_tasks = length;
+
+                                // The block index has the sync points of the blocks, and a range needs it to find the blocks overlapping it (the only ones decompressed)
+                                error = read_block_index(f_shafa, &index_length, &index);
+
+                                if (error == _FILE_UNRECOGNIZABLE && !range)
+                                    error = _SUCCESS;
+                                else if (!error && index_length != length)
+                                    error = _FILE_UNRECOGNIZABLE;
+
+                                // Sync points are bits of a single stream
+                                for (unsigned long long i = 0; index && num_streams > 1 && i < index_length && !error; ++i)
+                                    if (index[i].sync.num_points)
+                                        error = _FILE_UNRECOGNIZABLE;
+
+                                if (!error && range) {
+                                    error = find_range_blocks(index, length, range, &first_block, &num_tasks, &slice_start);
+                                    range_left = range->size;
+
+                                    if (!error)
+                                        error = skip_block_codes(f_cod, canonical, first_block);
+                                }
+
+                                // The ORIGINAL file is only created once the file and the range are known to be valid
+                                if (!error && !(f_wrt = fopen(path_wrt, "wb")))
+                                    error = _FILE_INACCESSIBLE;
+
+                                // Allocates memory to an array with the purpose of saving the size of each SHAF block
+                                sf_sizes = malloc(sizeof(unsigned long) * length);
+                                if (sf_sizes) {
+
+                                    // Allocates memory to an array with the purpose of saving the sizes of each RLE/ORIGINAL block
+                                    sizes = malloc(sizeof(unsigned long) * length);
+                                    if (sizes) {
+
+                                        if (rle_decompression) {
+                                            final_sizes = malloc(sizeof(unsigned long) * length);
+                                            if (!final_sizes)
+                                                error = _LACK_OF_MEMORY;
+                                        }  
+
+                                        for (unsigned long long thread_idx = 0; thread_idx < num_tasks && !error; ++thread_idx) {
+
+                                            entry = index ? &index[first_block + thread_idx] : NULL;
+
+                                            // Reads the size of the shafa blockss
+                                            if (next_block(&input, entry, &sf_bsize)) {
+
+                                                sf_sizes[thread_idx] = sf_bsize;
+
+                                                // Memory for the block of shafa code
+                                                error = multithread_reserve(sf_bsize);
+                                                if (error) break;
+
+                                                // Loads one block of shafa code (or points to it if the file is mapped)
+                                                error = input_block(&input, sf_bsize, &shafa_code, &shafa_allocated);
+                                                if (!error) {
+
+                                                    // Reads the size of the decompressed shafa code and saves it along with the block of COD code
+                                                    error = read_block_codes(f_cod, canonical, &sizes[thread_idx], &original_size, &block_codes);
+
+                                                    // The block index must agree with the COD file (textual ones don't keep the size before RLE, so it's taken from the index)
+                                                    if (!error && entry) {
+                                                        if (mode == 'R' && !original_size)
+                                                            original_size = entry->original_size;
+
+                                                        // Sync points must be inside the block
+                                                        if ((mode == 'R' ? original_size : sizes[thread_idx]) != entry->original_size
+                                                            || (entry->sync.num_points && entry->sync.points[entry->sync.num_points - 1].symbol >= sizes[thread_idx])) {
+                                                            free(block_codes.text);
+                                                            error = _FILE_UNRECOGNIZABLE;
+                                                        }
+                                                    }
+
+                                                    if (!error) {
+
+                                                        // Blocks with the same codes share the decoding table
+                                                        decoder = table_cache_get(&DECODING_TABLES, &block_codes);
+                                                        if (!decoder) {
+                                                            error = _LACK_OF_MEMORY;
+                                                            buffer_pool_release(shafa_allocated);
+                                                            break;
+                                                        }
+
+                                                        // Memory for the block of COD code and the decompressed blocks
+                                                        error = multithread_reserve(BLOCK_CODES_SIZE + sizes[thread_idx] + (rle_decompression ? rle_size_bound(sizes[thread_idx], original_size) : 0));
+                                                        if (error) {
+                                                            buffer_pool_release(shafa_allocated);
+                                                            table_cache_release(&DECODING_TABLES, decoder, NULL);
+                                                            break;
+                                                        }
+
+                                                        // Blocks with sync points are decompressed in parts by separate tasks (a range only needs some of them, so it's decompressed as a whole)
+                                                        if (entry && entry->sync.num_points && !range) {
+                                                            error = queue_split_block(f_wrt, shafa_code, shafa_allocated, sf_bsize, sizes[thread_idx], original_size, rle_decompression, 
+                                                                rle_decompression ? &final_sizes[thread_idx] : NULL, &entry->sync, decoder);
+                                                            if (error) break;
+                                                            continue;
+                                                        }
+
+                                                        // Allocates memory for the arguments
+                                                        args = malloc(sizeof(ArgumentsSHAFA)); 
+                                                        if (!args) {
+                                                            error = _LACK_OF_MEMORY;
+                                                            buffer_pool_release(shafa_allocated);
+                                                            table_cache_release(&DECODING_TABLES, decoder, NULL);
+                                                            break;
+                                                        }
+                                                            
+                                                        // Only the part of the block inside the range is written
+                                                        slice_size = ULONG_MAX;
+
+                                                        if (range) {
+                                                            slice_start = thread_idx ? 0 : slice_start;
+                                                            slice_size = entry->original_size - slice_start < range_left ? entry->original_size - slice_start : range_left;
+                                                            range_left -= slice_size;
+                                                        }
+
+                                                        // Arguments for the SHAFA multithread
+                                                        *args = (ArgumentsSHAFA) {
+                                                            .f_wrt = f_wrt,
+                                                            .shafa_code = shafa_code,
+                                                            .shafa_allocated = shafa_allocated,
+                                                            .shafa_size = sf_bsize,
+                                                            .original_size = original_size,
+                                                            .rle_decompression = rle_decompression,
+                                                            .rle_sizes = &sizes[thread_idx],
+                                                            .final_sizes = &final_sizes[thread_idx],
+                                                            .decoder = decoder,
+                                                            .slice_start = slice_start,
+                                                            .slice_size = slice_size,
+                                                            .num_streams = num_streams
+                                                        };
+                                                        error = multithread_create(process_shafa_decomp, release_decompressed_shafa, args); 
+                                                            
+                                                        if (error) {
+                                                            buffer_pool_release(shafa_allocated);
+                                                            table_cache_release(&DECODING_TABLES, decoder, NULL);
+                                                            free(args);
+                                                            break;
                                                         }
-                                                        else 
-                                                            error = _FILE_STREAM_FAILED;
-                                                 
                                                     }
                                                     else 
-                                                        error = _LACK_OF_MEMORY;                                                      
+                                                        buffer_pool_release(shafa_allocated);
                                                 }
-                                                else 
-                                                    error = _FILE_STREAM_FAILED;
+                                            }
+                                            else 
+                                                error = _FILE_STREAM_FAILED;
+
+                                            } 
+                                            thread_error = multithread_wait();
+
+                                            if (!error)
+                                                error = thread_error;
 
-                                                } 
-                                                multithread_wait();
+                                            table_cache_clear(&DECODING_TABLES);
+                                            buffer_pool_clear();
 
-                                        }
-                                        else 
-                                            error = _LACK_OF_MEMORY;
                                     }
                                     else 
-                                        error = _LACK_OF_MEMORY;                               
-
+                                        error = _LACK_OF_MEMORY;
                                 }
                                 else 
-                                    error = _FILE_UNRECOGNIZABLE;                           
+                                    error = _LACK_OF_MEMORY;                               
+
+                                if (f_wrt)
+                                    fclose(f_wrt);
                             }
                             else 
-                                error = _FILE_STREAM_FAILED;
+                                error = _FILE_UNRECOGNIZABLE;                           
                         }
                         else 
                             error = _FILE_STREAM_FAILED;
-
-                        fclose(f_cod);
-                        
                     }
                     else 
-                        error = _FILE_INACCESSIBLE;
-                    
-                    free(path_cod);
+                        error = _FILE_STREAM_FAILED;
 
+                    fclose(f_cod);
+                    
                 }
                 else 
-                    error = _LACK_OF_MEMORY;
-
-                fclose(f_wrt);
+                    error = _FILE_INACCESSIBLE;
+                
+                free(path_cod);
 
             }
             else 
-                error = _FILE_INACCESSIBLE;
+                error = _LACK_OF_MEMORY;
             
             if (rle_decompression) 
                 free(path_tmp);
@@ -804,6 +1371,7 @@ _modules_error shafa_decompress (char ** const path, bool rle_decompression)
         else 
             error = _LACK_OF_MEMORY;
 
+        input_close(&input);
         fclose(f_shafa);
     }
     else 
@@ -814,21 +1382,69 @@ _modules_error shafa_decompress (char ** const path, bool rle_decompression)
         *path = path_wrt;
         free(path_shafa);
 
-        if (rle_decompression) {
+        if (STATS == STATS_JSON) {
 
-            print_summary(total_time, sf_sizes, final_sizes, length, path_wrt, _SHAFA_RLE); 
+            stats_print(stdout, "D", total_time);
+            if (rle_decompression)
+                free(final_sizes);
+
+        }
+        else if (rle_decompression) {
+
+            print_summary(total_time, sf_sizes, final_sizes, num_tasks, path_wrt, _SHAFA_RLE); 
             free(final_sizes);
 
         }// If RLE decompression didn't occur
         else {
-            print_summary(total_time, sf_sizes, sizes, length, path_wrt, _SHAFA);                                               
+            print_summary(total_time, sf_sizes, sizes, num_tasks, path_wrt, _SHAFA);                                               
         }
     }
+    else
+        free(path_wrt);
                                       
     if (sizes) 
         free(sizes);
     if (sf_sizes) 
         free(sf_sizes);
+    free(index);
     
     return error;
 }
+
+
+_modules_error decompress_block (const BlockCodes * block_codes, const uint8_t * shafa, unsigned long shafa_size, unsigned long rle_size, unsigned long original_size, bool rle_decompression, uint8_t ** block)
+{
+    _modules_error error;
+    Decoder decoder;
+    ArgumentsRLE args_rle;
+    uint8_t * shafa_decompressed;
+
+    // Each block brings its own codes, so its decoding table isn't shared
+    error = create_decoder(block_codes, &decoder);
+
+    if (!error) {
+        error = shafa_block_decompressor(shafa, shafa_size, rle_size, 1, &decoder, &shafa_decompressed);
+        free(decoder.entries);
+    }
+
+    if (!error) {
+        if (rle_decompression) {
+
+            args_rle = (ArgumentsRLE) {
+                .buffer = shafa_decompressed,
+                .allocated = shafa_decompressed,
+                .rle_block_size = rle_size,
+                .original_size = original_size,
+                .final_sizes = &rle_size
+            };
+
+            error = rle_block_decompressor(&args_rle);
+            if (!error)
+                *block = args_rle.sequence;
+        }
+        else
+            *block = shafa_decompressed;
+    }
+
+    return error;
+}
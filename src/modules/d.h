@@ -1,17 +1,21 @@
 #ifndef MODULE_D_H
 #define MODULE_D_H
 
+#include <stdint.h>
 #include <stdbool.h>
 
+#include "utils/codes.h"
 #include "utils/errors.h"
+#include "utils/block_index.h"
 
 /**
 \brief Decompresses file which was compressed with Shannon Fano's algorithm and saves it to disk
  @param path Pointer to the SHAFA->RLE file's path
  @param decompress_rle Decompresses file with RLE's algorithm too
+ @param range Only decompresses the blocks overlapping this range (through the block index) and saves the range itself (NULL for the whole file)
  @returns Error status
 */
-_modules_error shafa_decompress(char ** path, bool decompress_rle);
+_modules_error shafa_decompress(char ** path, bool decompress_rle, const ByteRange * range);
 
 
 /**
@@ -21,4 +25,17 @@ _modules_error shafa_decompress(char ** path, bool decompress_rle);
 */
 _modules_error rle_decompress(char ** path);
 
+/**
+\brief Decompresses a single block compressed with Shannon Fano's algorithm (and RLE's, if needed)
+ @param block_codes Codes of the block
+ @param shafa Compressed block
+ @param shafa_size Size of the compressed block
+ @param rle_size Number of symbols codified in the block (its size before Shannon Fano's algorithm)
+ @param original_size Size of the block before RLE's algorithm (only used with `rle_decompression`)
+ @param rle_decompression Decompresses the block with RLE's algorithm too
+ @param block Address to load a buffer of the pool with the decompressed block (released with buffer_pool_release)
+ @returns Error status
+*/
+_modules_error decompress_block(const BlockCodes * block_codes, const uint8_t * shafa, unsigned long shafa_size, unsigned long rle_size, unsigned long original_size, bool rle_decompression, uint8_t ** block);
+
 #endif //MODULE_D_H
@@ -6,7 +6,6 @@
  *
  **************************************************/
 
-#include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,9 +13,17 @@
 #include <stdbool.h>
 
 
+#include "f.h"
 #include "utils/file.h"
+#include "utils/input.h"
+#include "utils/freqs.h"
+#include "utils/histogram.h"
+#include "utils/rle.h"
+#include "utils/stats.h"
 #include "utils/errors.h"
 #include "utils/extensions.h"
+#include "utils/multithread.h"
+#include "utils/buffer_pool.h"
 
 /**
 \brief Compresses a block
@@ -26,32 +33,10 @@
  @param size_f Size of the original file
  @returns Size of the compressed block
 */
-static unsigned long block_compression(const uint8_t buffer[], uint8_t block[], const unsigned long block_size, unsigned long size_f)
+unsigned long block_compression(const uint8_t buffer[], uint8_t block[], const unsigned long block_size, unsigned long size_f)
 {
-    //Looping variables(i,j)
-    unsigned long i, j, size_block_rle;
-    //Cycle that goes through the block of symbols of the file
-    for(i = 0, size_block_rle=0; i < block_size && i < size_f; i = j) {
-        //Number of repetitions of a symbol
-        int n_reps = 0;
-        //Counts the number of repetitions of a symbol
-        for(j = i; buffer[i] == buffer[j] && n_reps <255 && j<block_size; ++j, ++n_reps);
-        //If a symbol repits itself 4 times or more or if the symbol is NULL
-        if(n_reps >= 4 || !buffer[i])
-        {
-            block[size_block_rle] = 0;
-            block[size_block_rle+1] = buffer[i];
-            block[size_block_rle+2] = n_reps;
-            size_block_rle +=3;
-        }
-        else
-        {
-            block[size_block_rle] = buffer[i];
-            size_block_rle++;
-            j = ++i; 
-        } 
-    }
-    return size_block_rle;
+    //Runs are found by a vectorized scanner, the output is the same as scanning byte by byte
+    return rle_encode(buffer, block, block_size < size_f ? block_size : size_f);
 }
 
 /**
@@ -60,61 +45,90 @@ static unsigned long block_compression(const uint8_t buffer[], uint8_t block[],
  @param freq Array to put the frequencies
  @param size_block Block size
 */
-static void make_freq(const unsigned char* block, unsigned long* freq, unsigned long size_block)
+void make_freq(const unsigned char* block, unsigned long* freq, unsigned long size_block)
 {
-    int i;
-    unsigned long j;
-    //Puts all the elements of freq as 0
-    for(i = 0; i < 256; i++) freq[i] = 0;
-    //Goes through the block
-    for(j = 0; j < size_block; j++)
-    {
-        int symbol;
-        //Saves symbol
-        symbol = block[j];
-        //Increments frequency of the symbol
-        ++freq[symbol];
-    
+    histogram(block, size_block, freq);
+}
+
+/**
+\brief Struct with the parameters that are going to multithread
+*/
+typedef struct {
+    bool compress_rle;
+    bool write_freq;
+    bool binary_freq;
+    unsigned long block_size;
+    const uint8_t *buffer;
+    uint8_t *allocated; //NULL if the buffer is mapped from the txt file
+    uint8_t *block;
+    unsigned long *size_block_rle;
+    unsigned long freq[256];
+    unsigned long freq_rle[256];
+    FILE *f_rle;
+    FILE *f_rle_freq;
+    FILE *f_freq;
+} Arguments;
+
+/**
+\brief Compresses a block with RLE (if needed) and generates the frequencies of the compressed and/or original block
+ @param _args Structure with all arguments needed to this function
+ @returns Error status
+*/
+static _modules_error compress_block_freq(void * const _args)
+{
+    Arguments *args = (Arguments *) _args;
+
+    if(args->compress_rle) {
+        //The first block was already compressed by the main thread
+        if(!args->block) {
+            //Allocates memory for the array that will contain the compressed content of the buffer
+            args->block = buffer_pool_acquire(args->block_size * 2.1);
+            if(!args->block) return _LACK_OF_MEMORY;
+            //Compresses the current block and returns its size
+            *args->size_block_rle = block_compression(args->buffer, args->block, args->block_size, args->block_size);
+        }
+        //Generates the arrays of frequencies of both the rle and txt blocks in a single pass
+        if(args->write_freq) histogram_pair(args->block, *args->size_block_rle, args->freq_rle, args->buffer, args->block_size, args->freq);
+        //Generates an array of frequencies of the block (rle file content)
+        else make_freq(args->block, args->freq_rle, *args->size_block_rle);
     }
+    //Generates an array of frequencies of the block (txt file content)
+    else if(args->write_freq) make_freq(args->buffer, args->freq, args->block_size);
+
+    return _SUCCESS;
 }
 
 /**
-\brief Writes the frequencies in the freq file
- @param freq Array with the frequencies
- @param f_freq Freq file where we load the content
- @param block_num Current block
- @param n_blocks Number of blocks
+\brief Writes the compressed block to the rle file and its frequencies to the freq files
+ @param _args Structure with all arguments needed to this function
+ @param prev_error Error before calling this function
+ @param error Error after calling this function
  @returns Error status
 */
-static _modules_error write_freq(const unsigned long *freq, FILE* f_freq, const unsigned long long block_num, const unsigned long long n_blocks) 
+static _modules_error write_block_rle_freq(void * const _args, _modules_error prev_error, _modules_error error)
 {
-    int i, j, print = 0, print2 = 0, print3 = 0;
-    _modules_error error = _SUCCESS;
-    //Goes through the block of frequencies
-    for(i = 0; i < 256;)
-    {   //Writes the frequency of each value in the freq file
-        print = fprintf(f_freq,"%lu", freq[i]);
-        //Verifys if the fprintf went well
-        if(print >= 1) {
-            //If the frequencies of consecutive values are the same writes ';' after the fisrt value
-            for(j = i; freq[i] == freq[j] && j<256 ; j++)
-            {
-                if(j!=255) {
-                    print2 = fprintf(f_freq, ";");
-                    //If the fprintf went wrong
-                    if(print2 < 0) error = _FILE_STREAM_FAILED;
-                }  
+    Arguments *args = (Arguments *) _args;
+    const unsigned long size_block_rle = *args->size_block_rle;
+    const double start = stats_clock();
+
+    if(!error && !prev_error) {
+        if(args->compress_rle) {
+            //Writes each compressed block in the rle file
+            if(fwrite(args->block, 1, size_block_rle, args->f_rle) != size_block_rle) error = _FILE_STREAM_FAILED;
+            //Writes the size of the current compressed block and its frequencies in the freq file
+            else {
+                stats_write(size_block_rle, start);
+                error = write_block_freq(args->f_rle_freq, size_block_rle, args->block_size, args->freq_rle, args->binary_freq);
             }
-            i = j;
         }
-        else error = _FILE_STREAM_FAILED; 
-    }//If it's the last block
-    if(block_num == n_blocks -1) {
-        print3 = fprintf(f_freq, "@0");
-        //If the fprintf went wrong
-        if(print3 < 1) error = _FILE_STREAM_FAILED;
+        //Writes the current block size and its frequencies in the freq file
+        if(!error && args->write_freq) error = write_block_freq(args->f_freq, args->block_size, args->block_size, args->freq, args->binary_freq);
     }
 
+    buffer_pool_release(args->allocated);
+    buffer_pool_release(args->block);
+    free(_args);
+
     return error;
 }
 
@@ -138,12 +152,15 @@ static inline void print_summary(unsigned long long n_blocks, unsigned long *blo
         "Number of blocks: %lu\n" , n_blocks
     );
     
-    printf("Size of blocks analyzed in the original file: ");
-    //Cycle to print the block sizes of the txt file
-    for(unsigned long long i = 0; i < n_blocks; i++) {
-        if(i == n_blocks - 1)
-            printf("%lu\n", block_sizes[i]);
-        else printf("%lu/", block_sizes[i]);
+    //The quiet summary leaves out the size of each block
+    if(STATS != STATS_QUIET) {
+        printf("Size of blocks analyzed in the original file: ");
+        //Cycle to print the block sizes of the txt file
+        for(unsigned long long i = 0; i < n_blocks; i++) {
+            if(i == n_blocks - 1)
+                printf("%lu\n", block_sizes[i]);
+            else printf("%lu/", block_sizes[i]);
+        }
     }
     
     if(path_rle) {
@@ -156,13 +173,15 @@ static inline void print_summary(unsigned long long n_blocks, unsigned long *blo
         compression_ratio*=100.0;
         printf("RLE Compression: %s (%f%% compression)\n", path_rle, compression_ratio);
         
-        printf("Size of blocks analyzed in the RLE file: ");
-        //Cycle to print the block sizes of the rle file
-    
-        for(unsigned long long i = 0; i < n_blocks; i++) {
-            if(i == n_blocks - 1)
-                printf("%lu bytes\n", block_rle_sizes[i]);
-            else printf("%lu/", block_rle_sizes[i]);
+        if(STATS != STATS_QUIET) {
+            printf("Size of blocks analyzed in the RLE file: ");
+            //Cycle to print the block sizes of the rle file
+        
+            for(unsigned long long i = 0; i < n_blocks; i++) {
+                if(i == n_blocks - 1)
+                    printf("%lu bytes\n", block_rle_sizes[i]);
+                else printf("%lu/", block_rle_sizes[i]);
+            }
         }
     }
     printf("Module runtime (milliseconds): %f\n", total_t);
@@ -177,27 +196,28 @@ static inline void print_summary(unsigned long long n_blocks, unsigned long *blo
 }
 
 
-_modules_error freq_rle_compress(char** const path, const bool force_rle, const bool force_freq, const unsigned long block_size)
+_modules_error freq_rle_compress(char** const path, const bool force_rle, const bool force_freq, const unsigned long block_size, const bool binary_freq)
 {
-    clock_t t; 
     float total_t;
     float compression_ratio;
-    uint8_t *buffer, *block;
-    int  print_rle, print;
+    const uint8_t *buffer = NULL;
+    uint8_t *allocated = NULL, *first_block = NULL;
     long compression;
     unsigned long long n_blocks, block_num;
     bool compress_rle;
     long size_of_last_block;
     char *path_rle = NULL, *path_rle_freq = NULL, *path_freq = NULL; 
-    unsigned long size_f, the_block_size, size_block_rle, compresd, *block_sizes, *block_rle_sizes, s;
+    unsigned long size_f, the_block_size, compresd, first_size_rle = 0, *block_sizes = NULL, *block_rle_sizes = NULL;
     FILE *f, *f_rle=NULL, *f_rle_freq=NULL, *f_freq=NULL;
+    InputFile input;
+    Arguments *args;
+    _modules_error error = _SUCCESS, thread_error;
 
     compress_rle = true;
     size_of_last_block = 0;
     the_block_size = block_size;
-    _modules_error error = _SUCCESS;
 
-    t = clock();
+    clock_main_thread(START_CLOCK);
 
     //Opening txt file
     f = fopen(*path, "rb");
@@ -215,151 +235,119 @@ _modules_error freq_rle_compress(char** const path, const bool force_rle, const
                     //Getting number of blocks of the txt file
                     n_blocks = fsize(f, *path, &the_block_size, &size_of_last_block);
                     //Getting the size of the txt file
-                    size_f = (n_blocks-1) * (int)the_block_size + (int)size_of_last_block;
+                    size_f = (n_blocks-1) * the_block_size + size_of_last_block;
                     //If txt file size is at least 1KiB
-                    if(size_f >= _1KiB){        
+                    if(n_blocks > 0 && size_f >= _1KiB){        
                                     
-                        compresd = the_block_size;
-                        size_block_rle = 0;
-                        //Allocates memory for the array that will contain the block sizes of the txt file
-                        block_sizes = malloc(n_blocks * sizeof(unsigned long));
+                        //Allocates memory for the arrays that will contain the block sizes of the txt and rle files
+                        block_sizes = malloc(2 * n_blocks * sizeof(unsigned long));
                         if(block_sizes) {
-                            //Allocates memory for the array that will contain the block sizes of the rle file
-                            block_rle_sizes = malloc(n_blocks * sizeof(unsigned long));
-                            if(block_rle_sizes) {
-                                //Divides the buffer into blocks
-                                for (block_num = 0, s = 0; block_num < n_blocks; ++block_num) {
-                                    //If it's the last block
-                                    if(block_num == n_blocks -1) {
-                                        compresd = size_f - s;                                            
+                            block_rle_sizes = block_sizes + n_blocks; // Acts as a "virtual" array
+
+                            //The txt file is mapped whenever possible so blocks don't need to be copied
+                            input_open(&input, f);
+
+                            //The first block decides whether RLE is worth it, so it is compressed before any thread starts
+                            compresd = (n_blocks == 1) ? size_f : the_block_size;
+                            first_block = buffer_pool_acquire(compresd * 2.1);
+                            if(first_block) {
+                                if(!(error = input_block(&input, compresd, &buffer, &allocated))) {
+                                    first_size_rle = block_compression(buffer, first_block, compresd, size_f);
+                                    //Calculates the compression rate
+                                    compression = (long) compresd - (long) first_size_rle;
+                                    compression_ratio = (float)compression/(float)compresd;
+                                    //If the rate is lower than 5% and the user didn't force the rle file
+                                    if(compression_ratio < 0.05 && !force_rle) {
+                                        compress_rle = false;
+                                        buffer_pool_release(first_block);
+                                        first_block = NULL;
+                                    }
+
+                                    //Opening rle and rle freq files
+                                    if(compress_rle) {
+                                        f_rle = fopen(path_rle, "wb");
+                                        f_rle_freq = fopen(path_rle_freq, "wb");
+                                        if(!f_rle || !f_rle_freq) error = _FILE_INACCESSIBLE;
+                                        //Writes the header of the freq file (mode R)
+                                        else error = write_freq_header(f_rle_freq, 'R', n_blocks, binary_freq);
                                     }
-                                    //Loads size of the current block of the txt file to the respective array
-                                    block_sizes[block_num] = compresd;
-                                    //Allocates memory for the array that will contain the content of the txt file
-                                    buffer = malloc(compresd * sizeof(uint8_t));
-                                    if(buffer) {
-                                        //Loads the content of the block of the txt file into the buffer
-                                        if(fread(buffer, sizeof(uint8_t), compresd, f) == compresd) {
-                                            //Allocates memory for the array that will contain the compressed content of the buffer
-                                            block = malloc(compresd * 2.1);
-                                            if(block) {
-                                                if(compress_rle) {
-                                                    //Compresses the current block and returns its size
-                                                    size_block_rle = block_compression(buffer, block, compresd, size_f);
-                                                    //If it's the first block
-                                                    if(block_num == 0) {
-                                                        //Calculates the compression rate
-                                                        compression = compresd - size_block_rle;
-                                                        compression_ratio = (float)compression/(float)compresd;
-                                                                    
-                                                                    
-                                                        //If the rate is lower than 5% and the user didn't force the rle file
-                                                        if(compression_ratio < 0.05 && !force_rle) compress_rle = false;
-                                                    }
-                                                }
-
-                                                //Opening rle file
-                                                if(!f_rle && compress_rle) {
-                                                    f_rle = fopen(path_rle, "wb");
-                                                    if(!f_rle) {
-                                                        error = _FILE_INACCESSIBLE;
-                                                        break;
-                                                    }
-                                                }
-                                                //Opening rle freq file
-                                                if(!f_rle_freq && compress_rle) {
-                                                    f_rle_freq = fopen(path_rle_freq, "wb");
-                                                    if(!f_rle_freq) {
-                                                        error = _FILE_INACCESSIBLE;
-                                                        break;
-                                                    }
-                                                }
-                                                //Opening freq file
-                                                if(!f_freq && (force_freq || (!compress_rle))) {
-                                                f_freq = fopen(path_freq, "wb");
-                                                    if(!f_freq) {
-                                                        error = _FILE_INACCESSIBLE;
-                                                        break;
-                                                    }
-                                                }
-                                                                        
-                                                //If it's the first block and the user forced the rle file
-                                                if(block_num == 0 && compress_rle) {
-                                                    //Prints the header of the freq file: @R@n_blocks
-                                                    print_rle = fprintf(f_rle_freq,"@R@%lu", n_blocks);
-                                                }
-                                                //If it's the first block and the user didn't forced the rle file or forced the freq file
-                                                if(block_num == 0 && (!compress_rle || force_freq)) {
-                                                    //Prints the header of the freq file: @N@n_blocks
-                                                    print = fprintf(f_freq,"@N@%lu", n_blocks);
-                                                }
-                                                //If the fprintf went well
-                                                if((print >= 4 && print_rle >= 4) || (print >= 4 && !compress_rle) || print_rle >= 4) {
-                                                    //Allocates memory for all the 256 symbol's frequencies
-                                                    unsigned long *freq = malloc(sizeof(unsigned long)*256);
-                                                    if(freq) {
-                                                        //If it can be compressed
-                                                        if(compress_rle) {
-                                                                        
-                                                            //Loads size of the current block of the rle file to the respective array
-                                                            block_rle_sizes[block_num] = size_block_rle;
-                                                            //Writes each compressed block in the rle file
-                                                            int res = fwrite(block, 1, size_block_rle, f_rle);
-                                                            if(res == size_block_rle){
-                                                                //Generates an array of frequencies of the block (rle file content)
-                                                                make_freq(block, freq, size_block_rle);
-                                                                //Prints the size of the current compressed block in the freq file
-                                                                if(fprintf(f_rle_freq, "@%lu@", size_block_rle) >= 2) {
-                                                                    //Writes each frequencies block in the freq file from the rle file
-                                                                    error = write_freq(freq, f_rle_freq, block_num, n_blocks);
-                                                                }
-                                                                else error = _FILE_STREAM_FAILED;
-                                                        
-                                                            }
-                                                            else error = _FILE_STREAM_FAILED;
-                                                        }
-                                                        //If it can't be compressed or if the user forced the freq file
-                                                        if(!compress_rle || force_freq) {
-                                                                        
-                                                            //Generates an array of frequencies of the block (txt file content)
-                                                            make_freq(buffer, freq, compresd);
-                                                            //Prints the current block size in the freq file
-                                                            if(fprintf(f_freq, "@%lu@", compresd) >= 2) {
-                                                                //Writes each frequencies block in the freq file from the txt file
-                                                                error = write_freq(freq, f_freq, block_num, n_blocks);
-                                                                            
-                                                            }
-                                                            else error = _FILE_STREAM_FAILED;
-                                                            
-                                                        }
-                                                        free(freq);
-                                                    
-                                                    }
-                                                    else error = _LACK_OF_MEMORY;
-                                                }
-                                                else error = _FILE_STREAM_FAILED;
-
-                                            
-                                                free(block);
-                                            }
-                                            else error = _LACK_OF_MEMORY;
-
-                                                        
+                                    //Opening freq file
+                                    if(!error && (force_freq || !compress_rle)) {
+                                        f_freq = fopen(path_freq, "wb");
+                                        if(!f_freq) error = _FILE_INACCESSIBLE;
+                                        //Writes the header of the freq file (mode N)
+                                        else error = write_freq_header(f_freq, 'N', n_blocks, binary_freq);
+                                    }
+
+                                    //Divides the file into blocks which are processed by the threads
+                                    for(block_num = 0; block_num < n_blocks && !error; ++block_num) {
+                                        //If it's the last block
+                                        compresd = (block_num == n_blocks - 1) ? size_f - block_num * the_block_size : the_block_size;
+
+                                        //Input and rle blocks
+                                        error = multithread_reserve(compresd * (1 + (compress_rle ? 2.1 : 0)));
+                                        if(error) break;
+
+                                        //The first block was already loaded
+                                        if(block_num) {
+                                            //Loads the content of the block of the txt file (or points to it if the file is mapped)
+                                            error = input_block(&input, compresd, &buffer, &allocated);
+                                            if(error) break;
+                                        }
+
+                                        args = malloc(sizeof(Arguments));
+                                        if(!args) {
+                                            error = _LACK_OF_MEMORY;
+                                            break;
                                         }
-                                        else error = _FILE_STREAM_FAILED;
 
-                                        s+=compresd;
-                                        free(buffer);
+                                        *args = (Arguments) {
+                                            .compress_rle = compress_rle,
+                                            .write_freq = !compress_rle || force_freq,
+                                            .binary_freq = binary_freq,
+                                            .block_size = compresd,
+                                            .buffer = buffer,
+                                            .allocated = allocated,
+                                            .block = block_num ? NULL : first_block,
+                                            .size_block_rle = &block_rle_sizes[block_num],
+                                            .f_rle = f_rle,
+                                            .f_rle_freq = f_rle_freq,
+                                            .f_freq = f_freq
+                                        };
+
+                                        //Loads size of the current block of the txt file to the respective array
+                                        block_sizes[block_num] = compresd;
+                                        if(!block_num) block_rle_sizes[0] = first_size_rle;
+
+                                        //Buffers are owned by the thread from now on
+                                        allocated = first_block = NULL;
+
+                                        error = multithread_create(compress_block_freq, write_block_rle_freq, args);
+                                        if(error) {
+                                            buffer_pool_release(args->allocated);
+                                            buffer_pool_release(args->block);
+                                            free(args);
+                                            break;
+                                        }
                                     }
-                                    else error = _LACK_OF_MEMORY;
-                                                
+                                    thread_error = multithread_wait();
+                                    if(!error) error = thread_error;
+
+                                    //Marks the end of the freq files
+                                    if(!error && f_freq) error = write_freq_trailer(f_freq, binary_freq);
+                                    if(!error && f_rle_freq) error = write_freq_trailer(f_rle_freq, binary_freq);
+                                    if(f_rle) fclose(f_rle);
+                                    if(f_freq) fclose(f_freq);
+                                    if(f_rle_freq) fclose(f_rle_freq);
                                 }
-                                if(f_rle) fclose(f_rle);
-                                if(f_freq) fclose(f_freq);
-                                if(f_rle_freq) fclose(f_rle_freq);
                             }
                             else error = _LACK_OF_MEMORY;
-                                    
+
+                            //Only left over if a block never reached a thread
+                            buffer_pool_release(allocated);
+                            buffer_pool_release(first_block);
+                            buffer_pool_clear();
+                            input_close(&input);
                         }
                         else error = _LACK_OF_MEMORY;  
                     }
@@ -397,16 +385,14 @@ _modules_error freq_rle_compress(char** const path, const bool force_rle, const
             free(*path);
             *path = path_rle;
         }
-        //Calculates the runtime
-        t = clock() - t;
-        //Calculates the time in milliseconds
-        total_t = (float) ((((double) t) / CLOCKS_PER_SEC) * 1000);
-        print_summary(n_blocks, block_sizes, size_f, block_rle_sizes, total_t, path_rle,  path_freq, path_rle_freq);
-        free(block_sizes);
-        free(block_rle_sizes);
+        //Calculates the runtime in milliseconds
+        total_t = clock_main_thread(STOP_CLOCK);
+        if(STATS == STATS_JSON) stats_print(stdout, "F", total_t);
+        else print_summary(n_blocks, block_sizes, size_f, block_rle_sizes, total_t, path_rle,  path_freq, path_rle_freq);
         if(path_freq) free(path_freq);
         if(path_rle_freq) free(path_rle_freq);
     }
+    free(block_sizes);
 
     return error;
 }
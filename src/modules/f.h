@@ -1,6 +1,7 @@
 #ifndef MODULE_F_H
 #define MODULE_F_H
 
+#include <stdint.h>
 #include <stdbool.h>
 
 #include "utils/errors.h"
@@ -11,8 +12,27 @@
  @param force_rle Force execution of RLE's algorithm even if % of compression <= 5%
  @param force_freq Force frequencies' file creation for original file even if it can be compressed with RLE
  @param block_size Size of each block
+ @param binary_freq Write the frequencies' table in the binary format instead of the textual one
  @returns Error status
 */
-_modules_error freq_rle_compress(char ** path, bool force_rle, bool force_freq, unsigned long block_size);
+_modules_error freq_rle_compress(char ** path, bool force_rle, bool force_freq, unsigned long block_size, bool binary_freq);
+
+/**
+\brief Compresses a block with RLE's algorithm
+ @param buffer Array loaded with the original file content
+ @param block Array where to load the compressed content (worst case is twice the block size)
+ @param block_size Size of the current block
+ @param size_f Size of the original file
+ @returns Size of the compressed block
+*/
+unsigned long block_compression(const uint8_t buffer[], uint8_t block[], unsigned long block_size, unsigned long size_f);
+
+/**
+\brief Turns block of content in an array of frequencies (each index matches a symbol from 0 to 255)
+ @param block Array with the symbols (current block)
+ @param freq Array to put the frequencies
+ @param size_block Block size
+*/
+void make_freq(const unsigned char * block, unsigned long * freq, unsigned long size_block);
 
 #endif //MODULE_F_H
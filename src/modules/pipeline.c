@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "f.h"
+#include "t.h"
+#include "c.h"
+#include "pipeline.h"
+#include "utils/file.h"
+#include "utils/input.h"
+#include "utils/codes.h"
+#include "utils/stats.h"
+#include "utils/errors.h"
+#include "utils/extensions.h"
+#include "utils/multithread.h"
+#include "utils/block_index.h"
+#include "utils/buffer_pool.h"
+
+/**
+\brief Struct with the parameters that are going to multithread
+*/
+typedef struct {
+    bool compress_rle;
+    bool canonical;
+    unsigned long block_size;
+    FILE * fd_codes;
+    FILE * fd_shafa;
+    unsigned long long shafa_start; // Position of the first block in the SHAFA file
+    BlockCodes block_codes;
+    const uint8_t * block_input;
+    uint8_t * block_input_allocated; // NULL if the block is mapped from the file
+    uint8_t * block_rle;
+    uint8_t * block_output;
+    unsigned long * rle_block_size;
+    unsigned long * new_block_size;
+    unsigned long sync_interval; // Symbols between the sync points (0 for none)
+    BlockSync * sync;
+    unsigned int num_streams; // Bitstreams the symbols are interleaved into (1 for the usual layout)
+} Arguments;
+
+/**
+\brief Compresses the block with RLE (if needed), calculates its frequencies and codes and finally compresses it with Shannon Fano's algorithm
+ @param _args Structure with all arguments needed to this function
+ @returns Error status
+*/
+static _modules_error compress_pipeline(void * const _args)
+{
+    Arguments * args = (Arguments *) _args;
+    unsigned long frequencies[NUM_SYMBOLS];
+    Code codes[NUM_SYMBOLS];
+    unsigned long num_symbols = args->block_size;
+    const uint8_t * symbols = args->block_input;
+    _modules_error error;
+
+    if (args->compress_rle) {
+
+        // The first block was already compressed by the main thread in order to decide whether RLE is worth it
+        if (!args->block_rle) {
+            args->block_rle = buffer_pool_acquire(args->block_size * 2.1);
+
+            if (!args->block_rle)
+                return _LACK_OF_MEMORY;
+
+            *args->rle_block_size = block_compression(args->block_input, args->block_rle, args->block_size, args->block_size);
+        }
+
+        buffer_pool_release(args->block_input_allocated);
+        args->block_input_allocated = NULL;
+
+        symbols = args->block_rle;
+        num_symbols = *args->rle_block_size;
+    }
+    else
+        *args->rle_block_size = num_symbols;
+
+    make_freq(symbols, frequencies, num_symbols);
+
+    // Canonical codes only keep their lengths
+    if (args->canonical)
+        error = make_block_lengths(frequencies, args->block_codes.lengths);
+
+    else {
+        args->block_codes.text = buffer_pool_acquire(BLOCK_CODES_SIZE);
+
+        if (!args->block_codes.text)
+            return _LACK_OF_MEMORY;
+
+        error = make_block_codes(frequencies, args->block_codes.text);
+    }
+
+    if (!error)
+        error = build_codes(&args->block_codes, codes);
+
+    if (!error && args->num_streams > 1)
+        error = compress_block_streams(codes, symbols, num_symbols, args->num_streams, &args->block_output, args->new_block_size);
+    else if (!error)
+        error = compress_block_sync(codes, symbols, num_symbols, args->sync_interval, args->sync, &args->block_output, args->new_block_size);
+
+    // The compressed block is written at its own position as soon as it's ready (only the codes wait for their turn)
+    if (!error)
+        error = write_block_shafa(args->fd_shafa, args->shafa_start, args->block_output, *args->new_block_size);
+
+    buffer_pool_release(args->block_output);
+    args->block_output = NULL;
+
+    return error;
+}
+
+/**
+\brief Writes the block's codes to their file (the codification was written by compress_pipeline)
+ @param _args Structure with all arguments needed to this function
+ @param prev_error Error before calling this function
+ @param error Error after calling this function
+ @returns Error status
+*/
+static _modules_error write_pipeline(void * const _args, _modules_error prev_error, _modules_error error)
+{
+    Arguments * args = (Arguments *) _args;
+
+    if (!error && !prev_error)
+        error = write_block_codes(args->fd_codes, *args->rle_block_size, args->block_size, &args->block_codes);
+
+    // Every buffer is released here since process may have stopped halfway
+    buffer_pool_release(args->block_input_allocated);
+    buffer_pool_release(args->block_rle);
+    buffer_pool_release(args->block_codes.text);
+    buffer_pool_release(args->block_output);
+    free(_args);
+
+    return error;
+}
+
+/**
+\brief Prints the results of the program execution
+ @param num_blocks Number of blocks analysed
+ @param blocks_input_size Block sizes of the original file
+ @param blocks_rle_size Block sizes after RLE's compression (NULL if it wasn't applied)
+ @param blocks_output_size Block sizes after the codification
+ @param total_time Time that the program took to execute
+ @param path_codes The path to the generated codes' file
+ @param path_shafa The path to the generated compressed file
+*/
+static inline void print_summary(const unsigned long long num_blocks, const unsigned long * const blocks_input_size, const unsigned long * const blocks_rle_size, const unsigned long * const blocks_output_size, const double total_time, const char * const path_codes, const char * const path_shafa)
+{
+    printf(
+        "Module: F+T+C (RLE, symbol codes' calculation and codification in a single pass)\n"
+        "Number of blocks: %llu\n", num_blocks
+    );
+    // The quiet summary leaves out the line of each block
+    for (unsigned long long i = 0; i < num_blocks && STATS != STATS_QUIET; ++i) {
+        if (blocks_rle_size)
+            printf("Size before/after RLE/after codification (Block %llu): %lu/%lu/%lu -> %d%%\n", i, blocks_input_size[i], blocks_rle_size[i], blocks_output_size[i], (int) (((float) blocks_output_size[i] / blocks_input_size[i]) * 100));
+        else
+            printf("Size before/after & compression rate (Block %llu): %lu/%lu -> %d%%\n", i, blocks_input_size[i], blocks_output_size[i], (int) (((float) blocks_output_size[i] / blocks_input_size[i]) * 100));
+    }
+
+    printf(
+        "Module runtime (milliseconds): %f\n"
+        "Generated files: %s, %s\n",
+        total_time, path_codes, path_shafa
+    );
+}
+
+
+_modules_error pipeline_compress(char ** const path, const bool force_rle, const unsigned long block_size, const bool canonical, const bool index, const unsigned long sync_interval, const unsigned int num_streams)
+{
+    FILE * fd_file, * fd_codes, * fd_shafa;
+    Arguments * args;
+    float total_time;
+    char * path_file = *path;
+    char * path_base, * path_codes = NULL, * path_shafa = NULL;
+    long long num_blocks;
+    long size_of_last_block;
+    unsigned long the_block_size = block_size, size_f, cur_block_size, first_rle_size;
+    unsigned long * blocks_size = NULL, * blocks_input_size, * blocks_rle_size, * blocks_output_size;
+    BlockSync * blocks_sync = NULL;
+    InputFile input;
+    const uint8_t * block_input;
+    uint8_t * block_input_allocated = NULL, * first_block_rle;
+    bool compress_rle = false;
+    int header_size;
+    _modules_error error = _SUCCESS, thread_error;
+
+    clock_main_thread(START_CLOCK);
+
+    fd_file = fopen(path_file, "rb");
+
+    if (fd_file) {
+
+        num_blocks = fsize(fd_file, NULL, &the_block_size, &size_of_last_block);
+
+        if (num_blocks > 0) {
+
+            size_f = (num_blocks - 1) * the_block_size + size_of_last_block;
+
+            if (size_f >= _1KiB) {
+
+                blocks_size = malloc(3 * num_blocks * sizeof(unsigned long));
+
+                // Sync points of each block for the block index
+                if (sync_interval)
+                    blocks_sync = calloc(num_blocks, sizeof(BlockSync));
+
+                if (blocks_size && (blocks_sync || !sync_interval)) {
+
+                    blocks_input_size = blocks_size;
+                    blocks_rle_size = blocks_input_size + num_blocks; // Acts as a "virtual" array
+                    blocks_output_size = blocks_rle_size + num_blocks;
+
+                    // The file is mapped whenever possible so blocks don't need to be copied
+                    input_open(&input, fd_file);
+
+                    // The first block decides whether RLE is worth it for the whole file (same criteria as module F)
+                    cur_block_size = (num_blocks == 1) ? (unsigned long) size_of_last_block : the_block_size;
+                    first_block_rle = buffer_pool_acquire(cur_block_size * 2.1);
+
+                    if (first_block_rle) {
+
+                        if (!(error = input_block(&input, cur_block_size, &block_input, &block_input_allocated))) {
+
+                            first_rle_size = block_compression(block_input, first_block_rle, cur_block_size, cur_block_size);
+                            compress_rle = force_rle || ((float) ((long) cur_block_size - (long) first_rle_size) / cur_block_size) >= 0.05;
+
+                            if (!compress_rle) {
+                                buffer_pool_release(first_block_rle);
+                                first_block_rle = NULL;
+                            }
+
+                            path_base = compress_rle ? add_ext(path_file, RLE_EXT) : path_file;
+
+                            if (path_base) {
+                                path_codes = add_ext(path_base, CODES_EXT);
+                                path_shafa = add_ext(path_base, SHAFA_EXT);
+
+                                if (compress_rle)
+                                    free(path_base);
+                            }
+
+                            if (path_codes && path_shafa) {
+
+                                fd_codes = fopen(path_codes, "wb");
+
+                                if (fd_codes) {
+
+                                    fd_shafa = fopen(path_shafa, "wb");
+
+                                    if (fd_shafa) {
+
+                                        // Blocks are written by the threads at their own positions, so nothing can be left buffered (interleaved blocks are marked by their number of streams)
+                                        if (num_streams > 1)
+                                            header_size = fprintf(fd_shafa, "@%lld#%u", num_blocks, num_streams);
+                                        else
+                                            header_size = fprintf(fd_shafa, "@%lld", num_blocks);
+
+                                        if (!write_codes_header(fd_codes, compress_rle ? 'R' : 'N', num_blocks, canonical) && header_size >= 2 && !fflush(fd_shafa)) {
+
+                                            for (long long block_idx = 0; block_idx < num_blocks; ++block_idx) {
+
+                                                cur_block_size = (block_idx == num_blocks - 1) ? (unsigned long) size_of_last_block : the_block_size;
+
+                                                // Input, RLE (up to 2.1 times the input) and output blocks (less than 9 bits per codified symbol) along with the codes
+                                                error = multithread_reserve(cur_block_size * (1 + (compress_rle ? 2.1 : 0) + (compress_rle ? 2.1 : 1) * 1.125) + BLOCK_CODES_SIZE);
+
+                                                if (error)
+                                                    break;
+
+                                                // First block was already loaded
+                                                if (block_idx) {
+                                                    error = input_block(&input, cur_block_size, &block_input, &block_input_allocated);
+
+                                                    if (error)
+                                                        break;
+                                                }
+
+                                                args = malloc(sizeof(Arguments));
+
+                                                if (!args) {
+                                                    error = _LACK_OF_MEMORY;
+                                                    break;
+                                                }
+
+                                                *args = (Arguments) {
+                                                    .compress_rle = compress_rle,
+                                                    .canonical = canonical,
+                                                    .block_size = cur_block_size,
+                                                    .fd_codes = fd_codes,
+                                                    .fd_shafa = fd_shafa,
+                                                    .shafa_start = header_size,
+                                                    .block_codes = { .text = NULL },
+                                                    .block_input = block_input,
+                                                    .block_input_allocated = block_input_allocated,
+                                                    .block_rle = block_idx ? NULL : first_block_rle,
+                                                    .block_output = NULL,
+                                                    .rle_block_size = &blocks_rle_size[block_idx],
+                                                    .new_block_size = &blocks_output_size[block_idx],
+                                                    .sync_interval = sync_interval,
+                                                    .sync = blocks_sync ? &blocks_sync[block_idx] : NULL,
+                                                    .num_streams = num_streams
+                                                };
+
+                                                if (!block_idx)
+                                                    blocks_rle_size[0] = first_rle_size;
+
+                                                blocks_input_size[block_idx] = cur_block_size;
+
+                                                // Buffers are owned by the thread from now on
+                                                block_input_allocated = first_block_rle = NULL;
+
+                                                error = multithread_create(compress_pipeline, write_pipeline, args);
+
+                                                if (error) {
+                                                    buffer_pool_release(args->block_input_allocated);
+                                                    buffer_pool_release(args->block_rle);
+                                                    free(args);
+                                                    break;
+                                                }
+                                            }
+                                            thread_error = multithread_wait();
+
+                                            if (!error)
+                                                error = thread_error;
+
+                                            if (!error)
+                                                error = write_codes_trailer(fd_codes, canonical);
+
+                                            // The index goes after the last block, whose position is only known now
+                                            if (!error && index)
+                                                error = write_block_index(fd_shafa, header_size, num_blocks, blocks_output_size, blocks_input_size, blocks_sync);
+                                        }
+                                        else
+                                            error = _FILE_STREAM_FAILED;
+
+                                        fclose(fd_shafa);
+                                    }
+                                    else
+                                        error = _FILE_INACCESSIBLE;
+
+                                    fclose(fd_codes);
+                                }
+                                else
+                                    error = _FILE_INACCESSIBLE;
+                            }
+                            else {
+                                // Either path may have been generated without the other
+                                free(path_codes);
+                                free(path_shafa);
+                                path_codes = path_shafa = NULL;
+                                error = _LACK_OF_MEMORY;
+                            }
+                        }
+                    }
+                    else
+                        error = _LACK_OF_MEMORY;
+
+                    // Only left over if a block never reached a thread
+                    buffer_pool_release(block_input_allocated);
+                    buffer_pool_release(first_block_rle);
+                    buffer_pool_clear();
+                    input_close(&input);
+                }
+                else
+                    error = _LACK_OF_MEMORY;
+            }
+            else
+                error = _FILE_TOO_SMALL;
+        }
+        else
+            error = _FILE_STREAM_FAILED;
+
+        fclose(fd_file);
+    }
+    else
+        error = _FILE_INACCESSIBLE;
+
+    if (!error) {
+        *path = path_shafa;
+        free(path_file);
+
+        total_time = clock_main_thread(STOP_CLOCK);
+
+        if (STATS == STATS_JSON)
+            stats_print(stdout, "F+T+C", total_time);
+        else
+            print_summary(num_blocks, blocks_input_size, compress_rle ? blocks_rle_size : NULL, blocks_output_size, total_time, path_codes, path_shafa);
+    }
+    else
+        free(path_shafa);
+
+    for (long long i = 0; blocks_sync && i < num_blocks; ++i)
+        free(blocks_sync[i].points);
+
+    free(path_codes);
+    free(blocks_size);
+    free(blocks_sync);
+
+    return error;
+}
@@ -0,0 +1,22 @@
+#ifndef MODULE_PIPELINE_H
+#define MODULE_PIPELINE_H
+
+#include <stdbool.h>
+
+#include "utils/errors.h"
+
+/**
+\brief Executes modules F, T and C in a single pass. Each block goes from RLE to frequencies to codes to Shannon Fano's codification
+ without ever touching the disk, so only the .cod and .shaf files are generated
+ @param path Pointer to the original file's path
+ @param force_rle Force execution of RLE's algorithm even if % of compression <= 5%
+ @param block_size Size of each block
+ @param canonical Only save the lengths of the codes (canonical codes) in the .cod file
+ @param index Append the block index to the .shaf file (so module D can decompress a range of it)
+ @param sync_interval Symbols between the sync points of each block, which are kept in the block index (0 for none)
+ @param num_streams Bitstreams the symbols of each block are interleaved into (1 for the usual layout, which is the only one with sync points)
+ @returns Error status
+*/
+_modules_error pipeline_compress(char ** path, bool force_rle, unsigned long block_size, bool canonical, bool index, unsigned long sync_interval, unsigned int num_streams);
+
+#endif //MODULE_PIPELINE_H
@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "f.h"
+#include "t.h"
+#include "c.h"
+#include "d.h"
+#include "stream.h"
+#include "utils/file.h"
+#include "utils/codes.h"
+#include "utils/binary.h"
+#include "utils/stats.h"
+#include "utils/errors.h"
+#include "utils/multithread.h"
+#include "utils/buffer_pool.h"
+
+/**
+\brief Sizes of the whole stream (only updated by the write's functions, which run sequentially)
+*/
+typedef struct {
+    unsigned long long num_blocks;
+    unsigned long long input_size;
+    unsigned long long output_size;
+} StreamTotals;
+
+/**
+\brief Struct with the parameters that are going to multithread while compressing
+*/
+typedef struct {
+    bool force_rle;
+    FILE * fd_output;
+    StreamTotals * totals;
+    StreamBlock block;
+    uint8_t * block_input;
+    uint8_t * block_output;
+} ArgumentsCompress;
+
+/**
+\brief Struct with the parameters that are going to multithread while decompressing
+*/
+typedef struct {
+    FILE * fd_output;
+    StreamTotals * totals;
+    StreamBlock block;
+    uint8_t * block_shafa;
+    uint8_t * block_output;
+} ArgumentsDecompress;
+
+/**
+\brief Prints the results of the program execution (to stderr, since stdout may be the stream itself)
+ @param decompression Whether the stream was decompressed
+ @param totals Sizes of the whole stream
+ @param total_time Time that the program took to execute
+*/
+static inline void print_summary(const bool decompression, const StreamTotals * const totals, const double total_time)
+{
+    fprintf(stderr,
+        "Module: %s\n"
+        "Number of blocks: %llu\n"
+        "Size before/after (stream): %llu/%llu\n"
+        "Module runtime (milliseconds): %f\n",
+        decompression ? "D (stream decoding)" : "F+T+C (stream encoding)",
+        totals->num_blocks, totals->input_size, totals->output_size, total_time
+    );
+}
+
+
+_modules_error stream_encode_block(const uint8_t * const block_input, const unsigned long block_size, const bool force_rle, StreamBlock * const block, uint8_t ** const block_output)
+{
+    unsigned long frequencies[NUM_SYMBOLS];
+    Code codes[NUM_SYMBOLS];
+    const uint8_t * symbols = block_input;
+    uint8_t * block_rle;
+    _modules_error error;
+
+    block_rle = buffer_pool_acquire(block_size * 2.1);
+
+    if (!block_rle)
+        return _LACK_OF_MEMORY;
+
+    // Every block decides on its own whether RLE is worth it (same criteria as module F)
+    block->block_size = block_size;
+    block->rle_block_size = block_compression(block_input, block_rle, block_size, block_size);
+    block->mode = force_rle || ((float) ((long) block_size - (long) block->rle_block_size) / block_size) >= 0.05 ? 'R' : 'N';
+
+    if (block->mode == 'R')
+        symbols = block_rle;
+    else
+        block->rle_block_size = block_size;
+
+    make_freq(symbols, frequencies, block->rle_block_size);
+
+    error = make_block_lengths(frequencies, block->lengths);
+
+    if (!error)
+        error = canonical_codes(block->lengths, codes);
+
+    if (!error)
+        error = compress_block(codes, symbols, block->rle_block_size, block_output, &block->new_block_size);
+
+    buffer_pool_release(block_rle);
+
+    return error;
+}
+
+
+void stream_store_header(const StreamBlock * const block, uint8_t header[STREAM_BLOCK_HEADER_SIZE])
+{
+    store_le64(header, block->block_size);
+    header[8] = block->mode;
+    store_le64(header + 9, block->rle_block_size);
+    memcpy(header + 17, block->lengths, NUM_SYMBOLS);
+    store_le64(header + 17 + NUM_SYMBOLS, block->new_block_size);
+}
+
+
+_modules_error stream_load_header(const uint8_t header[STREAM_BLOCK_HEADER_SIZE], StreamBlock * const block)
+{
+    const uint64_t block_size = load_le64(header), rle_block_size = load_le64(header + 9), new_block_size = load_le64(header + 17 + NUM_SYMBOLS);
+    const char mode = header[8];
+
+    // RLE takes at most 3 bytes per symbol and codes at most 64 bits
+    if (!block_size || block_size > _64MiB || (mode != 'R' && mode != 'N') || (mode == 'N' && rle_block_size != block_size)
+        || !rle_block_size || rle_block_size > 3 * block_size || new_block_size > rle_block_size * (MAX_CODE_LENGTH / 8))
+        return _FILE_UNRECOGNIZABLE;
+
+    block->mode = mode;
+    block->block_size = block_size;
+    block->rle_block_size = rle_block_size;
+    block->new_block_size = new_block_size;
+    memcpy(block->lengths, header + 17, NUM_SYMBOLS);
+
+    return _SUCCESS;
+}
+
+
+_modules_error stream_decode_block(const StreamBlock * const block, const uint8_t * const block_shafa, uint8_t ** const block_output)
+{
+    BlockCodes block_codes = { .text = NULL };
+
+    memcpy(block_codes.lengths, block->lengths, NUM_SYMBOLS);
+
+    return decompress_block(&block_codes, block_shafa, block->new_block_size, block->rle_block_size, block->block_size, block->mode == 'R', block_output);
+}
+
+/**
+\brief Compresses a block of the stream on its own
+ @param _args Structure with all arguments needed to this function
+ @returns Error status
+*/
+static _modules_error compress_stream_block(void * const _args)
+{
+    ArgumentsCompress * args = (ArgumentsCompress *) _args;
+    _modules_error error;
+
+    error = stream_encode_block(args->block_input, args->block.block_size, args->force_rle, &args->block, &args->block_output);
+
+    buffer_pool_release(args->block_input);
+    args->block_input = NULL;
+
+    return error;
+}
+
+/**
+\brief Writes the block's header (with its codes) followed by its codification to the stream
+ @param _args Structure with all arguments needed to this function
+ @param prev_error Error before calling this function
+ @param error Error after calling this function
+ @returns Error status
+*/
+static _modules_error write_stream_block(void * const _args, _modules_error prev_error, _modules_error error)
+{
+    ArgumentsCompress * args = (ArgumentsCompress *) _args;
+    uint8_t header[STREAM_BLOCK_HEADER_SIZE];
+    const double start = stats_clock();
+
+    if (!error && !prev_error) {
+
+        stream_store_header(&args->block, header);
+
+        if (fwrite(header, sizeof(uint8_t), STREAM_BLOCK_HEADER_SIZE, args->fd_output) != STREAM_BLOCK_HEADER_SIZE
+            || fwrite(args->block_output, sizeof(uint8_t), args->block.new_block_size, args->fd_output) != args->block.new_block_size)
+            error = _FILE_STREAM_FAILED;
+        else
+            stats_write(STREAM_BLOCK_HEADER_SIZE + args->block.new_block_size, start);
+
+        ++args->totals->num_blocks;
+        args->totals->input_size += args->block.block_size;
+        args->totals->output_size += STREAM_BLOCK_HEADER_SIZE + args->block.new_block_size;
+    }
+
+    // Every buffer is released here since process may have stopped halfway
+    buffer_pool_release(args->block_input);
+    buffer_pool_release(args->block_output);
+    free(_args);
+
+    return error;
+}
+
+
+_modules_error stream_compress(FILE * const fd_input, FILE * const fd_output, const bool force_rle, const unsigned long block_size)
+{
+    ArgumentsCompress * args;
+    StreamTotals totals = {0};
+    uint8_t header[STREAM_HEADER_SIZE], * block_input;
+    unsigned long cur_block_size;
+    float total_time;
+    double start;
+    _modules_error error = _SUCCESS, thread_error;
+
+    clock_main_thread(START_CLOCK);
+
+    memcpy(header, STREAM_MAGIC, 4);
+    header[4] = STREAM_VERSION;
+
+    if (fwrite(header, sizeof(uint8_t), STREAM_HEADER_SIZE, fd_output) == STREAM_HEADER_SIZE) {
+
+        totals.output_size = STREAM_HEADER_SIZE;
+
+        while (!error) {
+
+            // Input, RLE (up to 2.1 times the input) and output blocks (less than 9 bits per codified symbol)
+            error = multithread_reserve(block_size * (1 + 2.1 + 2.1 * 1.125));
+
+            if (error)
+                break;
+
+            block_input = buffer_pool_acquire(block_size);
+
+            if (!block_input) {
+                error = _LACK_OF_MEMORY;
+                break;
+            }
+
+            // fread only returns less than a whole block at the end of the stream
+            start = stats_clock();
+            cur_block_size = fread(block_input, sizeof(uint8_t), block_size, fd_input);
+            stats_read(cur_block_size, start);
+
+            if (!cur_block_size) {
+                if (ferror(fd_input))
+                    error = _FILE_STREAM_FAILED;
+
+                buffer_pool_release(block_input);
+                break;
+            }
+
+            args = malloc(sizeof(ArgumentsCompress));
+
+            if (!args) {
+                buffer_pool_release(block_input);
+                error = _LACK_OF_MEMORY;
+                break;
+            }
+
+            *args = (ArgumentsCompress) {
+                .force_rle = force_rle,
+                .fd_output = fd_output,
+                .totals = &totals,
+                .block = { .block_size = cur_block_size },
+                .block_input = block_input,
+                .block_output = NULL
+            };
+
+            error = multithread_create(compress_stream_block, write_stream_block, args);
+
+            if (error) {
+                buffer_pool_release(block_input);
+                free(args);
+            }
+        }
+        thread_error = multithread_wait();
+
+        if (!error)
+            error = thread_error;
+
+        // The end of the stream is marked by an empty block
+        if (!error && (!write_le64(fd_output, 0) || fflush(fd_output)))
+            error = _FILE_STREAM_FAILED;
+
+        totals.output_size += 8;
+    }
+    else
+        error = _FILE_STREAM_FAILED;
+
+    buffer_pool_clear();
+
+    if (!error) {
+        total_time = clock_main_thread(STOP_CLOCK);
+        if (STATS == STATS_JSON)
+            stats_print(stderr, "F+T+C (stream)", total_time);
+        else
+            print_summary(false, &totals, total_time);
+    }
+
+    return error;
+}
+
+/**
+\brief Decompresses a block of the stream with Shannon Fano's algorithm (and RLE's, if needed)
+ @param _args Structure with all arguments needed to this function
+ @returns Error status
+*/
+static _modules_error decompress_stream_block(void * const _args)
+{
+    ArgumentsDecompress * args = (ArgumentsDecompress *) _args;
+    _modules_error error;
+
+    error = stream_decode_block(&args->block, args->block_shafa, &args->block_output);
+
+    buffer_pool_release(args->block_shafa);
+    args->block_shafa = NULL;
+
+    return error;
+}
+
+/**
+\brief Writes the decompressed block to the output stream
+ @param _args Structure with all arguments needed to this function
+ @param prev_error Error before calling this function
+ @param error Error after calling this function
+ @returns Error status
+*/
+static _modules_error write_decompressed_block(void * const _args, _modules_error prev_error, _modules_error error)
+{
+    ArgumentsDecompress * args = (ArgumentsDecompress *) _args;
+    const double start = stats_clock();
+
+    if (!error && !prev_error) {
+
+        if (fwrite(args->block_output, sizeof(uint8_t), args->block.block_size, args->fd_output) != args->block.block_size)
+            error = _FILE_STREAM_FAILED;
+        else
+            stats_write(args->block.block_size, start);
+
+        ++args->totals->num_blocks;
+        args->totals->input_size += STREAM_BLOCK_HEADER_SIZE + args->block.new_block_size;
+        args->totals->output_size += args->block.block_size;
+    }
+
+    buffer_pool_release(args->block_shafa);
+    buffer_pool_release(args->block_output);
+    free(_args);
+
+    return error;
+}
+
+
+_modules_error stream_decompress(FILE * const fd_input, FILE * const fd_output)
+{
+    ArgumentsDecompress * args;
+    StreamTotals totals = {0};
+    uint8_t header[STREAM_BLOCK_HEADER_SIZE], * block_shafa;
+    StreamBlock block;
+    float total_time;
+    double start;
+    _modules_error error = _SUCCESS, thread_error;
+
+    clock_main_thread(START_CLOCK);
+
+    if (fread(header, sizeof(uint8_t), STREAM_HEADER_SIZE, fd_input) == STREAM_HEADER_SIZE) {
+
+        if (!memcmp(header, STREAM_MAGIC, 4) && header[4] == STREAM_VERSION) {
+
+            totals.input_size = STREAM_HEADER_SIZE + 8;
+
+            while (!error) {
+
+                // A truncated stream (without its empty block) is an error
+                if (fread(header, sizeof(uint8_t), 8, fd_input) != 8) {
+                    error = _FILE_STREAM_FAILED;
+                    break;
+                }
+
+                if (!load_le64(header))
+                    break;
+
+                if (fread(header + 8, sizeof(uint8_t), STREAM_BLOCK_HEADER_SIZE - 8, fd_input) != STREAM_BLOCK_HEADER_SIZE - 8) {
+                    error = _FILE_STREAM_FAILED;
+                    break;
+                }
+
+                error = stream_load_header(header, &block);
+
+                // Compressed, RLE and decompressed blocks
+                if (!error)
+                    error = multithread_reserve(block.new_block_size + block.rle_block_size + (block.mode == 'R' ? block.block_size : 0));
+
+                if (error)
+                    break;
+
+                block_shafa = buffer_pool_acquire(block.new_block_size ? block.new_block_size : 1);
+
+                if (!block_shafa) {
+                    error = _LACK_OF_MEMORY;
+                    break;
+                }
+
+                start = stats_clock();
+
+                if (fread(block_shafa, sizeof(uint8_t), block.new_block_size, fd_input) != block.new_block_size) {
+                    buffer_pool_release(block_shafa);
+                    error = _FILE_STREAM_FAILED;
+                    break;
+                }
+
+                stats_read(block.new_block_size, start);
+
+                args = malloc(sizeof(ArgumentsDecompress));
+
+                if (!args) {
+                    buffer_pool_release(block_shafa);
+                    error = _LACK_OF_MEMORY;
+                    break;
+                }
+
+                *args = (ArgumentsDecompress) {
+                    .fd_output = fd_output,
+                    .totals = &totals,
+                    .block = block,
+                    .block_shafa = block_shafa,
+                    .block_output = NULL
+                };
+
+                error = multithread_create(decompress_stream_block, write_decompressed_block, args);
+
+                if (error) {
+                    buffer_pool_release(block_shafa);
+                    free(args);
+                }
+            }
+            thread_error = multithread_wait();
+
+            if (!error)
+                error = thread_error;
+
+            if (!error && fflush(fd_output))
+                error = _FILE_STREAM_FAILED;
+        }
+        else
+            error = _FILE_UNRECOGNIZABLE;
+    }
+    else
+        error = _FILE_STREAM_FAILED;
+
+    buffer_pool_clear();
+
+    if (!error) {
+        total_time = clock_main_thread(STOP_CLOCK);
+        if (STATS == STATS_JSON)
+            stats_print(stderr, "D (stream)", total_time);
+        else
+            print_summary(true, &totals, total_time);
+    }
+
+    return error;
+}
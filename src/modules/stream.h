@@ -0,0 +1,87 @@
+#ifndef MODULE_STREAM_H
+#define MODULE_STREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utils/codes.h"
+#include "utils/errors.h"
+
+/*
+    Stream (binary), which is self-contained so it can be written to and read from a pipe:
+        "SSTR" | version (1 byte)
+        Each block: size of the block (8 bytes) | mode 'R'/'N' (1 byte) | size after RLE (8 bytes) | length of each symbol's code (256 bytes)
+                    | size of the codification (8 bytes) | codification
+        A block with size 0 ends the stream
+*/
+#define STREAM_MAGIC "SSTR"
+#define STREAM_VERSION 1
+#define STREAM_HEADER_SIZE 5
+#define STREAM_BLOCK_HEADER_SIZE 281
+
+/**
+\brief Header of a block compressed on its own (everything needed to decompress it but its codification)
+*/
+typedef struct {
+    char mode; // 'R' (RLE) or 'N' (Normal)
+    unsigned long block_size;
+    unsigned long rle_block_size; // Number of codified symbols
+    unsigned long new_block_size; // Size of the codification
+    uint8_t lengths[NUM_SYMBOLS]; // Lengths of the canonical codes
+} StreamBlock;
+
+/**
+\brief Compresses a block on its own: RLE (if it's worth it for this block), canonical codes and Shannon Fano's codification
+ @param block_input Block to be compressed
+ @param block_size Size of the block
+ @param force_rle Force execution of RLE's algorithm even if % of compression <= 5%
+ @param block Header of the compressed block to be filled
+ @param block_output Address to load a buffer of the pool with the codification (released with buffer_pool_release)
+ @returns Error status
+*/
+_modules_error stream_encode_block(const uint8_t * block_input, unsigned long block_size, bool force_rle, StreamBlock * block, uint8_t ** block_output);
+
+/**
+\brief Stores the header of a compressed block
+ @param block Header of the block
+ @param header Buffer with STREAM_BLOCK_HEADER_SIZE bytes
+*/
+void stream_store_header(const StreamBlock * block, uint8_t header[STREAM_BLOCK_HEADER_SIZE]);
+
+/**
+\brief Loads the header of a compressed block, checking its sizes before anything is allocated from them
+ @param header Buffer with STREAM_BLOCK_HEADER_SIZE bytes
+ @param block Header of the block to be filled
+ @returns Error status
+*/
+_modules_error stream_load_header(const uint8_t header[STREAM_BLOCK_HEADER_SIZE], StreamBlock * block);
+
+/**
+\brief Decompresses a block compressed with stream_encode_block
+ @param block Header of the block
+ @param block_shafa Codification of the block
+ @param block_output Address to load a buffer of the pool with the decompressed block (released with buffer_pool_release)
+ @returns Error status
+*/
+_modules_error stream_decode_block(const StreamBlock * block, const uint8_t * block_shafa, uint8_t ** block_output);
+
+/**
+\brief Compresses a stream (e.g. stdin) block by block as it's read, with the codes of each block inlined before its codification
+ @param fd_input Stream to compress (read until its end, so its size doesn't need to be known)
+ @param fd_output Stream where the compressed stream is written (never seeked)
+ @param force_rle Force execution of RLE's algorithm even if % of compression <= 5%
+ @param block_size Size of each block
+ @returns Error status
+*/
+_modules_error stream_compress(FILE * fd_input, FILE * fd_output, bool force_rle, unsigned long block_size);
+
+/**
+\brief Decompresses a stream written by stream_compress block by block as it's read
+ @param fd_input Compressed stream
+ @param fd_output Stream where the decompressed content is written (never seeked)
+ @returns Error status
+*/
+_modules_error stream_decompress(FILE * fd_input, FILE * fd_output);
+
+#endif //MODULE_STREAM_H
@@ -11,202 +11,181 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdbool.h>
 
+#include "t.h"
+#include "utils/freqs.h"
+#include "utils/stats.h"
 #include "utils/errors.h"
 #include "utils/extensions.h"
 
-#define NUM_SYMBOLS 256
-#define MIN(a,b) ((a) < (b) ? a : b)
 
 /**
-\brief Reads the frequencies of each block provided by the .freq file 
- @param codes_input Buffer of the respective .freq file block
- @param frequencies Array to store the frequencies from each symbol
- @returns Error status
+\brief Symbol along with its frequency
+*/
+typedef struct {
+    unsigned long frequency;
+    int symbol;
+} SymbolFreq;
+
+/**
+\brief Compares two symbols for sorting: Descending frequency and, for the same frequency, ascending symbol
+ @param a First symbol
+ @param b Second symbol
+ @returns Negative if a comes first, positive otherwise
 */
-static _modules_error read_block(char * restrict codes_input, unsigned long * restrict frequencies) 
+static int compare_symbols (const void * a, const void * b)
 {
-    int read_count;
-    // Checks if there are any errors with the input file
-    if (sscanf(codes_input, "%lu%n;", frequencies, &read_count) != 1)
-        return _FILE_UNRECOGNIZABLE;
+    const SymbolFreq * sa = a, * sb = b;
 
-    codes_input += read_count + 1;
+    if (sa->frequency != sb->frequency)
+        return sa->frequency > sb->frequency ? -1 : 1;
 
-    // Loop to go through all symbols
-    for (int i = 1; i < NUM_SYMBOLS; ++i) {
-        
-        // Reads the frequency  
-        if (sscanf(codes_input, "%lu%n", &frequencies[i], &read_count) == 1) {
-            
-            // Checks for possible errors in .freq file
-            if (codes_input[read_count] != ';' && i != NUM_SYMBOLS - 1)
-                return _FILE_UNRECOGNIZABLE;
+    return sa->symbol - sb->symbol;
+}
 
-            codes_input += read_count + 1;
-        }  
+/**
+\brief Find the best division of any sequence of frequencies ordered between the element in the first position and the element in the last position
+ The left group grows while that brings both groups' sums closer together, which is found with a binary search over the prefix sums
+ @param prefix Prefix sums of the sorted frequencies (prefix[i] is the sum of the first i frequencies)
+ @param first First element of the array
+ @param last  Last element of the array
+ @returns Index of the last element of the left group
+*/
+static int best_division (const unsigned long prefix[], int first, int last)
+{
+    const unsigned long total = prefix[last + 1] - prefix[first];
+    unsigned long left, prev_left;
+    int low = first, high = last, middle;
 
-        // Checks if we are in one of the specific cases with equal frequencies
-        else if (*codes_input == ';' || (*codes_input == '\0' && i == NUM_SYMBOLS - 1)) {
-            frequencies[i] = frequencies[i-1];
-            ++codes_input;
-        }
+    // First element whose inclusion makes the left group at least as heavy as the right one
+    while (low < high) {
+        middle = (low + high) / 2;
 
-        // Checks for possible errors in .freq file
+        if (2 * (prefix[middle + 1] - prefix[first]) >= total)
+            high = middle;
         else
-            return _FILE_UNRECOGNIZABLE;
+            low = middle + 1;
     }
 
-    // Checks for possible errors in the buffer
-    if (codes_input[-1] != '\0')
-        return _FILE_UNRECOGNIZABLE;
-    
-    return _SUCCESS;
+    // It only belongs to the left group if it brings both groups closer than without it
+    left = prefix[low + 1] - prefix[first];
+    prev_left = prefix[low] - prefix[first];
+
+    if (low > first && 2 * left - total >= total - 2 * prev_left)
+        --low;
+
+    return low;
 }
 
 /**
-\brief Sort the frequencies array in descending order 
- @param frequencies The array to save the frequencies
- @param positions Array with the original index of each symbol
- @param left Inital index of the array 
- @param right Final index of the array
+\brief Apply the Shannon-Fano algorithm 
+ @param prefix Prefix sums of the sorted frequencies
+ @param codes Array to store the codes (by position in the sorted array)
+ @param start First element to aply the algorithm
+ @param end Last element to apply the algorithm
+ @param bits Bits of the code shared by every element between start and end
+ @param length Length of the code shared by every element between start and end
+ @returns Error status
 */
-static void insert_sort (unsigned long frequencies[], int positions[], int left, int right)
+static _modules_error sf_codes (const unsigned long prefix[], Code codes[], int start, int end, uint64_t bits, int length)
 {
-    unsigned long tmpFreq;
-    int j, a, iters;
+    _modules_error error;
+    int div;
 
-    for (int i = left + 1; i <= right; ++i){
+    if (start == end) {
+        codes[start] = (Code) { .bits = bits, .length = length };
+        return _SUCCESS;
+    }
 
-        tmpFreq = frequencies[i];
-        j = i - 1;
+    // Codes are packed in 64 bits
+    if (length == MAX_CODE_LENGTH)
+        return _CODE_TOO_LONG;
 
-        /* Move elements of frequencies[0..i-1], that are greater
-        than tmpFreq, to one position ahead of their current position
-        */
-        while (j >= left && frequencies[j] < tmpFreq){
-            frequencies[j+1] = frequencies[j];           
-            --j;
-        }
-        frequencies[j+1] = tmpFreq;
-        a = j + 1;        
-        iters = i - a;
-         /* Do the same thing to position so that the 
-        frequency value associated with each symbol isn't lost
-        */
-        for (int idx = i-1; iters; --idx)
-            if (positions[idx] >= a) {
-                ++positions[idx];
-                --iters;
-            }
-        positions[i] = a;       
-    }
-} 
+    div = best_division(prefix, start, end);
 
-/**
-\brief Calculates the sum of the positional frequencies from the first to the last position
- @param frequencies Array Frequencies 
- @param first First Element of the array
- @param last Last element of the array
- @returns Total sum of the frequencies 
-*/
-static unsigned long sum_freq (unsigned long frequencies[], int first, int last)
-{
-    unsigned long sum = 0;
+    error = sf_codes(prefix, codes, start, div, bits << 1, length + 1);
 
-    for (int i = first; i <= last; i++)
-        sum += frequencies[i];
+    if (!error)
+        error = sf_codes(prefix, codes, div + 1, end, (bits << 1) | 1, length + 1);
 
-    return sum;
+    return error;
 }
 
 /**
-\brief Find the best division of any sequence of frequencies ordered between the element in the first position and the element in the last position
- @param frequencies Array Frequencies 
- @param first First element of the array
- @param last  Last element of the array
- @returns Index of the best division
+\brief Calculates the Shannon-Fano codes of a block
+ @param block_frequencies Frequency of each of the 256 symbols
+ @param codes Array to store the code of each symbol (length 0 if it doesn't show up)
+ @returns Error status
 */
-static int best_Division (unsigned long frequencies[], int first, int last)
+static _modules_error sf_block_codes (const unsigned long * const block_frequencies, Code codes[NUM_SYMBOLS])
 {
-    
-    int division = first, total , mindif, dif;
-    unsigned long g1 = 0;
+    SymbolFreq sorted[NUM_SYMBOLS];
+    Code sorted_codes[NUM_SYMBOLS];
+    unsigned long prefix[NUM_SYMBOLS + 1];
+    int num_symbols = 0;
+    _modules_error error = _SUCCESS;
 
-    total = mindif = dif = sum_freq(frequencies, first, last);
+    // Symbols that don't show up don't get a code
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol)
+        if (block_frequencies[symbol])
+            sorted[num_symbols++] = (SymbolFreq) { .frequency = block_frequencies[symbol], .symbol = symbol };
 
-    while (dif == mindif){
+    qsort(sorted, num_symbols, sizeof(SymbolFreq), compare_symbols);
 
-        g1 = g1 + frequencies[division];
-        dif = abs(2 * g1 - total);
+    prefix[0] = 0;
+    for (int i = 0; i < num_symbols; ++i)
+        prefix[i + 1] = prefix[i] + sorted[i].frequency;
 
-            if (dif < mindif){
-                division = division + 1;
-                mindif = dif;
-            }
-            else
-                dif = mindif + 1;
-    }
+    // A block with a single symbol still needs a 1 bit code, otherwise it couldn't be decoded
+    if (num_symbols == 1)
+        sorted_codes[0] = (Code) { .bits = 0, .length = 1 };
+    else if (num_symbols)
+        error = sf_codes(prefix, sorted_codes, 0, num_symbols - 1, 0, 0);
 
-    return division - 1;
-}
+    if (!error) {
+        memset(codes, 0, NUM_SYMBOLS * sizeof(Code));
 
-/**
-\brief Add character representing a bit 0 or 1 to the code according to the Shannon-Fano algorithm 
- @param value bit to be added to code (0 or 1)
- @param codes Place to store the codes
- @param start First Element
- @param end Last Element 
-*/
-static void add_bit_to_code(char value, char codes[NUM_SYMBOLS][NUM_SYMBOLS], int start, int end)
-{
-    char * symbol_codes;
-    /*For symbol_codes, start the pointer on the first element, 
-    going through the array until the end */
-    for ( ; start <= end; ++start) {
-        symbol_codes = codes[start];
-
-        // While the pointer is moved it adds value 1 or 0.
-        for ( ; *symbol_codes; ++symbol_codes);
-        *symbol_codes = value;
+        for (int i = 0; i < num_symbols; ++i)
+            codes[sorted[i].symbol] = sorted_codes[i];
     }
+
+    return error;
 }
 
-/**
-\brief Apply the Shannon-Fano algorithm 
- @param frequencies Array with frequencies
- @param codes Array to store the codes 
- @param start First element to aply the algorithm
- @param end Last element to apply the algorithm
-*/
-static void sf_codes (unsigned long frequencies[], char codes[NUM_SYMBOLS][NUM_SYMBOLS], int start, int end)
+_modules_error make_block_codes(const unsigned long * const block_frequencies, char * block_codes)
 {
-    //While the pointer at the beginning is not the same as at the end it applies the algorithm
-    if (start != end){
-               
-        int div = best_Division(frequencies, start, end);
-     
-        add_bit_to_code('0', codes, start, div);
-        add_bit_to_code('1', codes, div + 1, end);
-
-        sf_codes(frequencies, codes, start, div);
-        sf_codes(frequencies, codes, div + 1, end);
+    Code codes[NUM_SYMBOLS];
+    _modules_error error;
+
+    error = sf_block_codes(block_frequencies, codes);
+
+    if (error)
+        return error;
+
+    // Joins every symbol's code separated by ';' (the last one is followed by the NULL terminator instead)
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol) {
+        for (int bit = codes[symbol].length - 1; bit >= 0; --bit)
+            *block_codes++ = '0' + ((codes[symbol].bits >> bit) & 1);
+        *block_codes++ = ';';
     }
+    block_codes[-1] = '\0';
+
+    return _SUCCESS;
 }
 
-/**
-\brief Counts how many symbols have frequencies different from 0 
- @param frequencies Array of the frequencies sorted in descending order
- @returns Number of non-null elements in the array
-*/
-static int not_null (unsigned long frequencies[NUM_SYMBOLS])
+_modules_error make_block_lengths(const unsigned long * const block_frequencies, uint8_t block_lengths[NUM_SYMBOLS])
 {
-    int r = 0;
+    Code codes[NUM_SYMBOLS];
+    _modules_error error;
 
-     // Parses the array from the end to the beginning until it finds the first non-null element incrementing r by 1 each interation
-    for (int i = NUM_SYMBOLS - 1; frequencies[i] == 0; --i) ++r;
+    error = sf_block_codes(block_frequencies, codes);
 
-    return (NUM_SYMBOLS - 1 - r);
+    if (!error)
+        for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol)
+            block_lengths[symbol] = codes[symbol].length;
+
+    return error;
 }
 
 /**
@@ -228,12 +207,17 @@ static inline void print_summary(unsigned long long num_blocks, const unsigned l
             "Size of blocks analyzed in the symbol file: " ,
             num_blocks 
     );
-    // Prints the sizes of each block, except the last 
-    for (i = 0; i < num_blocks - 1; ++i) {
-        printf("%lu/", sizes[i]);
+    // The quiet summary leaves out the size of each block
+    if (STATS == STATS_QUIET)
+        printf("(...)\n");
+    else {
+        // Prints the sizes of each block, except the last 
+        for (i = 0; i < num_blocks - 1; ++i) {
+            printf("%lu/", sizes[i]);
+        }
+        // Prints the size of the last block
+        printf("%lu bytes\n", sizes[i]);
     }
-    // Prints the size of the last block
-    printf("%lu bytes\n", sizes[i]);
 
     printf(
             "Module runtime (milliseconds): %f\n"
@@ -243,22 +227,20 @@ static inline void print_summary(unsigned long long num_blocks, const unsigned l
 }
 
 
-_modules_error get_shafa_codes(const char * path)
+_modules_error get_shafa_codes(const char * path, const bool canonical)
 {
     clock_t t;
     FILE * fd_freq, * fd_codes;
     char * path_freq;
     char * path_codes;
-    char * block_input;
     char mode;
+    bool binary_freq;
     unsigned long long num_blocks = 0;
-    unsigned long block_size = 0;
-    int freq_notnull, iter;
+    unsigned long block_size = 0, original_size;
     int error = _SUCCESS;
-    int positions[NUM_SYMBOLS];
     unsigned long frequencies[NUM_SYMBOLS], * sizes = NULL ;
     double total_time;
-    char (* codes)[NUM_SYMBOLS];
+    BlockCodes block_codes;
 
     t = clock();
     
@@ -275,7 +257,7 @@ _modules_error get_shafa_codes(const char * path)
         if (fd_freq) {
 
              // Reading the header of .freq file
-            if (fscanf(fd_freq, "@%c@%lu", &mode, &num_blocks) == 2) {   
+            if (!read_freq_header(fd_freq, &mode, &num_blocks, &binary_freq)) {
 
                 // Checks if it haves a possible mode (R - RLE or N - Normal)
                 if (mode == 'R' || mode == 'N') {
@@ -299,88 +281,38 @@ _modules_error get_shafa_codes(const char * path)
                             if (fd_codes) {
                                 
                                 // Prints header in the .cod file and checks if it only prints the proper elements
-                                if (fprintf(fd_codes, "@%c@%lu", mode, num_blocks) >= 3) {                               
+                                if (!write_codes_header(fd_codes, mode, num_blocks, canonical)) {
                                     
                                     // Loop to analyze every block in .freq file
-                                    for (long long i = 0; i < num_blocks && !error; ++i) {
+                                    for (unsigned long long i = 0; i < num_blocks && !error; ++i) {
 
-                                        // Memory allocation to save the generated codes
-                                        codes = calloc(1, sizeof(char[NUM_SYMBOLS][NUM_SYMBOLS]));
+                                        // Memory allocation to save the generated codes (canonical codes only need their lengths)
+                                        block_codes.text = canonical ? NULL : malloc(BLOCK_CODES_SIZE);
                                         
                                         // Checks if it was possible to allocate the required memory
-                                        if (codes) {
+                                        if (canonical || block_codes.text) {
                                             
-                                            // Initializes the array to keep the frequencies with 0's
-                                            memset(frequencies, 0, NUM_SYMBOLS * 4);
-
-                                            // Initializes the array to keep the original index of each symbol
-                                            for (int j = 0; j < NUM_SYMBOLS; ++j) positions[j] = j;
+                                            // Reads the current block size along with its frequencies
+                                            error = read_block_freq(fd_freq, binary_freq, &block_size, &original_size, frequencies);
 
-                                            // Reads the current block size and verifies possible file stream errors
-                                            if (fscanf(fd_freq, "@%lu", &block_size) == 1) {
+                                            if (!error) {
 
                                                 // Saves the size of the block in the array to that purpose
                                                 sizes[i] = block_size;
-                                    
-                                                // Allocates memory to keep the frequencies read, so it's possible to the lecture in only 1 access
-                                                block_input = malloc(9 * NUM_SYMBOLS + (NUM_SYMBOLS - 1) + 1); // 9 (max digits for frequency) + 256 (symbols) + 255 (';') + 1 (NULL terminator)
-
-                                                // Checks if it was possible to allocate the required memory
-                                                if (block_input) {
-                                                    
-                                                    // Reads the frequencies and verifies the read
-                                                    if (fscanf(fd_freq, "@%2559[^@]", block_input) == 1) {
-                                            
-                                                        // Calls read_block function
-                                                        error = read_block(block_input, frequencies);
-                                                       
-                                                       // Checks for possible errors in read_block function
-                                                        if (!error) {
-                                                            
-                                                            // Calls insert_sort function
-                                                            insert_sort(frequencies, positions, 0, NUM_SYMBOLS - 1);
-
-                                                            // Saves in freq_notnull the number of non-null elements in the array
-                                                            freq_notnull = not_null(frequencies);
-
-                                                            // Calls sf_codes to generate the Shannon-Fano codes
-                                                            sf_codes(frequencies, codes, 0, freq_notnull);
-
-                                                            // Prints in the .cod file the block size
-                                                            if (fprintf(fd_codes, "@%lu@", block_size) >= 2) {
-
-                                                                // Loop to print the codes till the last one in .cod file and checks for possible file stream errors
-                                                                for (iter = 0; iter < NUM_SYMBOLS - 1 && !error; ++iter) {
-                                                                    
-                                                                    if (fprintf(fd_codes, "%s;", codes[positions[iter]]) < 1)
-                                                                        error = _FILE_STREAM_FAILED;
-                                                                }
-
-                                                                // Prints last code in the file and checks for possible file stream errors
-                                                                if (!error && fprintf(fd_codes, "%s", codes[positions[iter]]) < 0) 
-                                                                    error = _FILE_STREAM_FAILED;
-                                                                    
-                                                            }
-                                                            else 
-                                                                error = _FILE_STREAM_FAILED;
-                                                             
-                                                        }
-
-                                                    }
-                                                    else 
-                                                        error = _FILE_STREAM_FAILED;
-                                                    
-                                                    // Free allocated memory to block_input
-                                                    free(block_input);
-                                                }
+
+                                                // Generates the Shannon-Fano codes of the block
+                                                if (canonical)
+                                                    error = make_block_lengths(frequencies, block_codes.lengths);
                                                 else
-                                                    error = _LACK_OF_MEMORY;
+                                                    error = make_block_codes(frequencies, block_codes.text);
+
+                                                // Prints in the .cod file the block size followed by its codes
+                                                if (!error)
+                                                    error = write_block_codes(fd_codes, block_size, original_size, &block_codes);
                                             }
-                                            else 
-                                                error = _FILE_STREAM_FAILED;
                                             
                                             // Free allocated memory to codes
-                                            free(codes);
+                                            free(block_codes.text);
                                         }
                                         else
                                             error = _LACK_OF_MEMORY;
@@ -393,7 +325,7 @@ _modules_error get_shafa_codes(const char * path)
                                     it should write "@0" in the .cod file to indicate 
                                     that there are no more blocks*/
                                 if (!error)
-                                    fprintf(fd_codes, "@0");
+                                    error = write_codes_trailer(fd_codes, canonical);
                                 
                                 // Closes output file
                                 fclose(fd_codes);
@@ -434,8 +366,11 @@ _modules_error get_shafa_codes(const char * path)
         t = clock() - t;
         total_time = (((double) t) / CLOCKS_PER_SEC) * 1000;
 
-        // Calls print_summary function
-        print_summary(num_blocks, sizes, total_time, path_codes);
+        // Calls print_summary function (module T doesn't queue any task, so its statistics only have its runtime)
+        if (STATS == STATS_JSON)
+            stats_print(stdout, "T", total_time);
+        else
+            print_summary(num_blocks, sizes, total_time, path_codes);
     }              
 
     // Free allocated memory to sizes
@@ -1,13 +1,34 @@
 #ifndef MODULE_T_H
 #define MODULE_T_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utils/codes.h"
 #include "utils/errors.h"
 
 /**
 \brief Creates a table of Shanon Fano's codes and saves it to disk
  @param path Original/RLE file's path
+ @param canonical Only save the lengths of the codes (canonical codes) instead of the codes themselves
+ @returns Error status
+*/
+_modules_error get_shafa_codes(const char * path, bool canonical);
+
+/**
+\brief Generates the Shannon Fano's codes of a block in the same textual representation used by the .cod file
+ @param block_frequencies Frequency of each of the 256 symbols
+ @param block_codes Buffer with at least BLOCK_CODES_SIZE bytes where the codes separated by ';' will be written
+ @returns Error status
+*/
+_modules_error make_block_codes(const unsigned long * block_frequencies, char * block_codes);
+
+/**
+\brief Generates the lengths of the Shannon Fano's codes of a block, which are enough to rebuild them as canonical codes
+ @param block_frequencies Frequency of each of the 256 symbols
+ @param block_lengths Array to save the length of each symbol's code (0 if it doesn't show up)
  @returns Error status
 */
-_modules_error get_shafa_codes(const char * path);
+_modules_error make_block_lengths(const unsigned long * block_frequencies, uint8_t block_lengths[NUM_SYMBOLS]);
 
-#endif //MODULE_T_H
\ No newline at end of file
+#endif //MODULE_T_H
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "binary.h"
+
+
+void store_le64(uint8_t * const buffer, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i, value >>= 8)
+        buffer[i] = (uint8_t) value;
+}
+
+
+uint64_t load_le64(const uint8_t * const buffer)
+{
+    uint64_t value = 0;
+
+    for (int i = 7; i >= 0; --i)
+        value = (value << 8) | buffer[i];
+
+    return value;
+}
+
+
+void store_le32(uint8_t * const buffer, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i, value >>= 8)
+        buffer[i] = (uint8_t) value;
+}
+
+
+uint32_t load_le32(const uint8_t * const buffer)
+{
+    return (uint32_t) buffer[0] | (uint32_t) buffer[1] << 8 | (uint32_t) buffer[2] << 16 | (uint32_t) buffer[3] << 24;
+}
+
+
+bool write_le64(FILE * const fd, const uint64_t value)
+{
+    uint8_t buffer[8];
+
+    store_le64(buffer, value);
+
+    return fwrite(buffer, sizeof(uint8_t), 8, fd) == 8;
+}
+
+
+bool read_le64(FILE * const fd, uint64_t * const value)
+{
+    uint8_t buffer[8];
+
+    if (fread(buffer, sizeof(uint8_t), 8, fd) != 8)
+        return false;
+
+    *value = load_le64(buffer);
+
+    return true;
+}
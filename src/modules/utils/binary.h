@@ -0,0 +1,56 @@
+#ifndef UTILS_BINARY_H
+#define UTILS_BINARY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Binary formats store every integer in little endian regardless of the machine
+*/
+
+/**
+\brief Stores an integer in little endian
+ @param buffer Buffer with at least 8 bytes
+ @param value Integer to be stored
+*/
+void store_le64(uint8_t * buffer, uint64_t value);
+
+/**
+\brief Loads an integer stored in little endian
+ @param buffer Buffer with at least 8 bytes
+ @returns Integer loaded
+*/
+uint64_t load_le64(const uint8_t * buffer);
+
+/**
+\brief Stores a 32 bits integer in little endian
+ @param buffer Buffer with at least 4 bytes
+ @param value Integer to be stored
+*/
+void store_le32(uint8_t * buffer, uint32_t value);
+
+/**
+\brief Loads a 32 bits integer stored in little endian
+ @param buffer Buffer with at least 4 bytes
+ @returns Integer loaded
+*/
+uint32_t load_le32(const uint8_t * buffer);
+
+/**
+\brief Writes an integer in little endian to a file
+ @param fd File's handle
+ @param value Integer to be written
+ @returns Success
+*/
+bool write_le64(FILE * fd, uint64_t value);
+
+/**
+\brief Reads an integer in little endian from a file
+ @param fd File's handle
+ @param value Pointer to the integer to be read
+ @returns Success
+*/
+bool read_le64(FILE * fd, uint64_t * value);
+
+#endif //UTILS_BINARY_H
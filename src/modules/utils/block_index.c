@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "binary.h"
+#include "errors.h"
+#include "output.h"
+#include "block_index.h"
+
+
+_modules_error write_block_index(FILE * const fd_shafa, const unsigned long long shafa_start, const unsigned long long num_blocks, const unsigned long * const compressed_sizes, const unsigned long * const original_sizes, const BlockSync * const sync)
+{
+    unsigned long size = INDEX_HEADER_SIZE + num_blocks * INDEX_ENTRY_SIZE + INDEX_TRAILER_SIZE;
+    unsigned long long offset = shafa_start;
+    uint8_t * index, * entry;
+    _modules_error error;
+
+    if (sync)
+        for (unsigned long long i = 0; i < num_blocks; ++i)
+            size += 8 + sync[i].num_points * INDEX_SYNC_POINT_SIZE;
+
+    index = malloc(size);
+
+    if (!index)
+        return _LACK_OF_MEMORY;
+
+    memcpy(index, INDEX_MAGIC, 4);
+    index[4] = sync ? INDEX_SYNC_VERSION : INDEX_VERSION;
+    store_le64(index + 5, num_blocks);
+
+    // Each block is "@size@" followed by its codification
+    entry = index + INDEX_HEADER_SIZE;
+    for (unsigned long long i = 0; i < num_blocks; ++i, entry += INDEX_ENTRY_SIZE) {
+        offset += snprintf(NULL, 0, "@%lu@", compressed_sizes[i]);
+
+        store_le64(entry, offset);
+        store_le64(entry + 8, compressed_sizes[i]);
+        store_le64(entry + 16, original_sizes[i]);
+
+        offset += compressed_sizes[i];
+    }
+
+    // The sync points of every block go after the entries, so the entries are the same as in version 1
+    for (unsigned long long i = 0; sync && i < num_blocks; ++i) {
+        store_le64(entry, sync[i].num_points);
+        entry += 8;
+
+        for (unsigned long point = 0; point < sync[i].num_points; ++point, entry += INDEX_SYNC_POINT_SIZE) {
+            store_le64(entry, sync[i].points[point].symbol);
+            store_le64(entry + 8, sync[i].points[point].bit);
+        }
+    }
+
+    // The trailer points back to the header so the index is found from the end of the file
+    store_le64(entry, offset);
+    memcpy(entry + 8, INDEX_MAGIC, 4);
+
+    error = output_write(fd_shafa, offset, index, size);
+    free(index);
+
+    return error;
+}
+
+/**
+\brief Counts the sync points after the entries of an index of version 2 (their number must fill the rest of the index)
+ @param sync Sync points of every block as stored in the index
+ @param size Size of the sync points of every block
+ @param num_blocks Number of blocks
+ @param num_points Pointer to load the number of sync points
+ @returns Whether the sync points fill the rest of the index
+*/
+static bool count_sync_points(const uint8_t * sync, unsigned long long size, const unsigned long long num_blocks, unsigned long long * const num_points)
+{
+    unsigned long long points;
+
+    *num_points = 0;
+
+    for (unsigned long long i = 0; i < num_blocks; ++i) {
+        if (size < 8)
+            return false;
+
+        points = load_le64(sync);
+
+        if (points > (size - 8) / INDEX_SYNC_POINT_SIZE)
+            return false;
+
+        *num_points += points;
+        sync += 8 + points * INDEX_SYNC_POINT_SIZE;
+        size -= 8 + points * INDEX_SYNC_POINT_SIZE;
+    }
+
+    return !size;
+}
+
+/**
+\brief Loads the sync points of each block of an index of version 2 (they were counted by count_sync_points)
+ @param sync Sync points of every block as stored in the index
+ @param entries Entry of each block
+ @param num_blocks Number of blocks
+ @param points Array to load the sync points of every block
+ @returns Whether every sync point is inside its block and after the previous one
+*/
+static bool load_sync_points(const uint8_t * sync, IndexEntry * const entries, const unsigned long long num_blocks, SyncPoint * points)
+{
+    SyncPoint point, previous;
+
+    for (unsigned long long i = 0; i < num_blocks; ++i) {
+        entries[i].sync = (BlockSync) { .num_points = load_le64(sync), .points = NULL };
+        sync += 8;
+
+        // Blocks without sync points don't point into the array
+        if (entries[i].sync.num_points)
+            entries[i].sync.points = points;
+
+        previous = (SyncPoint) { .symbol = 0, .bit = 0 };
+
+        for (unsigned long j = 0; j < entries[i].sync.num_points; ++j, sync += INDEX_SYNC_POINT_SIZE, previous = point) {
+            point = (SyncPoint) { .symbol = load_le64(sync), .bit = load_le64(sync + 8) };
+
+            if (point.symbol <= previous.symbol || point.bit <= previous.bit || point.bit >= entries[i].compressed_size * 8)
+                return false;
+
+            *points++ = point;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+\brief Loads the block index from the end of the .shaf file (leaving the file at any position)
+ @param fd_shafa SHAFA file's handle
+ @param num_blocks Pointer to load the number of blocks
+ @param entries Address to load an allocated array with the entry of each block (along with their sync points)
+ @returns Error status (_FILE_UNRECOGNIZABLE if the file has no index)
+*/
+static _modules_error load_block_index(FILE * const fd_shafa, unsigned long long * const num_blocks, IndexEntry ** const entries)
+{
+    uint8_t trailer[INDEX_TRAILER_SIZE], header[INDEX_HEADER_SIZE], * index;
+    unsigned long long index_start, index_size, length, num_points = 0;
+    long file_size;
+    IndexEntry * new_entries;
+    bool valid;
+    _modules_error error = _FILE_UNRECOGNIZABLE;
+
+    if (fseek(fd_shafa, 0, SEEK_END) || (file_size = ftell(fd_shafa)) < INDEX_HEADER_SIZE + INDEX_TRAILER_SIZE)
+        return _FILE_UNRECOGNIZABLE;
+
+    if (fseek(fd_shafa, file_size - INDEX_TRAILER_SIZE, SEEK_SET) || fread(trailer, sizeof(uint8_t), INDEX_TRAILER_SIZE, fd_shafa) != INDEX_TRAILER_SIZE)
+        return _FILE_STREAM_FAILED;
+
+    index_start = load_le64(trailer);
+
+    if (!memcmp(trailer + 8, INDEX_MAGIC, 4) && index_start <= (unsigned long long) file_size - INDEX_HEADER_SIZE - INDEX_TRAILER_SIZE) {
+
+        if (!fseek(fd_shafa, index_start, SEEK_SET) && fread(header, sizeof(uint8_t), INDEX_HEADER_SIZE, fd_shafa) == INDEX_HEADER_SIZE) {
+
+            length = load_le64(header + 5);
+            index_size = file_size - index_start - INDEX_HEADER_SIZE - INDEX_TRAILER_SIZE;
+
+            // The entries (and the sync points of version 2) must fill the space between the header and the trailer (an index is never written without blocks)
+            if (!memcmp(header, INDEX_MAGIC, 4) && (header[4] == INDEX_VERSION || header[4] == INDEX_SYNC_VERSION) && length && length <= index_size / INDEX_ENTRY_SIZE
+                && (header[4] == INDEX_SYNC_VERSION || index_size == length * INDEX_ENTRY_SIZE)) {
+
+                index = malloc(index_size);
+
+                if (index) {
+
+                    if (fread(index, sizeof(uint8_t), index_size, fd_shafa) == index_size) {
+
+                        valid = header[4] == INDEX_VERSION || count_sync_points(index + length * INDEX_ENTRY_SIZE, index_size - length * INDEX_ENTRY_SIZE, length, &num_points);
+
+                        // The sync points go right after the entries
+                        new_entries = valid ? malloc(length * sizeof(IndexEntry) + num_points * sizeof(SyncPoint)) : NULL;
+
+                        if (new_entries) {
+
+                            error = _SUCCESS;
+
+                            for (unsigned long long i = 0; i < length && !error; ++i) {
+                                new_entries[i] = (IndexEntry) {
+                                    .offset = load_le64(index + i * INDEX_ENTRY_SIZE),
+                                    .compressed_size = load_le64(index + i * INDEX_ENTRY_SIZE + 8),
+                                    .original_size = load_le64(index + i * INDEX_ENTRY_SIZE + 16),
+                                    .sync = { .num_points = 0, .points = NULL }
+                                };
+
+                                // Every block must lie before the index
+                                if (new_entries[i].offset > index_start || new_entries[i].compressed_size > index_start - new_entries[i].offset)
+                                    error = _FILE_UNRECOGNIZABLE;
+                            }
+
+                            if (!error && header[4] == INDEX_SYNC_VERSION && !load_sync_points(index + length * INDEX_ENTRY_SIZE, new_entries, length, (SyncPoint *) (new_entries + length)))
+                                error = _FILE_UNRECOGNIZABLE;
+
+                            if (!error) {
+                                *num_blocks = length;
+                                *entries = new_entries;
+                            }
+                            else
+                                free(new_entries);
+                        }
+                        else if (valid)
+                            error = _LACK_OF_MEMORY;
+                    }
+                    else
+                        error = _FILE_STREAM_FAILED;
+
+                    free(index);
+                }
+                else
+                    error = _LACK_OF_MEMORY;
+            }
+        }
+        else
+            error = _FILE_STREAM_FAILED;
+    }
+
+    return error;
+}
+
+
+_modules_error read_block_index(FILE * const fd_shafa, unsigned long long * const num_blocks, IndexEntry ** const entries)
+{
+    const long position = ftell(fd_shafa);
+    _modules_error error;
+
+    if (position < 0)
+        return _FILE_STREAM_FAILED;
+
+    error = load_block_index(fd_shafa, num_blocks, entries);
+
+    // The blocks are read from where the file was left
+    if (fseek(fd_shafa, position, SEEK_SET) && !error) {
+        free(*entries);
+        error = _FILE_STREAM_FAILED;
+    }
+
+    return error;
+}
+
+
+_modules_error find_range_blocks(const IndexEntry * const index, const unsigned long long length, const ByteRange * const range, unsigned long long * const first_block, unsigned long long * const num_blocks, unsigned long * const slice_start)
+{
+    const unsigned long long range_end = range->start + range->size;
+    unsigned long long block_start = 0, block_end;
+
+    *first_block = *num_blocks = 0;
+    *slice_start = 0;
+
+    for (unsigned long long i = 0; i < length && block_start < range_end; ++i, block_start = block_end) {
+        block_end = block_start + index[i].original_size;
+
+        if (block_end > range->start) {
+            if (!*num_blocks) {
+                *first_block = i;
+                *slice_start = range->start - block_start;
+            }
+            ++*num_blocks;
+        }
+    }
+
+    // A range past the end of the file would have nothing to save (one running past it is cut at the end of the file)
+    return *num_blocks ? _SUCCESS : _RANGE_OUT_OF_FILE;
+}
@@ -0,0 +1,92 @@
+#ifndef UTILS_BLOCK_INDEX_H
+#define UTILS_BLOCK_INDEX_H
+
+#include <stdio.h>
+
+#include "errors.h"
+
+/*
+    Block index (optional footer of the .shaf file, after its last block), so any block can be found without reading the ones before it:
+        "SIDX" | version (1 byte) | number of blocks (8 bytes)
+        Each block: position of its codification in the .shaf file (8 bytes) | size of its codification (8 bytes) | size once decompressed (8 bytes)
+        Only version 2, each block: number of sync points (8 bytes) | each sync point: symbol (8 bytes) | bit of the codification (8 bytes)
+        Position of the index in the .shaf file (8 bytes) | "SIDX"
+    Readers which don't know about it stop after the last block, so they just ignore it
+*/
+#define INDEX_MAGIC "SIDX"
+#define INDEX_VERSION 1
+#define INDEX_SYNC_VERSION 2 // Also has the sync points of the blocks
+#define INDEX_HEADER_SIZE 13
+#define INDEX_ENTRY_SIZE 24
+#define INDEX_SYNC_POINT_SIZE 16
+#define INDEX_TRAILER_SIZE 12
+
+/**
+\brief Range of bytes of a decompressed file
+*/
+typedef struct {
+    unsigned long long start;
+    unsigned long long size;
+} ByteRange;
+
+/**
+\brief Point of a block where the decoding can start: the symbol at `symbol` starts at `bit` of its codification
+*/
+typedef struct {
+    unsigned long long symbol;
+    unsigned long long bit;
+} SyncPoint;
+
+/**
+\brief Sync points of a block (in increasing order, the start of the block isn't one)
+*/
+typedef struct {
+    unsigned long num_points;
+    SyncPoint * points;
+} BlockSync;
+
+/**
+\brief Entry of the block index
+*/
+typedef struct {
+    unsigned long long offset;
+    unsigned long long compressed_size;
+    unsigned long long original_size;
+    BlockSync sync; // No sync points unless the index is of version 2 (they're in the allocation of the entries)
+} IndexEntry;
+
+/**
+\brief Writes the block index after the last block of the .shaf file (the blocks are "@size@" followed by their codification)
+ Warning: Anything written before through `fd_shafa` must have been flushed
+ @param fd_shafa SHAFA file's handle
+ @param shafa_start Position of the first block in the SHAFA file
+ @param num_blocks Number of blocks
+ @param compressed_sizes Size of each block's codification
+ @param original_sizes Size of each block once decompressed
+ @param sync Sync points of each block (NULL for an index without them, i.e. of version 1)
+ @returns Error status
+*/
+_modules_error write_block_index(FILE * fd_shafa, unsigned long long shafa_start, unsigned long long num_blocks, const unsigned long * compressed_sizes, const unsigned long * original_sizes, const BlockSync * sync);
+
+/**
+\brief Reads the block index of the .shaf file (the position of the file is restored afterwards)
+ @param fd_shafa SHAFA file's handle
+ @param num_blocks Pointer to load the number of blocks
+ @param entries Address to load an allocated array with the entry of each block (along with their sync points)
+ @returns Error status (_FILE_UNRECOGNIZABLE if the file has no index)
+*/
+_modules_error read_block_index(FILE * fd_shafa, unsigned long long * num_blocks, IndexEntry ** entries);
+
+/**
+\brief Finds the blocks overlapping a range of the decompressed file through the block index
+ @param index Entry of each block
+ @param length Number of blocks
+ @param range Range of the decompressed file
+ @param first_block Pointer to load the first block overlapping the range
+ @param num_blocks Pointer to load the number of blocks overlapping the range
+ @param slice_start Pointer to load the position of the range in the first block
+ @returns Error status (_RANGE_OUT_OF_FILE if the range starts at or past the end of the decompressed file)
+*/
+_modules_error find_range_blocks(const IndexEntry * index, unsigned long long length, const ByteRange * range, unsigned long long * first_block, unsigned long long * num_blocks, unsigned long * slice_start);
+
+#endif //UTILS_BLOCK_INDEX_H
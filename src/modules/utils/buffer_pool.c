@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "buffer_pool.h"
+#include "multithread.h"
+
+#ifdef POSIX_THREADS
+#include <pthread.h>
+
+#elif defined(WIN_THREADS)
+#include <windows.h>
+
+#endif
+
+/*
+    Locks of each platform under the same names (nothing to lock without threads)
+*/
+#ifdef POSIX_THREADS
+typedef pthread_mutex_t Lock;
+
+#define LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#define lock(l) pthread_mutex_lock(l)
+#define unlock(l) pthread_mutex_unlock(l)
+
+#elif defined(WIN_THREADS)
+typedef SRWLOCK Lock;
+
+#define LOCK_INIT SRWLOCK_INIT
+#define lock(l) AcquireSRWLockExclusive(l)
+#define unlock(l) ReleaseSRWLockExclusive(l)
+
+#else
+typedef char Lock;
+
+#define LOCK_INIT 0
+#define lock(l) ((void) (l))
+#define unlock(l) ((void) (l))
+
+#endif
+
+/**
+\brief Released buffers of a thread
+*/
+typedef struct FreeList {
+    Lock lock; // Held by its thread to take a buffer and by any thread giving one back
+    void * buffers[BUFFER_POOL_SLOTS];
+    unsigned int num_buffers;
+    struct FreeList * next; // Lists of every thread, to be trimmed and cleared
+} FreeList;
+
+/**
+\brief Kept right before each buffer
+*/
+typedef struct {
+    void * allocation; // Pointer given by malloc
+    FreeList * owner; // List of the thread which allocated it (NULL -> it's freed on release)
+    size_t capacity;
+} BufferHeader;
+
+static FreeList * LISTS = NULL;
+static Lock LISTS_LOCK = LOCK_INIT;
+
+// Capacity of every buffer kept by the lists (it's only changed with the lock of a list held)
+static atomic_ullong RETAINED_BYTES = 0;
+
+#ifdef _MSC_VER
+static __declspec(thread) FreeList * OWN_LIST;
+#else
+static _Thread_local FreeList * OWN_LIST;
+#endif
+
+static inline BufferHeader * header_of(void * const buffer)
+{
+    return (BufferHeader *) buffer - 1;
+}
+
+/**
+\brief Gets the list of the calling thread, creating it on its first call
+ @returns List (NULL on lack of memory, so its buffers aren't kept)
+*/
+static FreeList * own_list()
+{
+    if (!OWN_LIST && (OWN_LIST = malloc(sizeof(FreeList)))) {
+        *OWN_LIST = (FreeList) { .lock = LOCK_INIT, .num_buffers = 0 };
+
+        lock(&LISTS_LOCK);
+        OWN_LIST->next = LISTS;
+        LISTS = OWN_LIST;
+        unlock(&LISTS_LOCK);
+    }
+
+    return OWN_LIST;
+}
+
+/**
+\brief Allocates a buffer aligned to BUFFER_ALIGNMENT with its header right before it
+ @param capacity Size of the buffer
+ @param owner List the buffer goes back to
+ @returns Buffer (NULL on lack of memory)
+*/
+static void * allocate_buffer(const size_t capacity, FreeList * const owner)
+{
+    uint8_t * const allocation = malloc(sizeof(BufferHeader) + BUFFER_ALIGNMENT - 1 + capacity);
+    uint8_t * buffer;
+
+    if (!allocation)
+        return NULL;
+
+    // The first aligned position with room for the header before it
+    buffer = allocation + sizeof(BufferHeader);
+    buffer += -(uintptr_t) buffer & (BUFFER_ALIGNMENT - 1);
+
+    *header_of(buffer) = (BufferHeader) { .allocation = allocation, .owner = owner, .capacity = capacity };
+
+    return buffer;
+}
+
+
+void * buffer_pool_acquire(const size_t size)
+{
+    FreeList * const list = own_list();
+    void * buffer = NULL;
+    unsigned int best = BUFFER_POOL_SLOTS;
+    size_t capacity, granularity;
+
+    if (list) {
+        lock(&list->lock);
+
+        // The smallest buffer that fits, as long as the block takes at least half of it (so a small block doesn't hold on to a large buffer)
+        for (unsigned int i = 0; i < list->num_buffers; ++i) {
+            capacity = header_of(list->buffers[i])->capacity;
+
+            if (capacity >= size && capacity / 2 <= size && (best == BUFFER_POOL_SLOTS || capacity < header_of(list->buffers[best])->capacity))
+                best = i;
+        }
+
+        if (best != BUFFER_POOL_SLOTS) {
+            buffer = list->buffers[best];
+            list->buffers[best] = list->buffers[--list->num_buffers];
+            atomic_fetch_sub(&RETAINED_BYTES, header_of(buffer)->capacity);
+        }
+
+        unlock(&list->lock);
+    }
+
+    // Small buffers aren't rounded up as much as the blocks
+    granularity = size < BUFFER_GRANULARITY ? BUFFER_ALIGNMENT : BUFFER_GRANULARITY;
+
+    if (!buffer && size <= SIZE_MAX - BUFFER_GRANULARITY - sizeof(BufferHeader) - BUFFER_ALIGNMENT)
+        buffer = allocate_buffer((size + granularity - 1) / granularity * granularity, list);
+
+    return buffer;
+}
+
+
+void buffer_pool_release(void * buffer)
+{
+    FreeList * owner;
+
+    if (!buffer)
+        return;
+
+    owner = header_of(buffer)->owner;
+
+    if (owner) {
+        lock(&owner->lock);
+
+        if (owner->num_buffers < BUFFER_POOL_SLOTS) {
+            owner->buffers[owner->num_buffers++] = buffer;
+            atomic_fetch_add(&RETAINED_BYTES, header_of(buffer)->capacity);
+            buffer = NULL;
+        }
+
+        unlock(&owner->lock);
+    }
+
+    if (buffer)
+        free(header_of(buffer)->allocation);
+}
+
+
+void buffer_pool_trim(const unsigned long long bytes)
+{
+    void * buffer;
+
+    if (atomic_load(&RETAINED_BYTES) <= bytes)
+        return;
+
+    lock(&LISTS_LOCK);
+
+    for (FreeList * list = LISTS; list && atomic_load(&RETAINED_BYTES) > bytes; list = list->next) {
+        lock(&list->lock);
+
+        while (list->num_buffers && atomic_load(&RETAINED_BYTES) > bytes) {
+            buffer = list->buffers[--list->num_buffers];
+            atomic_fetch_sub(&RETAINED_BYTES, header_of(buffer)->capacity);
+            free(header_of(buffer)->allocation);
+        }
+
+        unlock(&list->lock);
+    }
+
+    unlock(&LISTS_LOCK);
+}
+
+
+void buffer_pool_clear()
+{
+    buffer_pool_trim(0);
+}
@@ -0,0 +1,42 @@
+#ifndef UTILS_BUFFER_POOL_H
+#define UTILS_BUFFER_POOL_H
+
+#include <stddef.h>
+
+/*
+    Buffers of the blocks (input, RLE, codification and decompressed blocks) are recycled instead of being allocated for every block.
+    Each thread keeps a list of the buffers it allocated: a released buffer goes back to that list, whichever thread releases it,
+    so the main thread gets back the input blocks it reads and each worker the outputs of the blocks it processes
+*/
+#define BUFFER_ALIGNMENT 64 // Cache line
+#define BUFFER_GRANULARITY (64 * 1024) // Capacities of larger buffers are rounded up to it so blocks of slightly different sizes share buffers
+#define BUFFER_POOL_SLOTS 8 // Released buffers kept for each thread (the few buffers of each of its tasks in flight)
+
+/**
+\brief Gets a buffer aligned to BUFFER_ALIGNMENT from the list of the calling thread (the smallest released one that fits) or allocates it if none fits.
+ It's safe to call from any thread
+ @param size Size of the buffer
+ @returns Buffer (NULL on lack of memory) which must be released with buffer_pool_release (never with free)
+*/
+void * buffer_pool_acquire(size_t size);
+
+/**
+\brief Gives a buffer back to the list of the thread which allocated it, to be reused by its next blocks (it's freed if that list is full).
+ It's safe to call from any thread
+ @param buffer Buffer given by buffer_pool_acquire (or NULL)
+*/
+void buffer_pool_release(void * buffer);
+
+/**
+\brief Frees released buffers until the pool keeps at most `bytes` (multithread_reserve calls it so they count against MEMORY_LIMIT).
+ It's safe to call from any thread
+ @param bytes Maximum capacity of the buffers kept by the pool
+*/
+void buffer_pool_trim(unsigned long long bytes);
+
+/**
+\brief Frees every buffer kept by the pool (it's called once a module's tasks are done)
+*/
+void buffer_pool_clear();
+
+#endif //UTILS_BUFFER_POOL_H
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "codes.h"
+#include "binary.h"
+#include "errors.h"
+
+#define CODES_HEADER_SIZE 14
+
+
+_modules_error parse_codes(const char * text, Code codes[NUM_SYMBOLS])
+{
+    const char * start;
+
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol) {
+
+        codes[symbol].bits = 0;
+
+        for (start = text; *text == '0' || *text == '1'; ++text)
+            codes[symbol].bits = (codes[symbol].bits << 1) | (*text == '1');
+
+        if (text - start > MAX_CODE_LENGTH)
+            return _FILE_UNRECOGNIZABLE;
+
+        codes[symbol].length = text - start;
+
+        // Every code is followed by ';' except the last one
+        if (*text++ != (symbol < NUM_SYMBOLS - 1 ? ';' : '\0'))
+            return _FILE_UNRECOGNIZABLE;
+    }
+
+    return _SUCCESS;
+}
+
+
+_modules_error canonical_codes(const uint8_t lengths[NUM_SYMBOLS], Code codes[NUM_SYMBOLS])
+{
+    unsigned int count[MAX_CODE_LENGTH + 1] = {0};
+    uint64_t next_code[MAX_CODE_LENGTH + 1];
+    uint64_t code = 0;
+    int available = 1; // Codes still available with the current length (Kraft's inequality)
+
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol) {
+        if (lengths[symbol] > MAX_CODE_LENGTH)
+            return _FILE_UNRECOGNIZABLE;
+
+        ++count[lengths[symbol]];
+    }
+    count[0] = 0;
+
+    for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+
+        available = 2 * available - count[length];
+
+        // Lengths which can't belong to a prefix code
+        if (available < 0)
+            return _FILE_UNRECOGNIZABLE;
+
+        // There aren't enough symbols left to run out of codes
+        if (available > NUM_SYMBOLS)
+            available = NUM_SYMBOLS;
+
+        code = (code + count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol) {
+        codes[symbol].length = lengths[symbol];
+        codes[symbol].bits = lengths[symbol] ? next_code[lengths[symbol]]++ : 0;
+    }
+
+    return _SUCCESS;
+}
+
+
+_modules_error build_codes(const BlockCodes * const block_codes, Code codes[NUM_SYMBOLS])
+{
+    if (block_codes->text)
+        return parse_codes(block_codes->text, codes);
+
+    return canonical_codes(block_codes->lengths, codes);
+}
+
+
+_modules_error write_codes_header(FILE * const fd, const char mode, const unsigned long long num_blocks, const bool canonical)
+{
+    uint8_t header[CODES_HEADER_SIZE];
+
+    if (!canonical)
+        return fprintf(fd, "@%c@%llu", mode, num_blocks) >= 4 ? _SUCCESS : _FILE_STREAM_FAILED;
+
+    memcpy(header, CODES_MAGIC, 4);
+    header[4] = CODES_VERSION;
+    header[5] = mode;
+    store_le64(header + 6, num_blocks);
+
+    return fwrite(header, sizeof(uint8_t), CODES_HEADER_SIZE, fd) == CODES_HEADER_SIZE ? _SUCCESS : _FILE_STREAM_FAILED;
+}
+
+
+_modules_error read_codes_header(FILE * const fd, char * const mode, unsigned long long * const num_blocks, bool * const canonical)
+{
+    uint8_t header[CODES_HEADER_SIZE];
+    int first = fgetc(fd);
+
+    // Textual files always start with '@'
+    if (first == '@') {
+        *canonical = false;
+        return fscanf(fd, "%c@%llu", mode, num_blocks) == 2 ? _SUCCESS : _FILE_UNRECOGNIZABLE;
+    }
+
+    header[0] = first;
+
+    if (first == EOF || fread(header + 1, sizeof(uint8_t), CODES_HEADER_SIZE - 1, fd) != CODES_HEADER_SIZE - 1)
+        return _FILE_UNRECOGNIZABLE;
+
+    if (memcmp(header, CODES_MAGIC, 4) || header[4] != CODES_VERSION || (header[5] != 'R' && header[5] != 'N'))
+        return _FILE_UNRECOGNIZABLE;
+
+    *canonical = true;
+    *mode = header[5];
+    *num_blocks = load_le64(header + 6);
+
+    return _SUCCESS;
+}
+
+
+_modules_error write_block_codes(FILE * const fd, const unsigned long block_size, const unsigned long original_size, const BlockCodes * const block_codes)
+{
+    if (block_codes->text)
+        return fprintf(fd, "@%lu@%s", block_size, block_codes->text) >= 2 ? _SUCCESS : _FILE_STREAM_FAILED;
+
+    if (!write_le64(fd, block_size) || !write_le64(fd, original_size) || fwrite(block_codes->lengths, sizeof(uint8_t), NUM_SYMBOLS, fd) != NUM_SYMBOLS)
+        return _FILE_STREAM_FAILED;
+
+    return _SUCCESS;
+}
+
+
+_modules_error read_block_codes(FILE * const fd, const bool canonical, unsigned long * const block_size, unsigned long * const original_size, BlockCodes * const block_codes)
+{
+    uint64_t size, size_before_rle;
+
+    if (!canonical) {
+        *original_size = 0;
+
+        block_codes->text = malloc(BLOCK_CODES_SIZE);
+
+        if (!block_codes->text)
+            return _LACK_OF_MEMORY;
+
+        if (fscanf(fd, "@%lu@%33151[^@]", block_size, block_codes->text) != 2) {
+            free(block_codes->text);
+            block_codes->text = NULL;
+            return _FILE_STREAM_FAILED;
+        }
+
+        return _SUCCESS;
+    }
+
+    block_codes->text = NULL;
+
+    if (!read_le64(fd, &size) || !read_le64(fd, &size_before_rle) || fread(block_codes->lengths, sizeof(uint8_t), NUM_SYMBOLS, fd) != NUM_SYMBOLS)
+        return _FILE_STREAM_FAILED;
+
+    *block_size = size;
+    *original_size = size_before_rle;
+
+    return _SUCCESS;
+}
+
+
+_modules_error skip_block_codes(FILE * const fd, const bool canonical, const unsigned long long num_blocks)
+{
+    BlockCodes block_codes;
+    unsigned long block_size, original_size;
+    _modules_error error = _SUCCESS;
+
+    // Canonical blocks have a fixed size: block size, size before RLE and the lengths
+    if (canonical)
+        return num_blocks && fseek(fd, num_blocks * (16 + NUM_SYMBOLS), SEEK_CUR) ? _FILE_STREAM_FAILED : _SUCCESS;
+
+    for (unsigned long long i = 0; i < num_blocks && !error; ++i) {
+        error = read_block_codes(fd, canonical, &block_size, &original_size, &block_codes);
+        free(block_codes.text);
+    }
+
+    return error;
+}
+
+
+_modules_error write_codes_trailer(FILE * const fd, const bool canonical)
+{
+    // Canonical files know their number of blocks so they don't need to mark the end
+    if (canonical)
+        return _SUCCESS;
+
+    return fprintf(fd, "@0") == 2 ? _SUCCESS : _FILE_STREAM_FAILED;
+}
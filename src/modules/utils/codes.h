@@ -0,0 +1,122 @@
+#ifndef UTILS_CODES_H
+#define UTILS_CODES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "errors.h"
+
+#define NUM_SYMBOLS 256
+#define MAX_CODE_LENGTH 64
+#define MAX_STREAMS 4 // Bitstreams the symbols of a block can be interleaved into
+#define BLOCK_CODES_SIZE 33152 // sum 1 to 256 (worst case shannon fano) + 255 semicolons + 1 byte NULL
+
+/*
+    Canonical .cod file (binary):
+        "SCOD" | version (1 byte) | mode 'R'/'N' (1 byte) | number of blocks (8 bytes)
+        Each block: block size (8 bytes) | size of the block before RLE (8 bytes) | length of each symbol's code (256 bytes)
+    Version 2 added the size before RLE so module D can allocate the decompressed block at once
+*/
+#define CODES_MAGIC "SCOD"
+#define CODES_VERSION 2
+
+/**
+\brief Code of a symbol
+*/
+typedef struct {
+    uint64_t bits; // Aligned to the least significant bit
+    uint8_t length; // 0 if the symbol doesn't show up in the block
+} Code;
+
+/**
+\brief Codes of a block as stored in the .cod file: Either the textual codes separated by ';' or only their lengths (canonical codes)
+*/
+typedef struct {
+    char * text; // NULL if canonical
+    uint8_t lengths[NUM_SYMBOLS];
+} BlockCodes;
+
+/**
+\brief Converts the textual codes of a block into codes
+ @param text Codes separated by ';'
+ @param codes Array to load the code of each symbol
+ @returns Error status
+*/
+_modules_error parse_codes(const char * text, Code codes[NUM_SYMBOLS]);
+
+/**
+\brief Assigns canonical codes given their lengths (shorter codes come first and, for the same length, lower symbols come first)
+ @param lengths Length of each symbol's code
+ @param codes Array to load the code of each symbol
+ @returns Error status
+*/
+_modules_error canonical_codes(const uint8_t lengths[NUM_SYMBOLS], Code codes[NUM_SYMBOLS]);
+
+/**
+\brief Rebuilds the codes of a block from its representation in the .cod file
+ @param block_codes Codes of a block as stored in the .cod file
+ @param codes Array to load the code of each symbol
+ @returns Error status
+*/
+_modules_error build_codes(const BlockCodes * block_codes, Code codes[NUM_SYMBOLS]);
+
+/**
+\brief Writes the header of the .cod file
+ @param fd File's handle
+ @param mode 'R' (RLE) or 'N' (Normal)
+ @param num_blocks Number of blocks
+ @param canonical Whether the file only keeps the lengths of the codes
+ @returns Error status
+*/
+_modules_error write_codes_header(FILE * fd, char mode, unsigned long long num_blocks, bool canonical);
+
+/**
+\brief Reads the header of the .cod file whatever its format is
+ @param fd File's handle
+ @param mode Pointer to load the mode
+ @param num_blocks Pointer to load the number of blocks
+ @param canonical Pointer to load whether the file only keeps the lengths of the codes
+ @returns Error status
+*/
+_modules_error read_codes_header(FILE * fd, char * mode, unsigned long long * num_blocks, bool * canonical);
+
+/**
+\brief Writes the codes of a block to the .cod file (in the format given by `block_codes->text`)
+ @param fd File's handle
+ @param block_size Size of the block
+ @param original_size Size of the block before RLE (only kept by the binary format)
+ @param block_codes Codes of the block
+ @returns Error status
+*/
+_modules_error write_block_codes(FILE * fd, unsigned long block_size, unsigned long original_size, const BlockCodes * block_codes);
+
+/**
+\brief Reads the codes of a block from the .cod file. If not canonical, `block_codes->text` is allocated
+ @param fd File's handle
+ @param canonical Whether the file only keeps the lengths of the codes
+ @param block_size Pointer to load the size of the block
+ @param original_size Pointer to load the size of the block before RLE (0 if the format doesn't keep it)
+ @param block_codes Codes of the block
+ @returns Error status
+*/
+_modules_error read_block_codes(FILE * fd, bool canonical, unsigned long * block_size, unsigned long * original_size, BlockCodes * block_codes);
+
+/**
+\brief Skips the codes of the next blocks of the .cod file
+ @param fd File's handle
+ @param canonical Whether the file only keeps the lengths of the codes
+ @param num_blocks Number of blocks to skip
+ @returns Error status
+*/
+_modules_error skip_block_codes(FILE * fd, bool canonical, unsigned long long num_blocks);
+
+/**
+\brief Writes the end of the .cod file
+ @param fd File's handle
+ @param canonical Whether the file only keeps the lengths of the codes
+ @returns Error status
+*/
+_modules_error write_codes_trailer(FILE * fd, bool canonical);
+
+#endif //UTILS_CODES_H
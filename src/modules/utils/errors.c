@@ -17,7 +17,9 @@
     _(       _FILE_STREAM_FAILED, "Can't communicate properly with file's stream\n"                             )     \
     _(           _FILE_TOO_SMALL, "File too small for decompression\n"                                          )     \
     _(   _THREAD_CREATION_FAILED, "Thread couldn't be created\n"                                                )     \
-    _(_THREAD_TERMINATION_FAILED, "Thread didn't terminate properly\n"                                          )
+    _(_THREAD_TERMINATION_FAILED, "Thread didn't terminate properly\n"                                          )     \
+    _(            _CODE_TOO_LONG, "Code longer than 64 bits\n"                                                  )     \
+    _(        _RANGE_OUT_OF_FILE, "Range starts past the end of the original file\n"                             )
     
 
 #define ERROR_CASE(NUM, MSG) case NUM: return MSG;
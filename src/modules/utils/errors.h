@@ -13,6 +13,8 @@ typedef enum _error // Use integers between 0-255 for safe integer cast to point
     _FILE_TOO_SMALL            = 6,
     _THREAD_CREATION_FAILED    = 7,
     _THREAD_TERMINATION_FAILED = 8,
+    _CODE_TOO_LONG             = 9,
+    _RANGE_OUT_OF_FILE         = 10,
 } _modules_error;
 
 
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "freqs.h"
+#include "binary.h"
+#include "errors.h"
+
+#define FREQS_HEADER_SIZE 14
+#define FREQS_BLOCK_SIZE (8 + 8 + 4 * NUM_SYMBOLS)
+
+/**
+\brief Reads the frequencies of a block in the textual format
+ @param codes_input Buffer of the respective .freq file block
+ @param frequencies Array to store the frequencies from each symbol
+ @returns Error status
+*/
+static _modules_error parse_freq(char * restrict codes_input, unsigned long * restrict frequencies) 
+{
+    int read_count;
+    // Checks if there are any errors with the input file
+    if (sscanf(codes_input, "%lu%n;", frequencies, &read_count) != 1)
+        return _FILE_UNRECOGNIZABLE;
+
+    codes_input += read_count + 1;
+
+    // Loop to go through all symbols
+    for (int i = 1; i < NUM_SYMBOLS; ++i) {
+        
+        // Reads the frequency  
+        if (sscanf(codes_input, "%lu%n", &frequencies[i], &read_count) == 1) {
+            
+            // Checks for possible errors in .freq file
+            if (codes_input[read_count] != ';' && i != NUM_SYMBOLS - 1)
+                return _FILE_UNRECOGNIZABLE;
+
+            codes_input += read_count + 1;
+        }  
+
+        // Checks if we are in one of the specific cases with equal frequencies
+        else if (*codes_input == ';' || (*codes_input == '\0' && i == NUM_SYMBOLS - 1)) {
+            frequencies[i] = frequencies[i-1];
+            ++codes_input;
+        }
+
+        // Checks for possible errors in .freq file
+        else
+            return _FILE_UNRECOGNIZABLE;
+    }
+
+    // Checks for possible errors in the buffer
+    if (codes_input[-1] != '\0')
+        return _FILE_UNRECOGNIZABLE;
+    
+    return _SUCCESS;
+}
+
+
+_modules_error write_freq_header(FILE * const fd, const char mode, const unsigned long long num_blocks, const bool binary)
+{
+    uint8_t header[FREQS_HEADER_SIZE];
+
+    if (!binary)
+        return fprintf(fd, "@%c@%llu", mode, num_blocks) >= 4 ? _SUCCESS : _FILE_STREAM_FAILED;
+
+    memcpy(header, FREQS_MAGIC, 4);
+    header[4] = FREQS_VERSION;
+    header[5] = mode;
+    store_le64(header + 6, num_blocks);
+
+    return fwrite(header, sizeof(uint8_t), FREQS_HEADER_SIZE, fd) == FREQS_HEADER_SIZE ? _SUCCESS : _FILE_STREAM_FAILED;
+}
+
+
+_modules_error read_freq_header(FILE * const fd, char * const mode, unsigned long long * const num_blocks, bool * const binary)
+{
+    uint8_t header[FREQS_HEADER_SIZE];
+    int first = fgetc(fd);
+
+    // Textual files always start with '@'
+    if (first == '@') {
+        *binary = false;
+        return fscanf(fd, "%c@%llu", mode, num_blocks) == 2 ? _SUCCESS : _FILE_UNRECOGNIZABLE;
+    }
+
+    header[0] = first;
+
+    if (first == EOF || fread(header + 1, sizeof(uint8_t), FREQS_HEADER_SIZE - 1, fd) != FREQS_HEADER_SIZE - 1)
+        return _FILE_UNRECOGNIZABLE;
+
+    if (memcmp(header, FREQS_MAGIC, 4) || header[4] != FREQS_VERSION || (header[5] != 'R' && header[5] != 'N'))
+        return _FILE_UNRECOGNIZABLE;
+
+    *binary = true;
+    *mode = header[5];
+    *num_blocks = load_le64(header + 6);
+
+    return _SUCCESS;
+}
+
+
+_modules_error write_block_freq(FILE * const fd, const unsigned long block_size, const unsigned long original_size, const unsigned long frequencies[NUM_SYMBOLS], const bool binary)
+{
+    uint8_t block[FREQS_BLOCK_SIZE];
+    char text[FREQ_TEXT_SIZE + 2 * 21]; // Along with "@<size>@"
+    int length, i, j;
+
+    if (binary) {
+        store_le64(block, block_size);
+        store_le64(block + 8, original_size);
+
+        for (i = 0; i < NUM_SYMBOLS; ++i)
+            store_le32(block + 16 + 4 * i, frequencies[i]);
+
+        return fwrite(block, sizeof(uint8_t), FREQS_BLOCK_SIZE, fd) == FREQS_BLOCK_SIZE ? _SUCCESS : _FILE_STREAM_FAILED;
+    }
+
+    length = sprintf(text, "@%lu@", block_size);
+
+    // Each frequency is written once followed by as many ';' as symbols in a row with it (the last symbol isn't followed by ';')
+    for (i = 0; i < NUM_SYMBOLS; i = j) {
+        length += sprintf(text + length, "%lu", frequencies[i]);
+
+        for (j = i; j < NUM_SYMBOLS && frequencies[i] == frequencies[j]; ++j)
+            if (j != NUM_SYMBOLS - 1)
+                text[length++] = ';';
+    }
+
+    return fwrite(text, sizeof(char), length, fd) == (size_t) length ? _SUCCESS : _FILE_STREAM_FAILED;
+}
+
+
+_modules_error read_block_freq(FILE * const fd, const bool binary, unsigned long * const block_size, unsigned long * const original_size, unsigned long frequencies[NUM_SYMBOLS])
+{
+    uint8_t block[FREQS_BLOCK_SIZE];
+    char text[FREQ_TEXT_SIZE];
+
+    if (binary) {
+        if (fread(block, sizeof(uint8_t), FREQS_BLOCK_SIZE, fd) != FREQS_BLOCK_SIZE)
+            return _FILE_STREAM_FAILED;
+
+        *block_size = load_le64(block);
+        *original_size = load_le64(block + 8);
+
+        for (int i = 0; i < NUM_SYMBOLS; ++i)
+            frequencies[i] = load_le32(block + 16 + 4 * i);
+
+        return _SUCCESS;
+    }
+
+    *original_size = 0;
+
+    if (fscanf(fd, "@%lu@%2559[^@]", block_size, text) != 2)
+        return _FILE_STREAM_FAILED;
+
+    return parse_freq(text, frequencies);
+}
+
+
+_modules_error write_freq_trailer(FILE * const fd, const bool binary)
+{
+    // Binary files know their number of blocks so they don't need to mark the end
+    if (binary)
+        return _SUCCESS;
+
+    return fprintf(fd, "@0") == 2 ? _SUCCESS : _FILE_STREAM_FAILED;
+}
@@ -0,0 +1,72 @@
+#ifndef UTILS_FREQS_H
+#define UTILS_FREQS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "errors.h"
+
+#define NUM_SYMBOLS 256
+#define FREQ_TEXT_SIZE (9 * NUM_SYMBOLS + (NUM_SYMBOLS - 1) + 1) // 9 (max digits for frequency) + 256 (symbols) + 255 (';') + 1 (NULL terminator)
+
+/*
+    Binary .freq file:
+        "SFRQ" | version (1 byte) | mode 'R'/'N' (1 byte) | number of blocks (8 bytes)
+        Each block: block size (8 bytes) | size of the block before RLE (8 bytes) | frequency of each symbol (256 * 4 bytes)
+    Frequencies fit in 4 bytes since no block (even after RLE) gets close to 4 GiB
+    Version 2 added the size before RLE so module D can allocate the decompressed block at once
+*/
+#define FREQS_MAGIC "SFRQ"
+#define FREQS_VERSION 2
+
+/**
+\brief Writes the header of the .freq file
+ @param fd File's handle
+ @param mode 'R' (RLE) or 'N' (Normal)
+ @param num_blocks Number of blocks
+ @param binary Whether to use the binary format instead of the textual one
+ @returns Error status
+*/
+_modules_error write_freq_header(FILE * fd, char mode, unsigned long long num_blocks, bool binary);
+
+/**
+\brief Reads the header of the .freq file whatever its format is
+ @param fd File's handle
+ @param mode Pointer to load the mode
+ @param num_blocks Pointer to load the number of blocks
+ @param binary Pointer to load whether the file is binary
+ @returns Error status
+*/
+_modules_error read_freq_header(FILE * fd, char * mode, unsigned long long * num_blocks, bool * binary);
+
+/**
+\brief Writes the frequencies of a block to the .freq file
+ @param fd File's handle
+ @param block_size Size of the block
+ @param original_size Size of the block before RLE (only kept by the binary format)
+ @param frequencies Frequency of each symbol
+ @param binary Whether to use the binary format instead of the textual one
+ @returns Error status
+*/
+_modules_error write_block_freq(FILE * fd, unsigned long block_size, unsigned long original_size, const unsigned long frequencies[NUM_SYMBOLS], bool binary);
+
+/**
+\brief Reads the frequencies of a block from the .freq file
+ @param fd File's handle
+ @param binary Whether the file is binary
+ @param block_size Pointer to load the size of the block
+ @param original_size Pointer to load the size of the block before RLE (0 if the format doesn't keep it)
+ @param frequencies Array to load the frequency of each symbol
+ @returns Error status
+*/
+_modules_error read_block_freq(FILE * fd, bool binary, unsigned long * block_size, unsigned long * original_size, unsigned long frequencies[NUM_SYMBOLS]);
+
+/**
+\brief Writes the end of the .freq file
+ @param fd File's handle
+ @param binary Whether the file is binary
+ @returns Error status
+*/
+_modules_error write_freq_trailer(FILE * fd, bool binary);
+
+#endif //UTILS_FREQS_H
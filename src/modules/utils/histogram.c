@@ -0,0 +1,174 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "histogram.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <immintrin.h>
+#define HISTOGRAM_AVX2
+#endif
+
+#define NUM_SYMBOLS 256
+
+/*
+    Consecutive equal symbols would increment the same counter over and over, so each store has to wait for the previous one.
+    Spreading the symbols over interleaved sub-histograms keeps those increments independent.
+*/
+#define NUM_SUB_HISTOGRAMS 4
+
+/*
+    Sub-histograms are 32 bits wide (to be cache friendly) so they are flushed before they can overflow
+*/
+#define CHUNK_SIZE (1UL << 30)
+
+/*
+    Size of the pieces in which both buffers of a pair are interleaved
+*/
+#define STRIPE_SIZE 4096UL
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+
+typedef uint32_t SubHistograms[NUM_SUB_HISTOGRAMS][NUM_SYMBOLS];
+
+/**
+\brief Counts the symbols of an 8 bytes word
+ @param sub Sub-histograms
+ @param word Bytes to count (in the machine's order, which is irrelevant for counting)
+*/
+static inline void count_word(SubHistograms sub, const uint64_t word)
+{
+    ++sub[0][(uint8_t)  word       ];
+    ++sub[1][(uint8_t) (word >>  8)];
+    ++sub[2][(uint8_t) (word >> 16)];
+    ++sub[3][(uint8_t) (word >> 24)];
+    ++sub[0][(uint8_t) (word >> 32)];
+    ++sub[1][(uint8_t) (word >> 40)];
+    ++sub[2][(uint8_t) (word >> 48)];
+    ++sub[3][(uint8_t) (word >> 56)];
+}
+
+/**
+\brief Counts a chunk of symbols 8 at a time
+ @param sub Sub-histograms
+ @param buffer Array with the symbols
+ @param size Size of the chunk
+*/
+static void count_generic(SubHistograms sub, const uint8_t * buffer, unsigned long size)
+{
+    uint64_t word;
+
+    for ( ; size >= 8; size -= 8, buffer += 8) {
+        memcpy(&word, buffer, 8); // Unaligned load
+        count_word(sub, word);
+    }
+
+    while (size--)
+        ++sub[0][*buffer++];
+}
+
+#ifdef HISTOGRAM_AVX2
+/**
+\brief Counts a chunk of symbols 32 at a time
+ @param sub Sub-histograms
+ @param buffer Array with the symbols
+ @param size Size of the chunk
+*/
+__attribute__((target("avx2")))
+static void count_avx2(SubHistograms sub, const uint8_t * buffer, unsigned long size)
+{
+    __m256i bytes;
+    uint64_t word;
+
+    for ( ; size >= 32; size -= 32, buffer += 32) {
+        bytes = _mm256_loadu_si256((const __m256i *) buffer);
+
+        // A run of 32 equal symbols (typical of the data compressed with RLE) is counted at once
+        // Checking shorter runs isn't worth it since the branch would be mispredicted too often
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(buffer[0]))) == -1) {
+            sub[0][buffer[0]] += 32;
+            continue;
+        }
+
+        // Scalar loads are cheaper than extracting the lanes of the vector
+        for (int i = 0; i < 32; i += 8) {
+            memcpy(&word, buffer + i, 8);
+            count_word(sub, word);
+        }
+    }
+
+    count_generic(sub, buffer, size);
+}
+#endif
+
+/**
+\brief Picks the fastest kernel supported by the processor
+ @returns Kernel to count a chunk of symbols
+*/
+static void (* select_kernel(void))(SubHistograms, const uint8_t *, unsigned long)
+{
+#ifdef HISTOGRAM_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return count_avx2;
+#endif
+
+    return count_generic;
+}
+
+/**
+\brief Adds the sub-histograms into the histogram and clears them
+ @param sub Sub-histograms
+ @param freq Histogram
+*/
+static inline void flush(SubHistograms sub, unsigned long freq[NUM_SYMBOLS])
+{
+    for (int symbol = 0; symbol < NUM_SYMBOLS; ++symbol)
+        freq[symbol] += (unsigned long) sub[0][symbol] + sub[1][symbol] + sub[2][symbol] + sub[3][symbol];
+
+    memset(sub, 0, sizeof(SubHistograms));
+}
+
+
+void histogram(const uint8_t * const buffer, const unsigned long size, unsigned long freq[NUM_SYMBOLS])
+{
+    histogram_pair(buffer, size, freq, NULL, 0, NULL);
+}
+
+
+void histogram_pair(const uint8_t * buffer_a, unsigned long size_a, unsigned long freq_a[NUM_SYMBOLS], const uint8_t * buffer_b, unsigned long size_b, unsigned long freq_b[NUM_SYMBOLS])
+{
+    void (* const count)(SubHistograms, const uint8_t *, unsigned long) = select_kernel();
+    SubHistograms sub_a = {{0}}, sub_b = {{0}};
+    unsigned long chunk_a, chunk_b, done_a, done_b, step_a, step_b;
+
+    memset(freq_a, 0, NUM_SYMBOLS * sizeof(unsigned long));
+    if (freq_b)
+        memset(freq_b, 0, NUM_SYMBOLS * sizeof(unsigned long));
+
+    while (size_a || size_b) {
+        chunk_a = MIN(size_a, CHUNK_SIZE);
+        chunk_b = MIN(size_b, CHUNK_SIZE);
+
+        // Both buffers are walked side by side in stripes, so their loads overlap
+        for (done_a = done_b = 0; done_a < chunk_a || done_b < chunk_b; done_a += step_a, done_b += step_b) {
+            step_a = MIN(chunk_a - done_a, STRIPE_SIZE);
+            step_b = MIN(chunk_b - done_b, STRIPE_SIZE);
+
+            if (step_a)
+                count(sub_a, buffer_a + done_a, step_a);
+            if (step_b)
+                count(sub_b, buffer_b + done_b, step_b);
+        }
+
+        if (chunk_a) {
+            flush(sub_a, freq_a);
+            buffer_a += chunk_a;
+            size_a -= chunk_a;
+        }
+        if (chunk_b) {
+            flush(sub_b, freq_b);
+            buffer_b += chunk_b;
+            size_b -= chunk_b;
+        }
+    }
+}
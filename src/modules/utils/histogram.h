@@ -0,0 +1,25 @@
+#ifndef UTILS_HISTOGRAM_H
+#define UTILS_HISTOGRAM_H
+
+#include <stdint.h>
+
+/**
+\brief Counts how many times each of the 256 symbols shows up in a buffer (AVX2 is used at runtime when the processor supports it)
+ @param buffer Array with the symbols
+ @param size Size of the buffer
+ @param freq Array to put the frequencies (it is overwritten)
+*/
+void histogram(const uint8_t * buffer, unsigned long size, unsigned long freq[256]);
+
+/**
+\brief Counts the symbols of two buffers in a single pass, e.g. an original block and its RLE compression
+ @param buffer_a First array with the symbols
+ @param size_a Size of the first buffer
+ @param freq_a Array to put the frequencies of the first buffer (it is overwritten)
+ @param buffer_b Second array with the symbols
+ @param size_b Size of the second buffer
+ @param freq_b Array to put the frequencies of the second buffer (it is overwritten)
+*/
+void histogram_pair(const uint8_t * buffer_a, unsigned long size_a, unsigned long freq_a[256], const uint8_t * buffer_b, unsigned long size_b, unsigned long freq_b[256]);
+
+#endif //UTILS_HISTOGRAM_H
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "input.h"
+#include "stats.h"
+#include "errors.h"
+#include "buffer_pool.h"
+
+#if defined(__unix__) || defined(__APPLE__) || defined(__MACH__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define MAP_INPUT
+
+#endif
+
+
+void input_open(InputFile * const input, FILE * const fd)
+{
+    *input = (InputFile) { .fd = fd, .map = NULL, .size = 0, .offset = 0 };
+
+#ifdef MAP_INPUT
+    struct stat info;
+    void * map;
+    const long position = ftell(fd);
+
+    // Only regular files can be mapped (pipes or terminals keep using fread)
+    if (position < 0 || fstat(fileno(fd), &info) || !S_ISREG(info.st_mode) || info.st_size <= position)
+        return;
+
+    map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(fd), 0);
+
+    if (map == MAP_FAILED)
+        return;
+
+    // Blocks are read from the start to the end (the kernel reads ahead more aggressively)
+    madvise(map, info.st_size, MADV_SEQUENTIAL);
+
+    input->map = map;
+    input->size = info.st_size;
+    input->offset = position;
+#endif
+}
+
+
+_modules_error input_block(InputFile * const input, const unsigned long size, const uint8_t ** const block, uint8_t ** const allocated)
+{
+    uint8_t * buffer;
+    const double start = stats_clock();
+
+    if (input->map) {
+
+        if (input->size - input->offset < size)
+            return _FILE_STREAM_FAILED;
+
+        *block = input->map + input->offset;
+        *allocated = NULL;
+        input->offset += size;
+
+        stats_read(size, start);
+
+        return _SUCCESS;
+    }
+
+    buffer = buffer_pool_acquire(size);
+
+    if (!buffer)
+        return _LACK_OF_MEMORY;
+
+    if (fread(buffer, sizeof(uint8_t), size, input->fd) != size) {
+        buffer_pool_release(buffer);
+        return _FILE_STREAM_FAILED;
+    }
+
+    *block = *allocated = buffer;
+
+    stats_read(size, start);
+
+    return _SUCCESS;
+}
+
+
+bool input_size(InputFile * const input, unsigned long * const value)
+{
+    return input_number(input, '@', value);
+}
+
+
+bool input_number(InputFile * const input, const char tag, unsigned long * const value)
+{
+    const char format[] = { tag, '%', 'l', 'u', '\0' };
+    unsigned long size = 0;
+    unsigned long long idx;
+
+    // fscanf leaves a character other than the tag unread
+    if (!input->map)
+        return fscanf(input->fd, format, value) == 1;
+
+    if (input->offset >= input->size || input->map[input->offset] != (uint8_t) tag)
+        return false;
+
+    // At least one digit is needed
+    for (idx = input->offset + 1; idx < input->size && input->map[idx] >= '0' && input->map[idx] <= '9'; ++idx)
+        size = size * 10 + (input->map[idx] - '0');
+
+    if (idx == input->offset + 1)
+        return false;
+
+    input->offset = idx;
+    *value = size;
+
+    return true;
+}
+
+
+bool input_skip(InputFile * const input, const char expected)
+{
+    if (!input->map)
+        return fgetc(input->fd) == expected;
+
+    if (input->offset >= input->size || input->map[input->offset] != (uint8_t) expected)
+        return false;
+
+    ++input->offset;
+
+    return true;
+}
+
+
+bool input_seek(InputFile * const input, const unsigned long long offset)
+{
+    if (!input->map)
+        return !fseek(input->fd, offset, SEEK_SET);
+
+    if (offset > input->size)
+        return false;
+
+    input->offset = offset;
+
+    return true;
+}
+
+
+void input_close(InputFile * const input)
+{
+#ifdef MAP_INPUT
+    if (input->map)
+        munmap((void *) input->map, input->size);
+#endif
+
+    input->map = NULL;
+}
@@ -0,0 +1,77 @@
+#ifndef UTILS_INPUT_H
+#define UTILS_INPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "errors.h"
+
+/**
+\brief Input file read block by block. Regular files are mapped in memory (where the platform allows it) so their blocks are used in place,
+ anything else (e.g. pipes) falls back to fread into an allocated buffer
+*/
+typedef struct {
+    FILE * fd;
+    const uint8_t * map; // NULL if the file is read with fread
+    unsigned long long size; // Size of the mapping
+    unsigned long long offset; // Position of the next block in the mapping
+} InputFile;
+
+/**
+\brief Prepares an input file to be read from its current position (it is mapped whenever possible)
+ @param input Input file to be initialized
+ @param fd File's handle (still owned by the caller, who must keep it open until input_close)
+*/
+void input_open(InputFile * input, FILE * fd);
+
+/**
+\brief Gets the next block of the input file
+ @param input Input file
+ @param size Size of the block
+ @param block Address to load the block (valid until input_close or, if allocated, until it is released)
+ @param allocated Address to load the buffer to be released with buffer_pool_release (NULL if the block is mapped)
+ @returns Error status
+*/
+_modules_error input_block(InputFile * input, unsigned long size, const uint8_t ** block, uint8_t ** allocated);
+
+/**
+\brief Reads a size written as '@' followed by its digits (the same as fscanf's "@%lu")
+ @param input Input file
+ @param value Pointer to load the size
+ @returns Success
+*/
+bool input_size(InputFile * input, unsigned long * value);
+
+/**
+\brief Reads a number written as the tag followed by its digits, leaving the input untouched if the tag isn't next
+ @param input Input file
+ @param tag Character before the digits
+ @param value Pointer to load the number
+ @returns Success
+*/
+bool input_number(InputFile * input, char tag, unsigned long * value);
+
+/**
+\brief Skips the next character of the input file as long as it is the expected one
+ @param input Input file
+ @param expected Expected character
+ @returns Whether it was the expected character
+*/
+bool input_skip(InputFile * input, char expected);
+
+/**
+\brief Moves to a given position of the input file, so the next block is read from there
+ @param input Input file
+ @param offset Position from the start of the file
+ @returns Success
+*/
+bool input_seek(InputFile * input, unsigned long long offset);
+
+/**
+\brief Releases the mapping of the input file (the file's handle is left open)
+ @param input Input file
+*/
+void input_close(InputFile * input);
+
+#endif //UTILS_INPUT_H
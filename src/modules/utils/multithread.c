@@ -12,8 +12,10 @@
 #include <stdbool.h>
 
 
+#include "stats.h"
 #include "errors.h"
 #include "multithread.h"
+#include "buffer_pool.h"
 
 #ifdef THREADS
 bool NO_MULTITHREAD = false;
@@ -33,96 +35,256 @@ bool NO_MULTITHREAD = true;
 #endif
 
 /*
-    Stack functions, arguments for both functions and lastly the previous thread ID into a struct
+    Synchronization primitives of each platform under the same names
 */
-#ifdef THREADS
-typedef struct {
-
 #ifdef POSIX_THREADS
-    pthread_t prev_thread;
-    uintptr_t (* process)(void *);
-    uintptr_t (* write)(void *, _modules_error, _modules_error);
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+
+#define mutex_lock(mutex) pthread_mutex_lock(mutex)
+#define mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+#define cond_wait(cond, mutex) pthread_cond_wait(cond, mutex)
+#define cond_broadcast(cond) pthread_cond_broadcast(cond)
+
 #elif defined(WIN_THREADS)
-    HANDLE prev_hthread;
-    DWORD (* process)(void *);
-    DWORD (* write)(void *, _modules_error, _modules_error);
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Cond;
+
+#define mutex_lock(mutex) EnterCriticalSection(mutex)
+#define mutex_unlock(mutex) LeaveCriticalSection(mutex)
+#define cond_wait(cond, mutex) SleepConditionVariableCS(cond, mutex, INFINITE)
+#define cond_broadcast(cond) WakeAllConditionVariable(cond)
+
 #endif
 
+unsigned int NUM_THREADS = 0;
+unsigned long long MEMORY_LIMIT = 0;
+
+// Errors of the sequential version are kept until multithread_wait just like the threaded version
+static _modules_error SEQUENTIAL_ERROR = _SUCCESS;
+
+// Bytes of the output claimed by the sequential version (see multithread_offset)
+static unsigned long long SEQUENTIAL_OFFSET = 0;
+
+/*
+    Tasks in flight per worker thread. The main thread stalls when every slot is taken
+*/
+#define TASKS_PER_THREAD 2
+
+#ifdef THREADS
+/*
+    Both functions and their arguments queued by the main thread
+*/
+typedef struct {
+    _modules_error (* process)(void *);
+    _modules_error (* write)(void *, _modules_error, _modules_error);
     void * args;
-} Data;
-#endif //THREADS
+    unsigned long long bytes;
+    _modules_error error;
+    bool processed;
+    bool offset_claimed; // Its output's offset was claimed (or it won't be since `process` already returned)
+    TaskStats stats;
+} Task;
 
-// This static global variable is only accessed by the main thread
+/*
+    Tasks live in a ring indexed by their sequence number. Those in [next_write, next_process) are being processed or waiting
+    for their turn to write and those in [next_process, next_task) are waiting for a worker
+*/
+typedef struct {
+    Thread * threads;
+    unsigned int num_threads;
+    Task * tasks;
+    unsigned long capacity;
+    unsigned long long next_task;
+    unsigned long long next_process;
+    unsigned long long next_write;
+    unsigned long long next_offset; // Next task allowed to claim its output's offset
+    unsigned long long output_offset; // Bytes of the output claimed so far
+    unsigned long long reserved_bytes; // Reserved by tasks in flight along with `pending_bytes`
+    unsigned long long pending_bytes; // Reserved for the task that hasn't been queued yet
+    bool writing;
+    _modules_error error; // First error returned by a write's function (Sticky until multithread_wait)
+    Mutex lock;
+    Cond task_queued;
+    Cond task_written;
+    Cond offset_claimed;
+} Pool;
+
+// This static global variable is only accessed by the main thread and the pool's own workers
 // `multithread[_create | _wait]`'s functions are Thread-Unsafe because of it. For Thread-Safety it requires a reentrant version
 // For further examples check: `strtok` and `strtok_r` respectively defined in C standard and Posix only
 // Why? Use same multithread[_create | _wait]'s function assignature for Windows and Posix
-#ifdef POSIX_THREADS
-static pthread_t THREAD = 0;
-#elif defined(WIN_THREADS)
-static HANDLE HTHREAD = 0;
+static Pool POOL = {0};
+
+// Sequence number of the task each worker is processing
+#ifdef _MSC_VER
+static __declspec(thread) unsigned long long CURRENT_TASK;
+#else
+static _Thread_local unsigned long long CURRENT_TASK;
 #endif
 
 /**
-\brief Calls both functions and waits last thread closing the handle
- @returns Error status (Hack as a pointer)
+\brief Moves the turn to claim an offset past every task that already claimed it (or won't)
+ Warning: Must be called with the pool's lock held
 */
-#ifdef POSIX_THREADS
-static uintptr_t wrapper(Data * data)
+static void skip_claimed_offsets()
 {
-    pthread_t prev_thread;
-    uintptr_t error, prev_error = _SUCCESS; // Define as _SUCCESS in case there is no prev_hthread
+    while (POOL.next_offset < POOL.next_process && POOL.tasks[POOL.next_offset % POOL.capacity].offset_claimed)
+        ++POOL.next_offset;
+
+    cond_broadcast(&POOL.offset_claimed);
+}
+
+/**
+\brief Calls write's function of every processed task whose turn has come. Only one worker does it at a time so writes are sequential
+ Warning: Must be called with the pool's lock held
+*/
+static void write_ready_tasks()
+{
+    Task * task;
+    _modules_error error;
+    double start;
+
+    if (POOL.writing)
+        return;
 
-    error = (*(data->process))(data->args);
-    prev_thread = data->prev_thread;
+    POOL.writing = true;
 
-    // In case of error in `data->process` it still joins the thread for resource cleanup
-    if (prev_thread && pthread_join(prev_thread, (void **) &prev_error))
-        prev_error = _THREAD_TERMINATION_FAILED;
+    while (POOL.next_write < POOL.next_process && (task = &POOL.tasks[POOL.next_write % POOL.capacity])->processed) {
 
-    error = (*(data->write))(data->args, prev_error, error);
-    
-    free(data);
+        // The slot won't be reused until `next_write` moves forward so it is safe to use it without the lock
+        mutex_unlock(&POOL.lock);
+        start = stats_clock();
+        stats_task(&task->stats);
+        error = task->write(task->args, POOL.error, task->error);
+        stats_written(&task->stats, start);
+        stats_task(NULL);
+        mutex_lock(&POOL.lock);
 
-    return prev_error ? prev_error : error;
+        stats_record(&task->stats);
+
+        if (!POOL.error)
+            POOL.error = error;
+
+        task->processed = false;
+        POOL.reserved_bytes -= task->bytes;
+        ++POOL.next_write;
+        cond_broadcast(&POOL.task_written);
+    }
+
+    POOL.writing = false;
 }
+
+/**
+\brief Worker's loop. Takes the oldest queued task, processes it and writes every task whose turn has come
+ @param number Number of the worker (from 1, the main thread being 0)
+ @returns Never returns
+*/
+#ifdef POSIX_THREADS
+static void * worker(void * number)
 #elif defined(WIN_THREADS)
-static DWORD WINAPI wrapper(LPVOID _data)
+static DWORD WINAPI worker(LPVOID number)
+#endif
 {
-    Data * data = (Data *) _data;
-    HANDLE prev_hthread;
-    DWORD error, prev_error = _SUCCESS; // Define as _SUCCESS in case there is no prev_hthread
+    Task * task;
+    _modules_error error;
+    double start;
 
-    error = (*(data->process))(data->args);
-    prev_hthread = data->prev_hthread;
+    stats_thread((unsigned int) (uintptr_t) number);
 
-    if (prev_hthread) { // In case of error in `data->process` it still joins the thread for resource cleanup
-        if (WaitForSingleObject(prev_hthread, INFINITE) != WAIT_OBJECT_0 || !GetExitCodeThread(prev_hthread, &prev_error))
-            prev_error = _THREAD_TERMINATION_FAILED;
-        
-        CloseHandle(prev_hthread);
-    }
+    mutex_lock(&POOL.lock);
+
+    for (;;) {
+
+        while (POOL.next_process == POOL.next_task)
+            cond_wait(&POOL.task_queued, &POOL.lock);
+
+        CURRENT_TASK = POOL.next_process;
+        task = &POOL.tasks[POOL.next_process++ % POOL.capacity];
+
+        mutex_unlock(&POOL.lock);
+        start = stats_clock();
+        stats_task(&task->stats);
+        error = task->process(task->args);
+        stats_processed(&task->stats, start);
+        stats_task(NULL);
+        mutex_lock(&POOL.lock);
+
+        task->error = error;
+        task->processed = true;
 
-    error = (*(data->write))(data->args, prev_error, error);
-    
-    HeapFree(GetProcessHeap(), 0, data);
+        // The following tasks can't keep waiting for an offset this one won't claim anymore
+        if (!task->offset_claimed) {
+            task->offset_claimed = true;
+            skip_claimed_offsets();
+        }
 
-    return prev_error ? prev_error : error;
+        write_ready_tasks();
+    }
+
+    return 0;
 }
+
+/**
+\brief Creates the pool of worker threads
+ @returns Error status
+*/
+static _modules_error pool_start()
+{
+    unsigned int num_threads = NUM_THREADS;
+
+    if (!num_threads) {
+#ifdef POSIX_THREADS
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = num_cpus > 0 ? num_cpus : 1;
+#elif defined(WIN_THREADS)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        num_threads = info.dwNumberOfProcessors;
 #endif
+    }
 
+    POOL.capacity = (unsigned long) num_threads * TASKS_PER_THREAD;
+    POOL.tasks = calloc(POOL.capacity, sizeof(Task));
+    POOL.threads = malloc(num_threads * sizeof(Thread));
 
+    if (!POOL.tasks || !POOL.threads) {
+        free(POOL.tasks);
+        free(POOL.threads);
+        return _LACK_OF_MEMORY;
+    }
+
+#ifdef POSIX_THREADS
+    pthread_mutex_init(&POOL.lock, NULL);
+    pthread_cond_init(&POOL.task_queued, NULL);
+    pthread_cond_init(&POOL.task_written, NULL);
+    pthread_cond_init(&POOL.offset_claimed, NULL);
+
+    for ( ; POOL.num_threads < num_threads; ++POOL.num_threads)
+        if (pthread_create(&POOL.threads[POOL.num_threads], NULL, worker, (void *) (uintptr_t) (POOL.num_threads + 1)))
+            break;
+
+#elif defined(WIN_THREADS)
+    InitializeCriticalSection(&POOL.lock);
+    InitializeConditionVariable(&POOL.task_queued);
+    InitializeConditionVariable(&POOL.task_written);
+    InitializeConditionVariable(&POOL.offset_claimed);
+
+    for ( ; POOL.num_threads < num_threads; ++POOL.num_threads)
+        if (!(POOL.threads[POOL.num_threads] = CreateThread(NULL, 0, worker, (LPVOID) (uintptr_t) (POOL.num_threads + 1), 0, NULL)))
+            break;
+
+#endif
+
+    // A smaller pool still works as long as there is one worker
+    return POOL.num_threads ? _SUCCESS : _THREAD_CREATION_FAILED;
+}
+#endif //THREADS
 
-/*
-                                      POSIX CAUTION
-       Attention: Be careful that sizeof(void *) must be >= sizeof(_modules_error) 
-    otherwise make sure the value returned by those funtions are always <= sizeof(void *)
 
-                                     WINDOWS CAUTION
-             Attention: Be careful that sizeof(DWORD) must be >= sizeof(int) 
-     otherwise make sure the value returned by those funtions are always <= sizeof(DWORD)
 
- Why? Because we use a hack to consider a pointer as an _modules_error to pass between threads
-*/
 _modules_error multithread_create(_modules_error (* process)(void *), _modules_error (* write)(void *, _modules_error, _modules_error), void * args)
 {
 
@@ -131,66 +293,189 @@ _modules_error multithread_create(_modules_error (* process)(void *), _modules_e
 #endif
     {
         _modules_error error;
+        TaskStats stats;
+        double start;
+
+        if (SEQUENTIAL_ERROR)
+            return SEQUENTIAL_ERROR;
+
+        stats_queue(&stats);
+        stats_task(&stats);
 
+        start = stats_clock();
         error = process(args);
-        return write(args, _SUCCESS, error);
+        stats_processed(&stats, start);
+
+        start = stats_clock();
+        SEQUENTIAL_ERROR = write(args, _SUCCESS, error);
+        stats_written(&stats, start);
+
+        stats_task(NULL);
+        stats_record(&stats);
+
+        return _SUCCESS;
     }
 
-    
+#ifdef THREADS
+
+    _modules_error error;
+    Task * task;
+    double start;
 
-#ifdef POSIX_THREADS
+    if (!POOL.num_threads && (error = pool_start()))
+        return error;
 
-    Data * data = malloc(sizeof(Data));
-    
-    if (!data)
-        return _LACK_OF_MEMORY;
+    mutex_lock(&POOL.lock);
+
+    start = stats_clock();
+
+    while (POOL.next_task - POOL.next_write >= POOL.capacity && !POOL.error)
+        cond_wait(&POOL.task_written, &POOL.lock);
 
-    * data = (Data) {
-        .prev_thread = THREAD,
-        .process = (uintptr_t (*) (void *)) process,
-        .write = (uintptr_t (*) (void *, _modules_error, _modules_error)) write,
+    stats_stall(start);
+
+    // Stop queueing as soon as a task fails (args are still the caller's responsability)
+    if ((error = POOL.error)) {
+        mutex_unlock(&POOL.lock);
+        return error;
+    }
+
+    task = &POOL.tasks[POOL.next_task++ % POOL.capacity];
+
+    *task = (Task) {
+        .process = process,
+        .write = write,
         .args = args,
+        .bytes = POOL.pending_bytes,
+        .error = _SUCCESS,
+        .processed = false,
+        .offset_claimed = false
     };
-    
-    if (pthread_create(&THREAD, NULL, (void *) wrapper, data)) {
-        free(data);
-        return _THREAD_CREATION_FAILED;
+
+    stats_queue(&task->stats);
+
+    POOL.pending_bytes = 0;
+
+    cond_broadcast(&POOL.task_queued);
+    mutex_unlock(&POOL.lock);
+
+    return _SUCCESS;
+
+#endif
+}
+
+_modules_error multithread_reserve(const unsigned long long bytes)
+{
+#ifndef _NO_MULTITHREAD
+    if (NO_MULTITHREAD || !MEMORY_LIMIT)
+#endif
+    {
+        // Sequentially each block is released before the next one is read, so only the buffers kept by the pool count
+        if (MEMORY_LIMIT)
+            buffer_pool_trim(MEMORY_LIMIT > bytes ? MEMORY_LIMIT - bytes : 0);
+
+        return _SUCCESS;
     }
 
-#elif defined(WIN_THREADS)
 
-    HANDLE handle;
-    Data * data = HeapAlloc(GetProcessHeap(), 0, sizeof(Data));
+#ifdef THREADS
 
-    if (!data)
-        return _LACK_OF_MEMORY;
+    _modules_error error;
+    unsigned long long reserved;
+    double start;
 
-    * data = (Data) {
-        .prev_hthread = HTHREAD,
-        .process = (DWORD (*) (void *)) process,
-        .write = (DWORD (*) (void *, _modules_error, _modules_error)) write,
-        .args = args
-    };
-    
-    handle = CreateThread( 
-        NULL,                   // default security attributes
-        0,                      // use default stack size  
-        wrapper,                // thread function name
-        data,                   // argument to thread function 
-        0,                      // use default creation flags 
-        NULL                    // returns the thread identifier 
-    );
-
-    if (handle)
-        HTHREAD = handle;
-    else {
-        HeapFree(GetProcessHeap(), 0, data);
-        return _THREAD_CREATION_FAILED;
+    if (!POOL.num_threads && (error = pool_start()))
+        return error;
+
+    mutex_lock(&POOL.lock);
+
+    start = stats_clock();
+
+    // Only the tasks already queued can release memory. Otherwise it would wait for itself
+    while (POOL.reserved_bytes > POOL.pending_bytes && POOL.reserved_bytes + bytes > MEMORY_LIMIT)
+        cond_wait(&POOL.task_written, &POOL.lock);
+
+    stats_stall(start);
+
+    POOL.reserved_bytes += bytes;
+    POOL.pending_bytes += bytes;
+    reserved = POOL.reserved_bytes;
+
+    mutex_unlock(&POOL.lock);
+
+    // The buffers kept by the pool only get what the tasks in flight leave under the limit
+    buffer_pool_trim(MEMORY_LIMIT > reserved ? MEMORY_LIMIT - reserved : 0);
+
+    return _SUCCESS;
+
+#endif
+}
+
+unsigned long long multithread_offset(const unsigned long long bytes)
+{
+    unsigned long long offset;
+
+#ifndef _NO_MULTITHREAD
+    if (NO_MULTITHREAD)
+#endif
+    {
+        offset = SEQUENTIAL_OFFSET;
+        SEQUENTIAL_OFFSET += bytes;
+        return offset;
     }
 
+
+#ifdef THREADS
+
+    double start;
+
+    mutex_lock(&POOL.lock);
+
+    start = stats_clock();
+
+    // Only the tasks queued before this one can still claim an offset before it
+    while (POOL.next_offset != CURRENT_TASK)
+        cond_wait(&POOL.offset_claimed, &POOL.lock);
+
+    stats_wait(start);
+
+    offset = POOL.output_offset;
+    POOL.output_offset += bytes;
+
+    POOL.tasks[CURRENT_TASK % POOL.capacity].offset_claimed = true;
+    skip_claimed_offsets();
+
+    mutex_unlock(&POOL.lock);
+
+    return offset;
+
 #endif
+}
 
-    return _SUCCESS;
+void multithread_turn()
+{
+#ifndef _NO_MULTITHREAD
+    if (NO_MULTITHREAD)
+#endif
+        return; // Tasks are processed one after another
+
+
+#ifdef THREADS
+
+    double start;
+
+    mutex_lock(&POOL.lock);
+
+    start = stats_clock();
+
+    while (POOL.next_offset != CURRENT_TASK)
+        cond_wait(&POOL.offset_claimed, &POOL.lock);
+
+    stats_wait(start);
+
+    mutex_unlock(&POOL.lock);
+
+#endif
 }
 
 _modules_error multithread_wait()
@@ -198,28 +483,40 @@ _modules_error multithread_wait()
 #ifndef _NO_MULTITHREAD
     if (NO_MULTITHREAD)
 #endif
-        return _SUCCESS;
+    {
+        _modules_error error = SEQUENTIAL_ERROR;
 
+        SEQUENTIAL_ERROR = _SUCCESS;
+        SEQUENTIAL_OFFSET = 0;
+        return error;
+    }
 
-#ifdef POSIX_THREADS
 
-    uintptr_t error;
+#ifdef THREADS
 
-    if (pthread_join(THREAD, (void **) &error))
-        return _THREAD_TERMINATION_FAILED;
+    _modules_error error;
 
-#elif defined(WIN_THREADS)
+    if (!POOL.num_threads)
+        return _SUCCESS;
 
-    DWORD error;
+    mutex_lock(&POOL.lock);
 
-    if (WaitForSingleObject(HTHREAD, INFINITE) != WAIT_OBJECT_0 || !GetExitCodeThread(HTHREAD, &error))
-        error = _THREAD_TERMINATION_FAILED;
-    
-    CloseHandle(HTHREAD);
+    while (POOL.next_write != POOL.next_task)
+        cond_wait(&POOL.task_written, &POOL.lock);
 
-#endif
+    error = POOL.error;
+    POOL.error = _SUCCESS;
+    POOL.output_offset = 0;
+
+    // A reservation may be left behind if the caller stopped before queueing its task
+    POOL.reserved_bytes -= POOL.pending_bytes;
+    POOL.pending_bytes = 0;
+
+    mutex_unlock(&POOL.lock);
 
     return error;
+
+#endif
 }
 
 
@@ -234,8 +531,10 @@ float clock_main_thread(CLOCK_ACTION action)
     static bool time_fail = true;
     struct timespec finish_time;
 
-    if (action == START_CLOCK)
+    if (action == START_CLOCK) {
+        stats_reset();
         return time_fail = clock_gettime(CLOCK_MONOTONIC, &start_time);
+    }
     else {
         if (time_fail || clock_gettime(CLOCK_MONOTONIC, &finish_time) == -1)
             return -1;
@@ -248,6 +547,7 @@ float clock_main_thread(CLOCK_ACTION action)
     clock_t time;
 
     if (action == START_CLOCK) {
+        stats_reset();
         start_time = clock();
         return start_time != -1 ? 0 : -1;
     }
@@ -20,6 +20,16 @@
 
 extern bool NO_MULTITHREAD;
 
+/*
+    Number of worker threads (0 -> as many as the number of online processors)
+*/
+extern unsigned int NUM_THREADS;
+
+/*
+    Maximum number of bytes held by tasks in flight and the buffers kept by utils/buffer_pool (0 -> unlimited)
+*/
+extern unsigned long long MEMORY_LIMIT;
+
 /*
     Clock's time action
 */
@@ -35,20 +45,47 @@ typedef enum {STOP_CLOCK, START_CLOCK} CLOCK_ACTION;
 float clock_main_thread(CLOCK_ACTION action);
 
 /**
-\brief Calls both functions in a separated thread. Even though its a different process, write's function will execute sequentially.
+\brief Queues both functions to be called by the pool of worker threads (which is created on the first call). Even though `process` runs in parallel, write's function will execute sequentially in the same order the tasks were queued.
+ The caller blocks while there are too many tasks in flight, which bounds the memory used by the arguments of queued tasks.
  Warning: This function isn't thread-safe itself
  @param process This is the processing function which doesn't do IO sequencially
- @param write This is the function which does IO sequentially
+ @param write This is the function which does IO sequentially. It is always called (even if `process` failed) so it must release `args`
  @param args Arguments passed to both other parameters of this multithread_create's function
- @returns Error status
+ @returns Error status. On error neither function will be called, so `args` is still owned by the caller
 */
 _modules_error multithread_create(_modules_error (* process)(void *), _modules_error (* write)(void *, _modules_error, _modules_error), void * args);
 
 /**
-\brief Waits for all threads created from multithread_create's function
+\brief Reserves memory for the buffers of the next task queued with multithread_create's function (it is released once its write's function returns).
+ The caller blocks while the reservations of the tasks in flight plus `bytes` exceed MEMORY_LIMIT, unless no other task is in flight.
+ Released buffers kept by the pool beyond what's left under MEMORY_LIMIT are freed. It can be called more than once for the same task
  Warning: This function isn't thread-safe itself
+ @param bytes Estimate of the bytes the task will hold (input plus output buffers)
  @returns Error status
 */
+_modules_error multithread_reserve(unsigned long long bytes);
+
+/**
+\brief Claims the next `bytes` of the output for the task being processed. Tasks get their offsets in the same order they were queued, so
+ each one can write its block at its own position as soon as it knows its size instead of waiting for the previous writes.
+ It must be called from `process` at most once per task (tasks that don't call it take no room in the output)
+ @param bytes Size of the task's output
+ @returns Offset of the task's output from the first task queued since the last multithread_wait
+*/
+unsigned long long multithread_offset(unsigned long long bytes);
+
+/**
+\brief Waits for the turn of the task being processed to claim its output's offset, i.e. until every task queued before it claimed its own
+ (or won't since its `process` already returned), so whatever they stored before claiming is visible. Its own claim won't wait afterwards
+ Warning: Must be called from `process` before its call to multithread_offset (if any)
+*/
+void multithread_turn();
+
+/**
+\brief Waits for all tasks queued with multithread_create's function
+ Warning: This function isn't thread-safe itself
+ @returns Error status of the first task that failed
+*/
 _modules_error multithread_wait();
 
 #endif //UTILS_MULTITHREAD_H
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "stats.h"
+#include "output.h"
+#include "errors.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#define WIN_OUTPUT
+
+#elif defined(__unix__) || defined(__APPLE__) || defined(__MACH__)
+#include <errno.h>
+#include <unistd.h>
+#define POSIX_OUTPUT
+
+#endif
+
+
+_modules_error output_write(FILE * const fd, unsigned long long offset, const void * const buffer, const unsigned long size)
+{
+    const uint8_t * next = buffer;
+    unsigned long left = size;
+    const double start = stats_clock();
+
+#ifdef POSIX_OUTPUT
+    ssize_t written;
+
+    // A single call may write less than asked for
+    while (left) {
+        written = pwrite(fileno(fd), next, left, offset);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return _FILE_STREAM_FAILED;
+
+        next += written;
+        left -= written;
+        offset += written;
+    }
+
+#elif defined(WIN_OUTPUT)
+    const HANDLE handle = (HANDLE) _get_osfhandle(_fileno(fd));
+    OVERLAPPED position;
+    DWORD written;
+
+    while (left) {
+        position = (OVERLAPPED) { .Offset = (DWORD) offset, .OffsetHigh = (DWORD) (offset >> 32) };
+
+        if (!WriteFile(handle, next, left > 0x40000000 ? 0x40000000 : (DWORD) left, &written, &position) || !written)
+            return _FILE_STREAM_FAILED;
+
+        next += written;
+        left -= written;
+        offset += written;
+    }
+
+#else
+    // Without threads there's only one writer at a time
+    if (fseek(fd, offset, SEEK_SET) || fwrite(next, sizeof(uint8_t), left, fd) != left)
+        return _FILE_STREAM_FAILED;
+
+#endif
+
+    stats_write(size, start);
+
+    return _SUCCESS;
+}
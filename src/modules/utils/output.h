@@ -0,0 +1,19 @@
+#ifndef UTILS_OUTPUT_H
+#define UTILS_OUTPUT_H
+
+#include <stdio.h>
+
+#include "errors.h"
+
+/**
+\brief Writes a buffer at a given position of a file without using (nor moving) the file's position, so many threads can write to it at once
+ Warning: Anything written before through `fd` must have been flushed
+ @param fd File's handle
+ @param offset Position of the file where the buffer goes
+ @param buffer Buffer to be written
+ @param size Size of the buffer
+ @returns Error status
+*/
+_modules_error output_write(FILE * fd, unsigned long long offset, const void * buffer, unsigned long size);
+
+#endif //UTILS_OUTPUT_H
@@ -0,0 +1,288 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rle.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <immintrin.h>
+#define RLE_SIMD // SSE2 is always available in x86-64
+#endif
+
+#define MIN_RUN 4
+#define MAX_RUN 255
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+
+#ifdef RLE_SIMD
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+/**
+\brief Finds where the next run (at least MIN_RUN equal symbols) or NULL symbol starts
+ @param input Array with the symbols
+ @param idx Index to start looking at
+ @param size Size of the input
+ @returns Index of the run/NULL symbol (size if there isn't any)
+*/
+static ALWAYS_INLINE unsigned long find_run_scalar(const uint8_t * const input, unsigned long idx, const unsigned long size)
+{
+    for ( ; idx < size; ++idx) {
+        if (!input[idx])
+            return idx;
+
+        if (idx + MIN_RUN - 1 < size && input[idx] == input[idx + 1] && input[idx] == input[idx + 2] && input[idx] == input[idx + 3])
+            return idx;
+    }
+
+    return size;
+}
+
+/**
+\brief Measures a run
+ @param input Array with the symbols
+ @param idx Index of the first symbol of the run
+ @param size Index where the run must end at most
+ @returns Length of the run
+*/
+static ALWAYS_INLINE unsigned long run_length_scalar(const uint8_t * const input, const unsigned long idx, const unsigned long size)
+{
+    unsigned long end = idx + 1;
+
+    while (end < size && input[end] == input[idx])
+        ++end;
+
+    return end - idx;
+}
+
+/**
+\brief Compresses the input given the functions to find and measure the runs
+ @param input Array with the symbols
+ @param output Array where to load the compressed content
+ @param size Size of the input
+ @param find_run Finds where the next run starts
+ @param run_length Measures a run
+ @returns Size of the compressed content
+*/
+static ALWAYS_INLINE unsigned long encode(const uint8_t * const input, uint8_t * const output, const unsigned long size,
+    unsigned long (* const find_run)(const uint8_t *, unsigned long, unsigned long),
+    unsigned long (* const run_length)(const uint8_t *, unsigned long, unsigned long))
+{
+    unsigned long idx = 0, out_idx = 0, run, reps;
+
+    while (idx < size) {
+
+        // Symbols before the run are copied as they are
+        run = find_run(input, idx, size);
+        memcpy(output + out_idx, input + idx, run - idx);
+        out_idx += run - idx;
+        idx = run;
+
+        if (idx == size)
+            break;
+
+        reps = run_length(input, idx, MIN(size, idx + MAX_RUN));
+
+        output[out_idx] = 0;
+        output[out_idx + 1] = input[idx];
+        output[out_idx + 2] = reps;
+        out_idx += 3;
+        idx += reps;
+    }
+
+    return out_idx;
+}
+
+#ifdef RLE_SIMD
+/*
+    The vectorized versions compare each lane with itself shifted by 1, 2 and 3 symbols,
+    so a bit of (mask(+1) & mask(+2) & mask(+3)) | mask(NULL) is set where a run or NULL symbol starts
+*/
+
+static ALWAYS_INLINE unsigned long find_run_sse2(const uint8_t * const input, unsigned long idx, const unsigned long size)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lane;
+    unsigned int mask;
+
+    for ( ; idx + 16 + MIN_RUN - 1 <= size; idx += 16) {
+        lane = _mm_loadu_si128((const __m128i *) (input + idx));
+
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(lane, _mm_loadu_si128((const __m128i *) (input + idx + 1))))
+             & _mm_movemask_epi8(_mm_cmpeq_epi8(lane, _mm_loadu_si128((const __m128i *) (input + idx + 2))))
+             & _mm_movemask_epi8(_mm_cmpeq_epi8(lane, _mm_loadu_si128((const __m128i *) (input + idx + 3))));
+        mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(lane, zero));
+
+        if (mask)
+            return idx + __builtin_ctz(mask);
+    }
+
+    return find_run_scalar(input, idx, size);
+}
+
+static ALWAYS_INLINE unsigned long run_length_sse2(const uint8_t * const input, const unsigned long idx, const unsigned long size)
+{
+    const __m128i symbol = _mm_set1_epi8(input[idx]);
+    unsigned long end = idx + 1;
+    unsigned int mask;
+
+    for ( ; end + 16 <= size; end += 16) {
+        mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (input + end)), symbol)) & 0xFFFF;
+
+        if (mask)
+            return end + __builtin_ctz(mask) - idx;
+    }
+
+    return end - 1 - idx + run_length_scalar(input, end - 1, size);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned long find_run_avx2(const uint8_t * const input, unsigned long idx, const unsigned long size)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lane;
+    unsigned int mask;
+
+    for ( ; idx + 32 + MIN_RUN - 1 <= size; idx += 32) {
+        lane = _mm256_loadu_si256((const __m256i *) (input + idx));
+
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lane, _mm256_loadu_si256((const __m256i *) (input + idx + 1))))
+             & _mm256_movemask_epi8(_mm256_cmpeq_epi8(lane, _mm256_loadu_si256((const __m256i *) (input + idx + 2))))
+             & _mm256_movemask_epi8(_mm256_cmpeq_epi8(lane, _mm256_loadu_si256((const __m256i *) (input + idx + 3))));
+        mask |= _mm256_movemask_epi8(_mm256_cmpeq_epi8(lane, zero));
+
+        if (mask)
+            return idx + __builtin_ctz(mask);
+    }
+
+    return find_run_sse2(input, idx, size);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned long run_length_avx2(const uint8_t * const input, const unsigned long idx, const unsigned long size)
+{
+    const __m256i symbol = _mm256_set1_epi8(input[idx]);
+    unsigned long end = idx + 1;
+    unsigned int mask;
+
+    for ( ; end + 32 <= size; end += 32) {
+        mask = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (input + end)), symbol));
+
+        if (mask)
+            return end + __builtin_ctz(mask) - idx;
+    }
+
+    // Carries on from the last symbol known to belong to the run
+    return end - 1 - idx + run_length_sse2(input, end - 1, size);
+}
+
+/**
+\brief Compresses the input with AVX2
+*/
+__attribute__((target("avx2")))
+static unsigned long encode_avx2(const uint8_t * const input, uint8_t * const output, const unsigned long size)
+{
+    return encode(input, output, size, find_run_avx2, run_length_avx2);
+}
+
+/**
+\brief Compresses the input with SSE2
+*/
+static unsigned long encode_sse2(const uint8_t * const input, uint8_t * const output, const unsigned long size)
+{
+    return encode(input, output, size, find_run_sse2, run_length_sse2);
+}
+#endif
+
+
+unsigned long rle_encode(const uint8_t * const input, uint8_t * const output, const unsigned long size)
+{
+#ifdef RLE_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return encode_avx2(input, output, size);
+
+    return encode_sse2(input, output, size);
+#else
+    return encode(input, output, size, find_run_scalar, run_length_scalar);
+#endif
+}
+
+
+bool rle_decoded_size(const uint8_t * const input, const unsigned long size, unsigned long * const decoded_size)
+{
+    const uint8_t * run;
+    unsigned long idx = 0, decoded = 0;
+
+    while (idx < size) {
+
+        // Every run starts with a NULL symbol
+        run = memchr(input + idx, 0, size - idx);
+
+        if (!run) {
+            decoded += size - idx;
+            break;
+        }
+
+        decoded += run - (input + idx);
+        idx = run - input;
+
+        if (idx + 2 >= size)
+            return false;
+
+        decoded += input[idx + 2];
+        idx += 3;
+    }
+
+    *decoded_size = decoded;
+
+    return true;
+}
+
+
+bool rle_decode(const uint8_t * const input, const unsigned long size, uint8_t * const output, const unsigned long capacity, unsigned long * const decoded_size)
+{
+    const uint8_t * run;
+    unsigned long idx = 0, out_idx = 0, literals, reps;
+
+    while (idx < size) {
+
+        // Literal stretches (everything up to the next run) are copied at once
+        run = memchr(input + idx, 0, size - idx);
+        literals = (run ? (unsigned long) (run - input) : size) - idx;
+
+        if (out_idx + literals > capacity)
+            return false;
+
+        memcpy(output + out_idx, input + idx, literals);
+        out_idx += literals;
+        idx += literals;
+
+        if (!run)
+            break;
+
+        if (idx + 2 >= size)
+            return false;
+
+        reps = input[idx + 2];
+
+        if (out_idx + reps > capacity)
+            return false;
+
+#ifdef RLE_SIMD
+        // Whole vectors are stored, the bytes written past the run are overwritten later (or fall in the slack)
+        for (unsigned long stored = 0; stored < reps; stored += 16)
+            _mm_storeu_si128((__m128i *) (output + out_idx + stored), _mm_set1_epi8(input[idx + 1]));
+#else
+        memset(output + out_idx, input[idx + 1], reps);
+#endif
+
+        out_idx += reps;
+        idx += 3;
+    }
+
+    *decoded_size = out_idx;
+
+    return true;
+}
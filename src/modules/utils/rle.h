@@ -0,0 +1,47 @@
+#ifndef UTILS_RLE_H
+#define UTILS_RLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Extra bytes the output of `rle_decode` must have past its capacity, since runs are expanded with whole vector stores
+*/
+#define RLE_DECODE_SLACK 16
+
+/*
+    Largest ratio between a buffer decompressed with RLE's algorithm and its compressed content: {0, symbol, 255} is the longest run
+*/
+#define RLE_MAX_EXPANSION 85
+
+/**
+\brief Compresses a buffer with RLE's algorithm: Runs of 4 or more symbols (and every NULL symbol) become {0, symbol, repetitions}
+ Runs and literal stretches are found with SSE2/AVX2 (selected at runtime) when the processor supports them
+ @param input Array with the symbols
+ @param output Array where to load the compressed content (worst case is twice the input size)
+ @param size Size of the input
+ @returns Size of the compressed content
+*/
+unsigned long rle_encode(const uint8_t * input, uint8_t * output, unsigned long size);
+
+/**
+\brief Calculates the size of a buffer once decompressed with RLE's algorithm (used when it wasn't recorded at compression time)
+ @param input Array with the compressed content
+ @param size Size of the compressed content
+ @param decoded_size Pointer to load the size once decompressed
+ @returns False if the compressed content is truncated
+*/
+bool rle_decoded_size(const uint8_t * input, unsigned long size, unsigned long * decoded_size);
+
+/**
+\brief Decompresses a buffer compressed with RLE's algorithm. Literal stretches are copied at once and runs are expanded with vector stores
+ @param input Array with the compressed content
+ @param size Size of the compressed content
+ @param output Array where to load the decompressed content (with RLE_DECODE_SLACK bytes past `capacity`)
+ @param capacity Maximum size of the decompressed content
+ @param decoded_size Pointer to load the size of the decompressed content
+ @returns False if the compressed content is truncated or doesn't fit in `capacity`
+*/
+bool rle_decode(const uint8_t * input, unsigned long size, uint8_t * output, unsigned long capacity, unsigned long * decoded_size);
+
+#endif //UTILS_RLE_H
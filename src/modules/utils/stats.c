@@ -0,0 +1,261 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "stats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+#endif
+
+STATS_FORMAT STATS = STATS_TEXT;
+
+#ifndef _NO_STATS
+
+/*
+    Times and bytes of every task added up for each thread
+*/
+typedef struct {
+    unsigned long long blocks; // Tasks processed
+    double read_time;
+    double stall_time;
+    double process_time;
+    double wait_time;
+    double write_time;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+} ThreadStats;
+
+// Tasks recorded since the module started (only appended by the thread writing the tasks and read once they're all written)
+static TaskStats * RECORDS = NULL;
+static unsigned long long NUM_RECORDS = 0;
+static unsigned long long RECORDS_CAPACITY = 0;
+
+// Reads and stalls of the main thread that belong to the next task it queues
+static TaskStats PENDING = {0};
+
+#ifdef _MSC_VER
+static __declspec(thread) unsigned int THREAD;
+static __declspec(thread) TaskStats * CURRENT;
+#else
+static _Thread_local unsigned int THREAD;
+static _Thread_local TaskStats * CURRENT;
+#endif
+
+
+double stats_clock()
+{
+    if (STATS != STATS_JSON)
+        return 0;
+
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+
+    return (double) counter.QuadPart * 1000 / frequency.QuadPart;
+
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &now))
+        return 0;
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+
+#else
+    return (double) clock() * 1000 / CLOCKS_PER_SEC;
+
+#endif
+}
+
+
+void stats_reset()
+{
+    free(RECORDS);
+    RECORDS = NULL;
+    NUM_RECORDS = RECORDS_CAPACITY = 0;
+    PENDING = (TaskStats) {0};
+}
+
+
+void stats_thread(const unsigned int thread)
+{
+    THREAD = thread;
+}
+
+
+void stats_task(TaskStats * const task)
+{
+    CURRENT = task;
+}
+
+
+void stats_read(const unsigned long long bytes, const double start)
+{
+    if (STATS != STATS_JSON)
+        return;
+
+    PENDING.read_time += stats_clock() - start;
+    PENDING.bytes_read += bytes;
+}
+
+
+void stats_stall(const double start)
+{
+    if (STATS != STATS_JSON)
+        return;
+
+    PENDING.stall_time += stats_clock() - start;
+}
+
+
+void stats_write(const unsigned long long bytes, const double start)
+{
+    if (STATS != STATS_JSON || !CURRENT)
+        return;
+
+    CURRENT->output_time += stats_clock() - start;
+    CURRENT->bytes_written += bytes;
+}
+
+
+void stats_wait(const double start)
+{
+    if (STATS != STATS_JSON || !CURRENT)
+        return;
+
+    CURRENT->wait_time += stats_clock() - start;
+}
+
+
+void stats_queue(TaskStats * const task)
+{
+    *task = PENDING;
+    task->worker = task->writer = THREAD;
+    PENDING = (TaskStats) {0};
+}
+
+
+void stats_processed(TaskStats * const task, const double start)
+{
+    if (STATS != STATS_JSON)
+        return;
+
+    task->worker = THREAD;
+    task->processed_at = stats_clock();
+    task->process_time = task->processed_at - start - task->wait_time - task->output_time;
+    task->write_time = task->output_time;
+}
+
+
+void stats_written(TaskStats * const task, const double start)
+{
+    if (STATS != STATS_JSON)
+        return;
+
+    task->writer = THREAD;
+    task->wait_time += start - task->processed_at;
+    task->write_time += stats_clock() - start;
+}
+
+
+void stats_record(const TaskStats * const task)
+{
+    TaskStats * records;
+
+    if (STATS != STATS_JSON)
+        return;
+
+    if (NUM_RECORDS == RECORDS_CAPACITY) {
+        records = realloc(RECORDS, (RECORDS_CAPACITY ? RECORDS_CAPACITY * 2 : 1024) * sizeof(TaskStats));
+
+        // The statistics are best effort, so a task is left out rather than failing the module
+        if (!records)
+            return;
+
+        RECORDS = records;
+        RECORDS_CAPACITY = RECORDS_CAPACITY ? RECORDS_CAPACITY * 2 : 1024;
+    }
+
+    RECORDS[NUM_RECORDS++] = *task;
+}
+
+
+void stats_print(FILE * const fd, const char * const module, const double total_time)
+{
+    unsigned long long i;
+    unsigned int num_threads = 1, thread;
+    TaskStats totals = {0};
+    ThreadStats * threads;
+    const TaskStats * task;
+
+    for (i = 0; i < NUM_RECORDS; ++i) {
+        if (RECORDS[i].worker >= num_threads)
+            num_threads = RECORDS[i].worker + 1;
+        if (RECORDS[i].writer >= num_threads)
+            num_threads = RECORDS[i].writer + 1;
+    }
+
+    fprintf(fd, "{\"module\":\"%s\",\"time_ms\":%.3f,\"blocks\":[", module, total_time);
+
+    for (i = 0; i < NUM_RECORDS; ++i) {
+        task = &RECORDS[i];
+
+        fprintf(fd,
+            "%s{\"block\":%llu,\"worker\":%u,\"writer\":%u,\"read_ms\":%.3f,\"stall_ms\":%.3f,\"process_ms\":%.3f,\"wait_ms\":%.3f,\"write_ms\":%.3f,\"bytes_read\":%llu,\"bytes_written\":%llu}",
+            i ? "," : "", i, task->worker, task->writer, task->read_time, task->stall_time, task->process_time, task->wait_time, task->write_time, task->bytes_read, task->bytes_written
+        );
+
+        totals.read_time += task->read_time;
+        totals.stall_time += task->stall_time;
+        totals.process_time += task->process_time;
+        totals.wait_time += task->wait_time;
+        totals.write_time += task->write_time;
+        totals.bytes_read += task->bytes_read;
+        totals.bytes_written += task->bytes_written;
+    }
+
+    fprintf(fd,
+        "],\"totals\":{\"blocks\":%llu,\"read_ms\":%.3f,\"stall_ms\":%.3f,\"process_ms\":%.3f,\"wait_ms\":%.3f,\"write_ms\":%.3f,\"bytes_read\":%llu,\"bytes_written\":%llu},\"threads\":[",
+        NUM_RECORDS, totals.read_time, totals.stall_time, totals.process_time, totals.wait_time, totals.write_time, totals.bytes_read, totals.bytes_written
+    );
+
+    // Reads and stalls are the main thread's, processing (and the bytes written) the worker's and writing the writer's
+    threads = calloc(num_threads, sizeof(ThreadStats));
+
+    if (threads) {
+        for (i = 0; i < NUM_RECORDS; ++i) {
+            task = &RECORDS[i];
+
+            threads[0].read_time += task->read_time;
+            threads[0].stall_time += task->stall_time;
+            threads[0].bytes_read += task->bytes_read;
+            threads[task->worker].process_time += task->process_time;
+            threads[task->worker].wait_time += task->wait_time;
+            threads[task->worker].bytes_written += task->bytes_written;
+            ++threads[task->worker].blocks;
+            threads[task->writer].write_time += task->write_time;
+        }
+
+        for (thread = 0; thread < num_threads; ++thread)
+            fprintf(fd,
+                "%s{\"thread\":%u,\"blocks\":%llu,\"read_ms\":%.3f,\"stall_ms\":%.3f,\"process_ms\":%.3f,\"wait_ms\":%.3f,\"write_ms\":%.3f,\"busy\":%.3f,\"bytes_read\":%llu,\"bytes_written\":%llu}",
+                thread ? "," : "", thread, threads[thread].blocks, threads[thread].read_time, threads[thread].stall_time, threads[thread].process_time,
+                threads[thread].wait_time, threads[thread].write_time,
+                total_time > 0 ? (threads[thread].read_time + threads[thread].process_time + threads[thread].write_time) / total_time : 0,
+                threads[thread].bytes_read, threads[thread].bytes_written
+            );
+
+        free(threads);
+    }
+
+    fprintf(fd, "]}\n");
+
+    stats_reset();
+}
+
+#endif //_NO_STATS
@@ -0,0 +1,142 @@
+#ifndef UTILS_STATS_H
+#define UTILS_STATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/*
+    Format of each module's summary
+*/
+typedef enum {
+    STATS_TEXT,  // Text summary with a line per block (default)
+    STATS_QUIET, // Text summary without the lines per block
+    STATS_JSON   // A JSON object per module (one line) with the times and bytes of each block and thread instead of the text summary
+} STATS_FORMAT;
+
+extern STATS_FORMAT STATS;
+
+/*
+    Times (milliseconds) and bytes of a task queued with multithread_create. Thread 0 is the main thread and workers are numbered from 1
+*/
+typedef struct {
+    unsigned int worker; // Thread that processed the task
+    unsigned int writer; // Thread that called its write's function
+    double read_time;    // Reading its input (main thread)
+    double stall_time;   // Main thread waiting for a free slot or memory before queueing it
+    double process_time; // Processing it (without the time spent writing or waiting)
+    double wait_time;    // Waiting for the previous tasks (its output's offset or its turn to write)
+    double write_time;   // Writing its output
+    double output_time;  // Spent writing while it was the current task (it's moved from processing to writing)
+    double processed_at; // When its process' function returned
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+} TaskStats;
+
+/*
+    Built with -D_NO_STATS every call compiles to nothing (`--stats json` isn't available)
+*/
+#ifndef _NO_STATS
+
+/**
+\brief Monotonic clock for the statistics
+ @returns Milliseconds since an arbitrary point (0 unless the format is STATS_JSON, so disabled statistics don't read the clock)
+*/
+double stats_clock();
+
+/**
+\brief Clears the statistics of the tasks recorded so far (every module starts its clock before its first block, which does it)
+*/
+void stats_reset();
+
+/**
+\brief Sets the number of the calling thread
+ @param thread Number of the thread (0 is the main thread)
+*/
+void stats_thread(unsigned int thread);
+
+/**
+\brief Sets the task being processed or written by the calling thread (where its reads and writes are added)
+ @param task Statistics of the task (NULL if none)
+*/
+void stats_task(TaskStats * task);
+
+/**
+\brief Adds a read of the main thread to the next task it queues
+ @param bytes Bytes read
+ @param start Clock (stats_clock) when the read started
+*/
+void stats_read(unsigned long long bytes, double start);
+
+/**
+\brief Adds the time the main thread was stalled to the next task it queues
+ @param start Clock (stats_clock) when the stall started
+*/
+void stats_stall(double start);
+
+/**
+\brief Adds a write to the current task of the calling thread
+ @param bytes Bytes written
+ @param start Clock (stats_clock) when the write started
+*/
+void stats_write(unsigned long long bytes, double start);
+
+/**
+\brief Adds a wait for the previous tasks to the current task of the calling thread
+ @param start Clock (stats_clock) when the wait started
+*/
+void stats_wait(double start);
+
+/**
+\brief Starts the statistics of a task with the reads and stalls of the main thread since the last task was queued
+ @param task Statistics of the task being queued
+*/
+void stats_queue(TaskStats * task);
+
+/**
+\brief Ends the processing of a task by the calling thread (what it spent writing or waiting isn't counted as processing)
+ @param task Statistics of the task
+ @param start Clock (stats_clock) when its processing started
+*/
+void stats_processed(TaskStats * task, double start);
+
+/**
+\brief Ends the write of a task by the calling thread (the time since it was processed is counted as waiting for the previous tasks)
+ @param task Statistics of the task
+ @param start Clock (stats_clock) when its write started
+*/
+void stats_written(TaskStats * task, double start);
+
+/**
+\brief Records the statistics of a task once it's written. Tasks are recorded in the order they were queued
+ Warning: Calls must be serialized (they are made by the thread writing the tasks)
+ @param task Statistics of the task
+*/
+void stats_record(const TaskStats * task);
+
+/**
+\brief Prints the statistics recorded since the module started as a JSON object in a single line
+ @param fd Stream where it's printed
+ @param module Name of the module
+ @param total_time Module's runtime (milliseconds)
+*/
+void stats_print(FILE * fd, const char * module, double total_time);
+
+#else
+
+static inline double stats_clock() { return 0; }
+static inline void stats_reset() {}
+static inline void stats_thread(unsigned int thread) { (void) thread; }
+static inline void stats_task(TaskStats * task) { (void) task; }
+static inline void stats_read(unsigned long long bytes, double start) { (void) bytes; (void) start; }
+static inline void stats_stall(double start) { (void) start; }
+static inline void stats_write(unsigned long long bytes, double start) { (void) bytes; (void) start; }
+static inline void stats_wait(double start) { (void) start; }
+static inline void stats_queue(TaskStats * task) { (void) task; }
+static inline void stats_processed(TaskStats * task, double start) { (void) task; (void) start; }
+static inline void stats_written(TaskStats * task, double start) { (void) task; (void) start; }
+static inline void stats_record(const TaskStats * task) { (void) task; }
+static inline void stats_print(FILE * fd, const char * module, double total_time) { (void) fd; (void) module; (void) total_time; }
+
+#endif //_NO_STATS
+
+#endif //UTILS_STATS_H
@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "codes.h"
+#include "errors.h"
+#include "table_cache.h"
+
+/*
+    States of the table of an entry
+*/
+typedef enum {
+    _TABLE_EMPTY,
+    _TABLE_BUILDING,
+    _TABLE_READY,
+} TableState;
+
+struct CachedTable {
+    uint64_t hash;
+    BlockCodes key;
+    void * table;
+    atomic_int state;
+    atomic_uint references; // Owners of the entry: The cache itself and every task using it
+    unsigned long long last_use;
+};
+
+/**
+\brief Hashes the codes of a block (FNV-1a)
+ @param block_codes Codes of the block
+ @returns Hash of the codes
+*/
+static uint64_t hash_codes(const BlockCodes * const block_codes)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const uint8_t * bytes = block_codes->text ? (const uint8_t *) block_codes->text : block_codes->lengths;
+    const size_t size = block_codes->text ? strlen(block_codes->text) : NUM_SYMBOLS;
+
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+
+    // Textual and canonical codes never match each other
+    return hash ^ (block_codes->text != NULL);
+}
+
+/**
+\brief Compares the codes of two blocks
+ @param a Codes of the first block
+ @param b Codes of the second block
+ @returns Whether they are the same
+*/
+static bool same_codes(const BlockCodes * const a, const BlockCodes * const b)
+{
+    if (!a->text || !b->text)
+        return !a->text && !b->text && !memcmp(a->lengths, b->lengths, NUM_SYMBOLS);
+
+    return !strcmp(a->text, b->text);
+}
+
+
+CachedTable * table_cache_get(TableCache * const cache, BlockCodes * const block_codes)
+{
+    const uint64_t hash = hash_codes(block_codes);
+    CachedTable * entry, ** slot = &cache->slots[0];
+
+    ++cache->clock;
+
+    for (int i = 0; i < TABLE_CACHE_SLOTS; ++i) {
+        entry = cache->slots[i];
+
+        if (entry && entry->hash == hash && same_codes(&entry->key, block_codes)) {
+            entry->last_use = cache->clock;
+            atomic_fetch_add(&entry->references, 1);
+            free(block_codes->text);
+            return entry;
+        }
+
+        // Empty slots are taken first, otherwise the least recently used one
+        if (*slot && (!entry || entry->last_use < (*slot)->last_use))
+            slot = &cache->slots[i];
+    }
+
+    entry = malloc(sizeof(CachedTable));
+
+    if (!entry) {
+        free(block_codes->text);
+        return NULL;
+    }
+
+    entry->hash = hash;
+    entry->key = *block_codes;
+    entry->table = NULL;
+    entry->last_use = cache->clock;
+    atomic_init(&entry->state, _TABLE_EMPTY);
+    atomic_init(&entry->references, 2); // The cache's and the caller's
+
+    if (*slot)
+        table_cache_release(cache, *slot, NULL);
+
+    *slot = entry;
+
+    return entry;
+}
+
+
+void table_cache_reference(CachedTable * const entry)
+{
+    atomic_fetch_add(&entry->references, 1);
+}
+
+
+_modules_error table_cache_acquire(const TableCache * const cache, CachedTable * const entry, const void ** const table)
+{
+    int state = atomic_load_explicit(&entry->state, memory_order_acquire);
+    _modules_error error;
+    void * new_table;
+
+    if (state == _TABLE_READY) {
+        *table = entry->table;
+        return _SUCCESS;
+    }
+
+    error = cache->build(&entry->key, &new_table);
+
+    // The first table built is shared, any other thread building it at the same time keeps its own (which is cheaper than waiting)
+    if (!error && state == _TABLE_EMPTY && atomic_compare_exchange_strong(&entry->state, &state, _TABLE_BUILDING)) {
+        entry->table = new_table;
+        atomic_store_explicit(&entry->state, _TABLE_READY, memory_order_release);
+    }
+
+    *table = error ? NULL : new_table;
+
+    return error;
+}
+
+
+void table_cache_release(const TableCache * const cache, CachedTable * const entry, const void * const table)
+{
+    // Tables that weren't shared belong to whoever built them (the shared one is only set once the entry is ready)
+    if (table && (atomic_load_explicit(&entry->state, memory_order_acquire) != _TABLE_READY || table != entry->table))
+        cache->destroy((void *) table);
+
+    if (atomic_fetch_sub_explicit(&entry->references, 1, memory_order_acq_rel) == 1) {
+        if (atomic_load_explicit(&entry->state, memory_order_acquire) == _TABLE_READY)
+            cache->destroy(entry->table);
+
+        free(entry->key.text);
+        free(entry);
+    }
+}
+
+
+void table_cache_clear(TableCache * const cache)
+{
+    for (int i = 0; i < TABLE_CACHE_SLOTS; ++i) {
+        if (cache->slots[i])
+            table_cache_release(cache, cache->slots[i], NULL);
+
+        cache->slots[i] = NULL;
+    }
+}
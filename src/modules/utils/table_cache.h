@@ -0,0 +1,70 @@
+#ifndef UTILS_TABLE_CACHE_H
+#define UTILS_TABLE_CACHE_H
+
+#include <stdint.h>
+
+#include "codes.h"
+#include "errors.h"
+
+/*
+    Tables (encoding or decoding) built from the codes of a block are shared by every block with the same codes.
+    The cache is only looked up by the thread queuing the tasks, while the tables are built by the worker threads on demand
+*/
+#define TABLE_CACHE_SLOTS 16
+
+/**
+\brief Table built from the codes of a block (opaque)
+*/
+typedef struct CachedTable CachedTable;
+
+/**
+\brief Cache of the tables built from the codes of the blocks of a file
+*/
+typedef struct {
+    _modules_error (* build)(const BlockCodes * block_codes, void ** table); // Allocates a table from the codes
+    void (* destroy)(void * table); // Releases a table allocated by `build`
+    CachedTable * slots[TABLE_CACHE_SLOTS];
+    unsigned long long clock; // Last use of each slot for the replacement
+} TableCache;
+
+/**
+\brief Finds the entry of the cache for the codes of a block, creating it if there isn't one (the table itself is only built by table_cache_acquire)
+ Warning: This function isn't thread-safe itself
+ @param cache Cache of the tables
+ @param block_codes Codes of the block. Its text is owned by the cache from now on (even on error)
+ @returns Referenced entry of the cache (NULL on lack of memory) which must be released with table_cache_release
+*/
+CachedTable * table_cache_get(TableCache * cache, BlockCodes * block_codes);
+
+/**
+\brief Adds a reference to an entry given by table_cache_get (for another task using it)
+ Warning: The caller must still hold a reference to it
+ @param entry Entry given by table_cache_get
+*/
+void table_cache_reference(CachedTable * entry);
+
+/**
+\brief Gets the table of an entry, building it if no other thread did it yet. It's safe to call from any thread
+ @param cache Cache of the tables
+ @param entry Entry given by table_cache_get
+ @param table Address to load the table
+ @returns Error status
+*/
+_modules_error table_cache_acquire(const TableCache * cache, CachedTable * entry, const void ** table);
+
+/**
+\brief Releases the reference to an entry (and the table given by table_cache_acquire, if any). It's safe to call from any thread
+ @param cache Cache of the tables
+ @param entry Entry given by table_cache_get
+ @param table Table given by table_cache_acquire (NULL if it wasn't acquired)
+*/
+void table_cache_release(const TableCache * cache, CachedTable * entry, const void * table);
+
+/**
+\brief Drops every entry of the cache (tables still in use are released by their last owner)
+ Warning: This function isn't thread-safe itself
+ @param cache Cache of the tables
+*/
+void table_cache_clear(TableCache * cache);
+
+#endif //UTILS_TABLE_CACHE_H
@@ -10,17 +10,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <stdbool.h>
 
 #include "modules/f.h"
 #include "modules/t.h"
 #include "modules/c.h"
 #include "modules/d.h"
+#include "modules/stream.h"
+#include "modules/container.h"
+#include "modules/pipeline.h"
 #include "modules/utils/file.h"
+#include "modules/utils/stats.h"
 #include "modules/utils/errors.h"
 #include "modules/utils/extensions.h"
 #include "modules/utils/multithread.h"
 
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#define MAX_THREADS 1024
+#define STREAM_FILE "-"
+
 /*
     Every option parsed from user's input
 */
@@ -34,6 +47,15 @@ typedef struct {
     bool f_force_freq;
     bool d_shaf;
     bool d_rle;
+    bool keep_intermediates;
+    bool text_codes;
+    bool text_freq;
+    bool index;
+    unsigned long sync_interval; // Symbols between the sync points of each block (0 for none)
+    unsigned int num_streams; // Bitstreams the symbols of each block are interleaved into
+    bool container;
+    bool range;
+    ByteRange byte_range;
 } Options;
 
 
@@ -47,7 +69,8 @@ typedef struct {
 static bool parse(const int argc, char * const argv[], Options * const options, char ** const file)
 {
     char opt;
-    char * key, * value;
+    char * key, * value, * end;
+    unsigned long num;
 
     for (int i = 1; i < argc; ++i) { // argv[0] == "./shafa"
         key = argv[i];
@@ -55,7 +78,76 @@ static bool parse(const int argc, char * const argv[], Options * const options,
         if (strcmp(key, "--no-multithread") == 0)
             NO_MULTITHREAD = true;
 
-        else if (key[0] != '-') {
+        else if (strcmp(key, "--keep-intermediates") == 0)
+            options->keep_intermediates = true;
+
+        else if (strcmp(key, "--text-codes") == 0)
+            options->text_codes = true;
+
+        else if (strcmp(key, "--text-freq") == 0)
+            options->text_freq = true;
+
+        else if (strcmp(key, "--index") == 0)
+            options->index = true;
+
+        else if (strcmp(key, "--container") == 0)
+            options->container = true;
+
+        else if (strcmp(key, "--mem-limit") == 0) { // In MiB
+            if (++i >= argc)
+                return false;
+
+            num = strtoul(argv[i], &end, 10);
+
+            // strtoul wraps a negative number around and a limit too large would wrap to 0 (unlimited)
+            if (*end || !num || *argv[i] == '-' || num > ULLONG_MAX / (_1KiB * _1KiB))
+                return false;
+
+            MEMORY_LIMIT = (unsigned long long) num * _1KiB * _1KiB;
+        }
+
+        else if (strcmp(key, "--sync") == 0) { // In KiB
+            if (++i >= argc)
+                return false;
+
+            num = strtoul(argv[i], &end, 10);
+
+            if (*end || !num || num > ULONG_MAX / _1KiB)
+                return false;
+
+            // Sync points are kept in the block index
+            options->sync_interval = num * _1KiB;
+            options->index = true;
+        }
+
+        else if (strcmp(key, "--streams") == 0) { // 2|4
+            if (++i >= argc)
+                return false;
+
+            num = strtoul(argv[i], &end, 10);
+
+            if (*end || (num != 2 && num != MAX_STREAMS))
+                return false;
+
+            options->num_streams = num;
+        }
+
+        else if (strcmp(key, "--stats") == 0) { // json|quiet
+            if (++i >= argc)
+                return false;
+
+#ifndef _NO_STATS
+            if (strcmp(argv[i], "json") == 0)
+                STATS = STATS_JSON;
+            else
+#endif
+            if (strcmp(argv[i], "quiet") == 0)
+                STATS = STATS_QUIET;
+            else
+                return false;
+        }
+
+        else if (key[0] != '-' || strcmp(key, STREAM_FILE) == 0) { // "-" stands for stdin/stdout
             if (*file) // There is a path to file already as an argument
                 return false;
 
@@ -68,7 +160,38 @@ static bool parse(const int argc, char * const argv[], Options * const options,
 
             value = argv[i];
 
-            if (strlen(key) != 2 || strlen(value) != 1)
+            if (strlen(key) != 2)
+                return false;
+
+            if (key[1] == 't') { // Number of threads
+                num = strtoul(value, &end, 10);
+
+                if (*end || !num || num > MAX_THREADS)
+                    return false;
+
+                NUM_THREADS = num;
+                continue;
+            }
+
+            if (key[1] == 'r') { // Range of the decompressed file: start:length
+                if (*value < '0' || *value > '9')
+                    return false;
+
+                options->byte_range.start = strtoull(value, &end, 10);
+
+                if (*end != ':' || end[1] < '0' || end[1] > '9')
+                    return false;
+
+                options->byte_range.size = strtoull(end + 1, &end, 10);
+
+                if (*end || !options->byte_range.size || options->byte_range.size > ULLONG_MAX - options->byte_range.start)
+                    return false;
+
+                options->range = true;
+                continue;
+            }
+
+            if (strlen(value) != 1)
                 return false;
         
             opt = *value;
@@ -152,9 +275,45 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
     _modules_error error;
     char * tmp_file;
     bool file_rle_shaf = false, decompressed = false;
+
+    // Ranges are found through the index of the blocks, which only .shaf files (with --index) and containers have
+    if (options.range && (!options.module_d || options.d_shaf || options.d_rle)) {
+        fputs("Module d: A range (-r) can only be extracted by module 'd' decompressing the file as a whole (without -d)...\n", stderr);
+        return _OUTSIDE_MODULE;
+    }
+
+    // Interleaved streams are a layout of the .shaf file, whose sync points (and the codification of a block in chunks) need a single stream
+    if (options.num_streams > 1 && (options.sync_interval || options.container)) {
+        fputs("Modules f, t & c: Interleaved streams (--streams) can't be used along with --sync or --container...\n", stderr);
+        return _OUTSIDE_MODULE;
+    }
+
+    // A container keeps everything in a single file, so there are no intermediate files
+    if (options.container && options.module_f && options.module_t && options.module_c) {
+        error = container_compress(ptr_file, options.f_force_rle, options.block_size);
+
+        if (error) {
+            fputs("Modules f, t & c: Something went wrong while compressing into a container...\n", stderr);
+            return error;
+        }
+
+        options.module_f = options.module_t = options.module_c = false; // Already executed
+    }
+
+    // Modules F, T and C are fused unless the user explicitly asked for the intermediate files (.rle and .freq)
+    if (options.module_f && options.module_t && options.module_c && !options.keep_intermediates && !options.f_force_freq) {
+        error = pipeline_compress(ptr_file, options.f_force_rle, options.block_size, !options.text_codes, options.index, options.sync_interval, options.num_streams);
+
+        if (error) {
+            fputs("Modules f, t & c: Something went wrong while compressing...\n", stderr);
+            return error;
+        }
+
+        options.module_f = options.module_t = options.module_c = false; // Already executed
+    }
     
     if (options.module_f) {
-        error = freq_rle_compress(ptr_file, options.f_force_rle, options.f_force_freq, options.block_size); // Returns true if file was RLE compressed
+        error = freq_rle_compress(ptr_file, options.f_force_rle, options.f_force_freq, options.block_size, !options.text_freq); // Returns true if file was RLE compressed
 
         if (error) {
             fputs("Module f: Something went wrong while compressing with RLE or creating frequencies' table...\n", stderr);
@@ -180,7 +339,7 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
             }
         }
 
-        error = get_shafa_codes(*ptr_file); // If file doesn't end in .rle then its considered an uncompressed one
+        error = get_shafa_codes(*ptr_file, !options.text_codes); // If file doesn't end in .rle then its considered an uncompressed one
 
         if (error) {
             fputs("Module t: Something went wrong...\n", stderr);
@@ -195,7 +354,7 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
             return _OUTSIDE_MODULE;
         }
 
-        error = shafa_compress(ptr_file); // If file doesn't end in .rle then its considered an uncompressed one
+        error = shafa_compress(ptr_file, options.index, options.sync_interval, options.num_streams); // If file doesn't end in .rle then its considered an uncompressed one
 
         if (error) {
             fputs("Module c: Something went wrong...\n", stderr);
@@ -203,6 +362,23 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
         }
     }
 
+    if (options.module_d && check_ext(*ptr_file, CONTAINER_EXT)) {
+
+        if (options.module_f || options.module_t || options.module_c || options.d_shaf || options.d_rle) { // Conflict
+            fputs("Module d: A container can only be decompressed as a whole (without -d)...\n", stderr);
+            return _OUTSIDE_MODULE;
+        }
+
+        error = container_decompress(ptr_file, options.range ? &options.byte_range : NULL);
+
+        if (error) {
+            fputs("Module d: Something went wrong while decompressing the container...\n", stderr);
+            return error;
+        }
+
+        options.module_d = false; // Already executed
+    }
+
     if (options.module_d) {
 
         if ((options.module_f && (!options.module_t || !options.module_c) && !check_ext(*ptr_file, RLE_EXT)) || (options.module_t && !options.module_c)) { // Conflict
@@ -229,10 +405,10 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
                     }
                 }
 
-                error = shafa_decompress(ptr_file, (options.d_rle || !options.d_shaf) && (file_rle_shaf || check_ext(*ptr_file, RLE_EXT SHAFA_EXT))); // RLE => Trigger: NULL | -m d
+                error = shafa_decompress(ptr_file, (options.d_rle || !options.d_shaf) && (file_rle_shaf || check_ext(*ptr_file, RLE_EXT SHAFA_EXT)), options.range ? &options.byte_range : NULL); // RLE => Trigger: NULL | -m d
 
                 if (error) {
-                    fputs("Module d: Something went wrong while decompressing...\n", stderr);
+                    fputs(options.range ? "Module d: Something went wrong while decompressing the range (was the file compressed with --index?)...\n" : "Module d: Something went wrong while decompressing...\n", stderr);
                     return error;
                 }
                 else
@@ -242,8 +418,8 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
         
         if (!decompressed && (options.d_rle || !options.d_shaf)) { // Trigger: NULL | -m d | -m d -d r (Won't execute this statement if had already been decompressed) 
 
-            if (!check_ext(*ptr_file, RLE_EXT)) { 
-                fprintf(stderr, "Module d: Wrong extension... Should end in %s\n", RLE_EXT);
+            if (!check_ext(*ptr_file, RLE_EXT) || options.range) { 
+                fprintf(stderr, "Module d: Wrong extension... Should end in %s\n", options.range ? SHAFA_EXT : RLE_EXT);
                 return _OUTSIDE_MODULE;
             }
 
@@ -258,10 +434,41 @@ _modules_error execute_modules(Options options, char ** const ptr_file) // bette
     return _SUCCESS;
 }
 
+/**
+\brief Compresses stdin to stdout (or decompresses it with `-m d`) without any intermediate file
+ @param options A struct to the Options parsed from the user's input
+ @returns Error status
+*/
+_modules_error execute_stream(const Options options)
+{
+    _modules_error error;
+    const bool compression = !options.module_d && (options.module_f == options.module_t && options.module_t == options.module_c);
+
+    if (options.range || (!compression && (options.module_f || options.module_t || options.module_c || options.d_shaf || options.d_rle))) {
+        fputs("Stream: Only the whole compression or decompression (-m d) can be executed...\n", stderr);
+        return _OUTSIDE_MODULE;
+    }
+
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    if (compression)
+        error = stream_compress(stdin, stdout, options.f_force_rle, options.block_size ? options.block_size : _64KiB);
+    else
+        error = stream_decompress(stdin, stdout);
+
+    if (error)
+        fprintf(stderr, "Stream: Something went wrong while %s...\n", compression ? "compressing" : "decompressing");
+
+    return error;
+}
+
 
 int main (const int argc, char * const argv[])
 {
-    Options options = {0}; // Reference C99 Standard 6.7.8.21
+    Options options = { .num_streams = 1 }; // Reference C99 Standard 6.7.8.21
     char * file = NULL;
     int error;
 
@@ -280,6 +487,16 @@ int main (const int argc, char * const argv[])
         return 1;
     }
 
+    // Blocks are read from stdin and written to stdout as they come, so nothing is known about the file
+    if (strcmp(file, STREAM_FILE) == 0) {
+        error = execute_stream(options);
+
+        if (error && error != _OUTSIDE_MODULE)
+            fputs(error_msg(error), stderr);
+
+        return error ? 1 : 0;
+    }
+
     // Have to otherwise it will raise error if some modules tries to free it in order to change the pointer to the new file's path
     file = add_ext(file, ""); // does the same as `strdup` from <string.h> which is not supported in c17
 
@@ -291,7 +508,7 @@ int main (const int argc, char * const argv[])
 
 
     if (!options.module_f && !options.module_t && !options.module_c && !options.module_d) {
-        if (check_ext(file, SHAFA_EXT)) // if user wants to decompress a RLE only then they must specify `-m d` which will be equivalent to `-m d -d r`
+        if (check_ext(file, SHAFA_EXT) || check_ext(file, CONTAINER_EXT)) // if user wants to decompress a RLE only then they must specify `-m d` which will be equivalent to `-m d -d r`
             options.module_d = 1;
         else
             options.module_f = options.module_t = options.module_c = 1;